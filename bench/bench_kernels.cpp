@@ -0,0 +1,399 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include "common.hpp"
+#include "aabb.hpp"
+#include "sphere.hpp"
+#include "material.hpp"
+#include "flat_bvh.hpp"
+#include "world.hpp"
+
+// Times the kernels the renderer spends its time in, one at a time, and reports nanoseconds per
+// call. Inputs are drawn up front from a fixed stream per benchmark, so the numbers are
+// comparable between runs and builds and don't include making the inputs.
+//
+// Usage: ray-tracer-microbench [filter], where only benchmarks whose name contains `filter` run.
+
+constexpr size_t INPUT_COUNT = 1 << 12;
+constexpr size_t BVH_PRIMITIVES = 1 << 16;
+constexpr size_t BVH_RAYS = 1 << 14;
+constexpr double MIN_SECONDS = 0.05;
+constexpr int REPEATS = 5;
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Runs the kernel `iterations` times and returns something derived from every result, so the
+ * compiler can't drop the calls.
+ */
+using Kernel = std::function<float(size_t iterations)>;
+
+struct Benchmark
+{
+    const char* name;
+    std::function<Kernel()> setup;
+
+    // Operations each iteration counts as
+    size_t ops_per_iteration = 1;
+};
+
+// Results end up here for the same reason
+static volatile float g_sink = 0.0f;
+
+static double seconds_since(const Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Doubles the iteration count until a run takes `MIN_SECONDS`, then reports the fastest of
+ * `REPEATS` runs, which is the one least disturbed by the rest of the system.
+ */
+static double measure(const Kernel& kernel, const size_t ops_per_iteration)
+{
+    size_t iterations = 1;
+    for (;;)
+    {
+        const auto start = Clock::now();
+        g_sink = g_sink + kernel(iterations);
+        if (seconds_since(start) >= MIN_SECONDS)
+            break;
+        iterations *= 2;
+    }
+
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; i++)
+    {
+        const auto start = Clock::now();
+        g_sink = g_sink + kernel(iterations);
+        best = std::min(best, seconds_since(start));
+    }
+    return best * 1e9 / (double(iterations) * double(ops_per_iteration));
+}
+
+static std::vector<ray> random_rays(const size_t count)
+{
+    std::vector<ray> rays = {};
+    rays.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // From a shell around the unit cube towards a point inside it
+        const auto origin = 3.0f * vec3::random_unit_vector();
+        const auto target = vec3::random(-1.0f, 1.0f);
+        rays.push_back(ray(origin, target - origin));
+    }
+
+    return rays;
+}
+
+/**
+ * Rays through a grid on a plane facing the unit cube, the way camera rays arrive at a scene.
+ */
+static std::vector<ray> coherent_rays(const size_t count)
+{
+    const size_t side = size_t(std::sqrt(double(count)));
+    const point3 eye(0.0f, 0.0f, 3.0f);
+
+    std::vector<ray> rays = {};
+    rays.reserve(side * side);
+    for (size_t y = 0; y < side; y++)
+    {
+        for (size_t x = 0; x < side; x++)
+        {
+            const point3 target(2.0f * float(x) / float(side) - 1.0f, 2.0f * float(y) / float(side) - 1.0f, 0.0f);
+            rays.push_back(ray(eye, target - eye));
+        }
+    }
+
+    return rays;
+}
+
+static std::vector<aabb> random_boxes(const size_t count)
+{
+    std::vector<aabb> boxes = {};
+    boxes.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto center = vec3::random(-1.0f, 1.0f);
+        const auto extent = vec3::random(0.005f, 0.02f);
+        boxes.push_back(aabb(center - extent, center + extent));
+    }
+
+    return boxes;
+}
+
+/**
+ * Records of rays from `random_rays` hitting the unit sphere, for the materials to scatter.
+ */
+static std::vector<std::pair<ray, HitRecord>> random_hits(const size_t count)
+{
+    const Sphere sphere(point3(0, 0, 0), 1.0f, 0);
+    std::vector<std::pair<ray, HitRecord>> hits = {};
+    hits.reserve(count);
+
+    while (hits.size() < count)
+    {
+        for (const auto& r : random_rays(count))
+        {
+            HitRecord rec;
+            if (hits.size() < count && sphere.hit(r, World::T_MIN, World::T_MAX, rec))
+                hits.emplace_back(r, rec);
+        }
+    }
+
+    return hits;
+}
+
+static Kernel bench_random_float()
+{
+    return [](const size_t iterations)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < iterations; i++)
+            sum += random_float();
+        return sum;
+    };
+}
+
+static Kernel bench_random_unit_vector()
+{
+    return [](const size_t iterations)
+    {
+        vec3 sum;
+        for (size_t i = 0; i < iterations; i++)
+            sum += vec3::random_unit_vector();
+        return sum.x();
+    };
+}
+
+/**
+ * Pairs of random vectors for the `vec3` benchmarks, whose operations are timed on their own.
+ */
+static std::shared_ptr<std::vector<vec3>> random_vectors()
+{
+    auto vectors = std::make_shared<std::vector<vec3>>();
+    for (size_t i = 0; i < INPUT_COUNT * 2; i++)
+        vectors->push_back(vec3::random(-1.0f, 1.0f));
+    return vectors;
+}
+
+static Kernel bench_vec3_dot()
+{
+    return [v = random_vectors()](const size_t iterations)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const size_t j = (i % INPUT_COUNT) * 2;
+            sum += vec3::dot((*v)[j], (*v)[j + 1]);
+        }
+        return sum;
+    };
+}
+
+static Kernel bench_vec3_cross()
+{
+    return [v = random_vectors()](const size_t iterations)
+    {
+        vec3 sum;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const size_t j = (i % INPUT_COUNT) * 2;
+            sum += vec3::cross((*v)[j], (*v)[j + 1]);
+        }
+        return sum.x();
+    };
+}
+
+static Kernel bench_vec3_unit_vector()
+{
+    return [v = random_vectors()](const size_t iterations)
+    {
+        vec3 sum;
+        for (size_t i = 0; i < iterations; i++)
+            sum += vec3::unit_vector((*v)[i % (INPUT_COUNT * 2)]);
+        return sum.x();
+    };
+}
+
+static Kernel bench_vec3_fma()
+{
+    return [v = random_vectors()](const size_t iterations)
+    {
+        vec3 sum;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const size_t j = (i % INPUT_COUNT) * 2;
+            sum = vec3::fma((*v)[j], (*v)[j + 1], sum);
+        }
+        return sum.x();
+    };
+}
+
+static Kernel bench_ray_construction()
+{
+    return [v = random_vectors()](const size_t iterations)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const size_t j = (i % INPUT_COUNT) * 2;
+            sum += ray((*v)[j], (*v)[j + 1]).direction().x();
+        }
+        return sum;
+    };
+}
+
+static Kernel bench_aabb_hit()
+{
+    // The rays' reciprocals are computed on first use, so the timed runs reuse them as a
+    // traversal does
+    auto boxes = std::make_shared<std::vector<aabb>>(random_boxes(INPUT_COUNT));
+    auto rays = std::make_shared<std::vector<ray>>(random_rays(INPUT_COUNT));
+    for (const auto& r : *rays)
+        (*boxes)[0].hit(r, World::T_MIN, World::T_MAX);
+
+    return [boxes, rays](const size_t iterations)
+    {
+        float hits = 0.0f;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            // Different strides so every ray meets many boxes
+            const auto& r = (*rays)[i % INPUT_COUNT];
+            hits += (*boxes)[(i * 7) % INPUT_COUNT].hit(r, World::T_MIN, World::T_MAX) ? 1.0f : 0.0f;
+        }
+        return hits;
+    };
+}
+
+static Kernel bench_sphere_hit()
+{
+    auto spheres = std::make_shared<std::vector<Sphere>>();
+    for (size_t i = 0; i < INPUT_COUNT; i++)
+        spheres->emplace_back(vec3::random(-0.5f, 0.5f), random_float(0.1f, 0.5f), 0);
+    auto rays = std::make_shared<std::vector<ray>>(random_rays(INPUT_COUNT));
+
+    return [spheres, rays](const size_t iterations)
+    {
+        float sum = 0.0f;
+        HitRecord rec;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const auto& r = (*rays)[i % INPUT_COUNT];
+            if ((*spheres)[(i * 7) % INPUT_COUNT].hit(r, World::T_MIN, World::T_MAX, rec))
+                sum += rec.t;
+        }
+        return sum;
+    };
+}
+
+static Kernel bench_scatter(std::shared_ptr<Material> material)
+{
+    auto hits = std::make_shared<std::vector<std::pair<ray, HitRecord>>>(random_hits(INPUT_COUNT));
+
+    return [material, hits](const size_t iterations)
+    {
+        float sum = 0.0f;
+        color attenuation;
+        ray scattered;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            const auto& hit = (*hits)[i % INPUT_COUNT];
+            if (material->scatter(hit.first, hit.second, attenuation, scattered))
+                sum += scattered.direction().x();
+        }
+        return sum;
+    };
+}
+
+/**
+ * Each iteration builds the whole tree. Reported per primitive.
+ */
+static Kernel bench_bvh_build(const BvhBuilder builder)
+{
+    auto boxes = std::make_shared<std::vector<aabb>>(random_boxes(BVH_PRIMITIVES));
+
+    return [boxes, builder](const size_t iterations)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < iterations; i++)
+            sum += float(FlatBvh::build(*boxes, builder).memory_usage());
+        return sum;
+    };
+}
+
+/**
+ * Closest hits of `rays` against a world of small spheres spread through the unit cube.
+ */
+static Kernel bench_bvh_traverse(const BvhBuilder builder, std::vector<ray> (*make_rays)(size_t))
+{
+    auto world = std::make_shared<World>();
+    const auto mat = world->add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    for (size_t i = 0; i < BVH_PRIMITIVES; i++)
+        world->add_object(Sphere(vec3::random(-1.0f, 1.0f), random_float(0.005f, 0.02f), mat));
+    world->compute_bvh(builder);
+    auto rays = std::make_shared<std::vector<ray>>(make_rays(BVH_RAYS));
+
+    return [world, rays](const size_t iterations)
+    {
+        float sum = 0.0f;
+        HitRecord rec;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            if (world->hit((*rays)[i % rays->size()], World::T_MIN, World::T_MAX, rec))
+                sum += rec.t;
+        }
+        return sum;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    const Benchmark benchmarks[] =
+    {
+        { "random_float", bench_random_float },
+        { "vec3::random_unit_vector", bench_random_unit_vector },
+        { "vec3::dot", bench_vec3_dot },
+        { "vec3::cross", bench_vec3_cross },
+        { "vec3::unit_vector", bench_vec3_unit_vector },
+        { "vec3::fma", bench_vec3_fma },
+        { "ray::ray", bench_ray_construction },
+        { "aabb::hit", bench_aabb_hit },
+        { "Sphere::hit", bench_sphere_hit },
+        { "Lambertian::scatter", [] { return bench_scatter(std::make_shared<Lambertian>(color(0.5f, 0.5f, 0.5f))); } },
+        { "Metal::scatter", [] { return bench_scatter(std::make_shared<Metal>(color(0.8f, 0.8f, 0.8f), 0.3f)); } },
+        { "Dielectric::scatter", [] { return bench_scatter(std::make_shared<Dielectric>(1.5f)); } },
+        { "FlatBvh::build sah (per prim)", [] { return bench_bvh_build(BvhBuilder::Sah); }, BVH_PRIMITIVES },
+        { "FlatBvh::build median (per prim)", [] { return bench_bvh_build(BvhBuilder::Median); }, BVH_PRIMITIVES },
+        { "World::hit sah coherent", [] { return bench_bvh_traverse(BvhBuilder::Sah, coherent_rays); } },
+        { "World::hit sah incoherent", [] { return bench_bvh_traverse(BvhBuilder::Sah, random_rays); } },
+        { "World::hit median coherent", [] { return bench_bvh_traverse(BvhBuilder::Median, coherent_rays); } },
+        { "World::hit median incoherent", [] { return bench_bvh_traverse(BvhBuilder::Median, random_rays); } },
+    };
+
+    uint64_t stream = 0;
+    for (const auto& benchmark : benchmarks)
+    {
+        // Each benchmark draws from its own stream, so filtering doesn't change the inputs
+        seed_random_stream(stream++);
+        if (std::strstr(benchmark.name, filter) == nullptr)
+            continue;
+
+        const Kernel kernel = benchmark.setup();
+        std::cout << std::left << std::setw(34) << benchmark.name
+            << std::right << std::fixed << std::setprecision(2) << std::setw(10) << measure(kernel, benchmark.ops_per_iteration)
+            << " ns/op" << std::endl;
+    }
+
+    return 0;
+}
\ No newline at end of file
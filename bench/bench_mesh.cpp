@@ -0,0 +1,394 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "common.hpp"
+#include "triangle_mesh.hpp"
+#include "world.hpp"
+#include "sphere.hpp"
+#include "camera.hpp"
+#include "image.hpp"
+#include "thread_pool.hpp"
+
+// Measures the memory cost per triangle and the intersection throughput of the mesh layouts.
+// Everything is seeded so runs are comparable.
+
+constexpr uint32_t SPHERE_RINGS = 256;
+constexpr uint32_t SPHERE_SEGMENTS = 512;
+constexpr size_t WORLD_RAYS = 1 << 20;
+constexpr size_t KERNEL_TRIANGLES = 4096;
+constexpr size_t KERNEL_RAYS = 1 << 12;
+constexpr int INSTANCE_GRID = 4;
+constexpr size_t REFIT_SPHERES = 1 << 17;
+constexpr int REFIT_FRAMES = 8;
+constexpr size_t REFIT_RAYS = 1 << 16;
+constexpr float MOTION_DISTANCE = 0.05f;
+constexpr size_t CAMERA_IMAGE_SIZE = 512;
+constexpr size_t CAMERA_SAMPLES = 16;
+constexpr size_t OUTPUT_WIDTH = 1920;
+constexpr size_t OUTPUT_HEIGHT = 1080;
+constexpr int OUTPUT_REPEATS = 16;
+
+// Approximate heap cost of an object held through `std::make_shared`: the reference counts in the
+// control block and the `shared_ptr` stored in the world's object list
+constexpr size_t SHARED_OBJECT_OVERHEAD = 2 * sizeof(long) + sizeof(std::shared_ptr<Hittable>);
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<ray> make_rays(const size_t count)
+{
+    std::vector<ray> rays = {};
+    rays.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // From a shell around the unit sphere towards a point inside it
+        const auto origin = 3.0f * vec3::random_unit_vector();
+        const auto target = 0.5f * vec3::random_in_unit_sphere();
+        rays.push_back(ray(origin, target - origin));
+    }
+
+    return rays;
+}
+
+static double seconds_since(const Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_world(
+    const char* name,
+    const TriangleMesh& mesh,
+    const MeshLayout layout,
+    const std::vector<ray>& rays
+)
+{
+    World world;
+    const auto mat = world.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    world.add_mesh(mesh, mat, layout);
+
+    const auto build_start = Clock::now();
+    world.compute_bvh();
+    const double build_time = seconds_since(build_start);
+
+    const size_t objects = world.object_count();
+    const double tris = double(mesh.triangle_count());
+
+    const size_t object_bytes = layout == MeshLayout::Triangles ? sizeof(Triangle) : sizeof(TrianglePacket);
+    const double bytes_per_tri = (
+        double(mesh.memory_usage())
+        + double(objects) * double(object_bytes + SHARED_OBJECT_OVERHEAD)
+        + double(world.bvh().memory_usage())
+    ) / tris;
+
+    size_t hits = 0;
+    HitRecord rec;
+    const auto start = Clock::now();
+    for (const auto& r : rays)
+        hits += world.hit(r, 0.001f, std::numeric_limits<float>::max(), rec) ? 1 : 0;
+    const double elapsed = seconds_since(start);
+
+    std::cout << std::left << std::setw(10) << name << std::setprecision(4)
+        << " objects: " << objects
+        << ", bytes/tri: " << bytes_per_tri
+        << ", BVH build: " << build_time * 1e3 << " ms"
+        << ", " << double(rays.size()) / elapsed * 1e-6 << " Mrays/s"
+        << " (" << hits << " hits)" << std::endl;
+}
+
+static void bench_instances(const TriangleMesh& mesh, const std::vector<ray>& rays)
+{
+    auto shape = std::make_shared<Shape>();
+    shape->add_mesh(mesh, 0, MeshLayout::Packets);
+    shape->compute_bvh();
+
+    // A grid of small copies filling the same volume as the single mesh
+    World world;
+    world.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    const float spacing = 1.6f / float(INSTANCE_GRID);
+    for (int x = 0; x < INSTANCE_GRID; x++)
+    {
+        for (int y = 0; y < INSTANCE_GRID; y++)
+        {
+            for (int z = 0; z < INSTANCE_GRID; z++)
+            {
+                const auto offset = spacing * (vec3(float(x), float(y), float(z)) - vec3(0.5f, 0.5f, 0.5f) * float(INSTANCE_GRID - 1));
+                world.add_instance(shape, Transform::translate(offset) * Transform::scale(vec3(0.4f, 0.4f, 0.4f) * spacing));
+            }
+        }
+    }
+
+    const auto build_start = Clock::now();
+    world.compute_bvh();
+    const double build_time = seconds_since(build_start);
+
+    const size_t instances = world.object_count();
+    const double tris = double(instances) * double(mesh.triangle_count());
+    const double bytes_per_tri = (
+        double(mesh.memory_usage())
+        + double(shape->object_count()) * double(sizeof(TrianglePacket) + SHARED_OBJECT_OVERHEAD)
+        + double(shape->bvh().memory_usage())
+        + double(instances) * double(sizeof(Instance) + SHARED_OBJECT_OVERHEAD)
+        + double(world.bvh().memory_usage())
+    ) / tris;
+
+    size_t hits = 0;
+    HitRecord rec;
+    const auto start = Clock::now();
+    for (const auto& r : rays)
+        hits += world.hit(r, 0.001f, std::numeric_limits<float>::max(), rec) ? 1 : 0;
+    const double elapsed = seconds_since(start);
+
+    std::cout << std::left << std::setw(10) << "instances" << std::setprecision(4)
+        << " objects: " << instances
+        << ", bytes/tri: " << bytes_per_tri
+        << ", BVH build: " << build_time * 1e3 << " ms"
+        << ", " << double(rays.size()) / elapsed * 1e-6 << " Mrays/s"
+        << " (" << hits << " hits)" << std::endl;
+}
+
+static double trace(const World& world, const std::vector<ray>& rays)
+{
+    HitRecord rec;
+    const auto start = Clock::now();
+    for (const auto& r : rays)
+        world.hit(r, 0.001f, std::numeric_limits<float>::max(), rec);
+    return double(rays.size()) / seconds_since(start) * 1e-6;
+}
+
+static void bench_refit(const std::vector<ray>& rays, ThreadPool& pool)
+{
+    // Small spheres in the unit ball that spread out a little more every frame
+    World world;
+    world.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    std::vector<point3> centers = {};
+    std::vector<vec3> velocities = {};
+    for (size_t i = 0; i < REFIT_SPHERES; i++)
+    {
+        centers.push_back(0.9f * vec3::random_in_unit_sphere());
+        velocities.push_back(0.02f * vec3::random_in_unit_sphere());
+        world.add_object(Sphere(centers.back(), 0.01f, 0));
+    }
+    world.compute_bvh();
+
+    std::vector<Sphere*> spheres = {};
+    for (const auto& object : world.objects())
+        spheres.push_back(static_cast<Sphere*>(object.get()));
+
+    for (const float threshold : { INFINITY, FlatBvh::DEFAULT_REBUILD_THRESHOLD })
+    {
+        World moved;
+        moved.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+        for (const auto& c : centers) moved.add_object(Sphere(c, 0.01f, 0));
+        moved.compute_bvh();
+
+        std::vector<Sphere*> moved_spheres = {};
+        for (const auto& object : moved.objects())
+            moved_spheres.push_back(static_cast<Sphere*>(object.get()));
+
+        double refit_time = 0.0;
+        double rebuild_time = 0.0;
+        size_t rebuilt = 0;
+        for (int frame = 1; frame <= REFIT_FRAMES; frame++)
+        {
+            for (size_t i = 0; i < moved_spheres.size(); i++)
+                moved_spheres[i]->set_center(centers[i] + float(frame) * velocities[i]);
+
+            const auto stats = moved.refit(pool, threshold);
+            refit_time += stats.refit_seconds;
+            rebuild_time += stats.rebuild_seconds;
+            rebuilt += stats.full_rebuild ? stats.subtrees : stats.rebuilt_subtrees;
+        }
+
+        std::cout << (std::isinf(threshold) ? "refit only:   " : "refit+rebuild:") << std::setprecision(4)
+            << " refit " << refit_time / REFIT_FRAMES * 1e3 << " ms/frame"
+            << ", rebuild " << rebuild_time / REFIT_FRAMES * 1e3 << " ms/frame"
+            << " (" << rebuilt << " subtrees)"
+            << ", last frame " << trace(moved, rays) << " Mrays/s" << std::endl;
+    }
+
+    // Reference: the last frame's positions built from scratch
+    for (size_t i = 0; i < spheres.size(); i++)
+        spheres[i]->set_center(centers[i] + float(REFIT_FRAMES) * velocities[i]);
+    const auto build_start = Clock::now();
+    world.compute_bvh();
+    const double build_time = seconds_since(build_start);
+
+    std::cout << "full build:    " << build_time * 1e3 << " ms/frame, "
+        << trace(world, rays) << " Mrays/s" << std::endl;
+}
+
+static void bench_motion(const std::vector<ray>& rays)
+{
+    // The refit benchmark's spheres drifting together a few radii while the shutter is open,
+    // each a little off the shared direction
+    World still;
+    World moving;
+    still.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    moving.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+    for (size_t i = 0; i < REFIT_SPHERES; i++)
+    {
+        const point3 center = 0.9f * vec3::random_in_unit_sphere();
+        const point3 center_end = center + MOTION_DISTANCE * (vec3(1, 0, 0) + 0.25f * vec3::random_in_unit_sphere());
+        still.add_object(Sphere(center, 0.01f, 0));
+        moving.add_object(Sphere(center, center_end, 0.01f, 0));
+    }
+
+    std::vector<ray> timed = {};
+    timed.reserve(rays.size());
+    for (const auto& r : rays)
+        timed.push_back(ray::from_unit(r.origin(), r.direction(), random_float()));
+
+    still.compute_bvh();
+    std::cout << "static:       " << std::setprecision(4) << trace(still, rays) << " Mrays/s" << std::endl;
+
+    auto start = Clock::now();
+    moving.compute_bvh();
+    const double keyed_build = seconds_since(start);
+    std::cout << "two-key BVH:  build " << keyed_build * 1e3 << " ms, "
+        << trace(moving, timed) << " Mrays/s" << std::endl;
+
+    // The same topology with every node holding the box swept over the whole interval
+    std::vector<aabb> swept(moving.object_count());
+    for (size_t i = 0; i < swept.size(); i++)
+        moving.objects()[i]->bounding_box(swept[i]);
+    start = Clock::now();
+    moving.set_bvh(FlatBvh::build(swept));
+    const double swept_build = seconds_since(start);
+    std::cout << "swept boxes:  build " << swept_build * 1e3 << " ms, "
+        << trace(moving, timed) << " Mrays/s" << std::endl;
+}
+
+static void bench_camera()
+{
+    // A lens and an open shutter, so every ray draws all of its random numbers
+    const Camera camera(point3(13, 2, 3), point3(0, 0, 0), vec3(0, 1, 0), 20.0f, 1.0f, 0.1f, 10.0f, 0.0f, 1.0f);
+    const size_t size = CAMERA_IMAGE_SIZE;
+    const double count = double(size * size * CAMERA_SAMPLES);
+
+    // Sum a component so the rays can't be optimized away
+    float sum = 0.0f;
+    auto start = Clock::now();
+    for (size_t y = 0; y < size; y++)
+    {
+        for (size_t x = 0; x < size; x++)
+        {
+            for (size_t i = 0; i < CAMERA_SAMPLES; i++)
+            {
+                const auto u = (float(x) + random_float()) / float(size - 1);
+                const auto v = (float(y) + random_float()) / float(size - 1);
+                sum += camera.screen_to_world(u, v).direction().x();
+            }
+        }
+    }
+    const double scalar = seconds_since(start);
+
+    RayBatch batch;
+    start = Clock::now();
+    for (size_t y = 0; y < size; y++)
+    {
+        camera.generate_rays(PixelRect { 0, y, size, 1 }, size, size, CAMERA_SAMPLES, batch);
+        for (size_t b = 0; b < batch.block_count(); b++)
+            sum += batch.directions()[b].x.horizontal_sum();
+    }
+    const double batched = seconds_since(start);
+
+    std::cout << "camera rays, per sample: " << count / scalar * 1e-6 << " M rays/s\n"
+        << "camera rays, batched:    " << count / batched * 1e-6 << " M rays/s"
+        << " (checksum " << sum << ")" << std::endl;
+}
+
+static void bench_output()
+{
+    Image image(OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    for (size_t y = 0; y < OUTPUT_HEIGHT; y++)
+    {
+        for (size_t x = 0; x < OUTPUT_WIDTH; x++)
+            image.set_pixel(x, y, color::random());
+    }
+
+    std::vector<uint8_t> bytes(4 * OUTPUT_WIDTH * OUTPUT_HEIGHT);
+    const auto start = Clock::now();
+    for (int i = 0; i < OUTPUT_REPEATS; i++)
+        image.to_rgba8(bytes.data());
+    const double elapsed = seconds_since(start) / OUTPUT_REPEATS;
+
+    std::cout << "tiled to RGBA8: " << elapsed * 1e3 << " ms per " << OUTPUT_WIDTH << "x" << OUTPUT_HEIGHT
+        << " frame (" << double(OUTPUT_WIDTH * OUTPUT_HEIGHT) / elapsed * 1e-6 << " M pixels/s)" << std::endl;
+}
+
+static void bench_kernels(const TriangleMesh& mesh, const std::vector<ray>& rays)
+{
+    // Spread the sample over the whole mesh so some of the rays hit
+    const size_t tri_count = std::min(KERNEL_TRIANGLES, mesh.triangle_count());
+    const size_t stride = mesh.triangle_count() / tri_count;
+    std::vector<uint32_t> indices(tri_count);
+    for (uint32_t i = 0; i < tri_count; i++) indices[i] = uint32_t(i * stride);
+
+    std::vector<TrianglePacket> packets = {};
+    for (size_t i = 0; i < tri_count; i += TrianglePacket::WIDTH)
+        packets.emplace_back(&mesh, indices.data() + i, std::min(TrianglePacket::WIDTH, tri_count - i), 0);
+
+    size_t hits = 0;
+    auto start = Clock::now();
+    for (const auto& r : rays)
+    {
+        for (const auto i : indices)
+        {
+            float t, b0, b1, b2;
+            hits += intersect_triangle(
+                r, mesh.vertex(i, 0), mesh.vertex(i, 1), mesh.vertex(i, 2),
+                0.001f, 1e30f, t, b0, b1, b2
+            ) ? 1 : 0;
+        }
+    }
+    const double watertight = seconds_since(start);
+
+    size_t packet_hits = 0;
+    HitRecord rec;
+    start = Clock::now();
+    for (const auto& r : rays)
+    {
+        for (const auto& packet : packets)
+            packet_hits += packet.hit(r, 0.001f, 1e30f, rec) ? 1 : 0;
+    }
+    const double packet = seconds_since(start);
+
+    const double tests = double(rays.size()) * double(tri_count);
+    std::cout << "watertight kernel: " << tests / watertight * 1e-6 << " M tests/s ("
+        << hits << " hits)\n"
+        << "packet8 kernel:    " << tests / packet * 1e-6 << " M tests/s ("
+        << packet_hits << " packets hit)" << std::endl;
+}
+
+int main()
+{
+    seed_random_float(1234);
+
+    const auto mesh = TriangleMesh::uv_sphere(point3(0, 0, 0), 1.0f, SPHERE_RINGS, SPHERE_SEGMENTS);
+    std::cout << "Mesh: " << mesh.triangle_count() << " triangles, "
+        << mesh.vertex_count() << " vertices, "
+        << double(mesh.memory_usage()) / double(mesh.triangle_count()) << " buffer bytes/tri"
+        << std::endl;
+
+    bench_kernels(mesh, make_rays(KERNEL_RAYS));
+    bench_camera();
+    bench_output();
+
+    const auto rays = make_rays(WORLD_RAYS);
+    bench_world("triangles", mesh, MeshLayout::Triangles, rays);
+    bench_world("packets", mesh, MeshLayout::Packets, rays);
+    bench_instances(mesh, rays);
+
+    ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    bench_refit(make_rays(REFIT_RAYS), pool);
+    bench_motion(make_rays(REFIT_RAYS));
+
+    return 0;
+}
\ No newline at end of file
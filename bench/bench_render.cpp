@@ -0,0 +1,620 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "args.hpp"
+#include "common.hpp"
+#include "world.hpp"
+#include "sphere.hpp"
+#include "material.hpp"
+#include "triangle_mesh.hpp"
+#include "renderer.hpp"
+#include "camera_path.hpp"
+#include "default_world.hpp"
+#include "mapped_file.hpp"
+#include "json.hpp"
+
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+
+// Renders a fixed set of scenes at fixed sizes and sample counts and records the wall time,
+// throughput, peak memory and how far each image is from a stored reference, then checks them
+// against a baseline. Run it with --update on a known good build to record the references and the
+// baseline, and without it before and after a change:
+//
+//     ray-tracer-render-bench --references refs --baseline baseline.json --update
+//     ray-tracer-render-bench --references refs --baseline baseline.json
+//
+// Renders are seeded per tile, so an unchanged renderer reproduces its references exactly. The
+// baseline's "tolerances" say how much slower, hungrier or further from the references a run may
+// be before it counts as a regression, and can be edited by hand. Timings are only comparable on
+// the machine and thread count the baseline was recorded with.
+
+using Clock = std::chrono::steady_clock;
+
+// Relative, except `rmse` which is the largest error allowed against the references
+constexpr double DEFAULT_TIME_TOLERANCE = 0.10;
+constexpr double DEFAULT_THROUGHPUT_TOLERANCE = 0.10;
+constexpr double DEFAULT_MEMORY_TOLERANCE = 0.10;
+constexpr double DEFAULT_RMSE_TOLERANCE = 0.005;
+
+// Allowed on top of the memory tolerance, since the runtime's own few megabytes vary from run to
+// run and would trip it for small scenes
+constexpr double MEMORY_SLACK_MB = 4.0;
+
+struct BenchScene
+{
+    const char* name;
+    size_t width;
+    size_t height;
+    size_t samples;
+    CameraSettings camera;
+    World (*build)();
+};
+
+struct BenchResult
+{
+    std::string name;
+    size_t width = 0;
+    size_t height = 0;
+    size_t samples = 0;
+    double build_seconds = 0.0;
+    double render_seconds = 0.0;
+
+    // 0 when the build doesn't count rays
+    double mrays_per_second = 0.0;
+
+    // 0 when it can't be measured on this platform
+    double peak_rss_mb = 0.0;
+
+    // Negative when there is no reference to compare with
+    double rmse = -1.0;
+};
+
+struct Tolerances
+{
+    double time = DEFAULT_TIME_TOLERANCE;
+    double throughput = DEFAULT_THROUGHPUT_TOLERANCE;
+    double memory = DEFAULT_MEMORY_TOLERANCE;
+    double rmse = DEFAULT_RMSE_TOLERANCE;
+};
+
+static double seconds_since(const Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Starts measuring peak memory from the current resident set, so each scene is measured on its
+ * own. Memory freed by earlier scenes is handed back to the system first where the allocator
+ * allows it, since it would otherwise count against the next scene.
+ */
+static void reset_peak_rss()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+
+#if defined(__linux__)
+    // Resets VmHWM, since Linux 4.0
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+#endif
+}
+
+/**
+ * Highest resident set size since `reset_peak_rss`, in megabytes, or 0 if unknown.
+ */
+static double peak_rss_mb()
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stod(line.substr(6)) / 1024.0;
+    }
+#endif
+    return 0.0;
+}
+
+static World build_default()
+{
+    return construct_default_world(false);
+}
+
+/**
+ * A ball of tiny spheres, far more objects than pixels, over a ground sphere.
+ */
+static World build_particles()
+{
+    constexpr size_t PARTICLES = 200000;
+
+    seed_random_stream(1);
+    World world;
+    const auto ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
+    const auto diffuse = world.add_material(Lambertian(color(0.7f, 0.3f, 0.2f)));
+    const auto metal = world.add_material(Metal(color(0.8f, 0.8f, 0.9f), 0.2f));
+    world.add_object(Sphere(point3(0, -1000, 0), 1000, ground));
+
+    for (size_t i = 0; i < PARTICLES; i++)
+    {
+        // Denser towards the middle
+        const auto offset = vec3::random_in_unit_sphere() * random_float(0.2f, 1.0f);
+        const point3 center = point3(0.0f, 1.6f, 0.0f) + 1.5f * offset;
+        world.add_object(Sphere(center, random_float(0.004f, 0.012f), random_float() < 0.8f ? diffuse : metal));
+    }
+
+    return world;
+}
+
+/**
+ * A few finely tessellated spheres, about a million triangles in all.
+ */
+static World build_meshes()
+{
+    constexpr uint32_t RINGS = 256;
+    constexpr uint32_t SEGMENTS = 512;
+
+    World world;
+    const auto ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
+    const auto clay = world.add_material(Lambertian(color(0.7f, 0.4f, 0.3f)));
+    const auto gold = world.add_material(Metal(color(0.8f, 0.6f, 0.2f), 0.1f));
+    world.add_object(Sphere(point3(0, -1000, 0), 1000, ground));
+
+    world.add_mesh(TriangleMesh::uv_sphere(point3(-3.0f, 1.0f, 0.0f), 1.0f, RINGS, SEGMENTS), clay, MeshLayout::Packets);
+    world.add_mesh(TriangleMesh::uv_sphere(point3(-1.0f, 1.0f, 0.0f), 1.0f, RINGS, SEGMENTS), gold, MeshLayout::Packets);
+    world.add_mesh(TriangleMesh::uv_sphere(point3(1.0f, 1.0f, 0.0f), 1.0f, RINGS, SEGMENTS), clay, MeshLayout::Packets);
+    world.add_mesh(TriangleMesh::uv_sphere(point3(3.0f, 1.0f, 0.0f), 1.0f, RINGS, SEGMENTS), gold, MeshLayout::Packets);
+    return world;
+}
+
+/**
+ * Rows of solid and hollow glass spheres focusing the sky onto the ground, where paths run long.
+ */
+static World build_glass()
+{
+    World world;
+    const auto ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
+    const auto glass = world.add_material(Dielectric(1.5f));
+    const auto dense = world.add_material(Dielectric(2.4f));
+    const auto mirror = world.add_material(Metal(color(0.9f, 0.9f, 0.9f), 0.0f));
+    world.add_object(Sphere(point3(0, -1000, 0), 1000, ground));
+
+    for (int x = -3; x <= 3; x++)
+    {
+        for (int z = -2; z <= 2; z++)
+        {
+            const point3 center(float(x) * 1.1f, 0.5f, float(z) * 1.1f);
+            const int kind = (x + 3 + (z + 2) * 7) % 4;
+            world.add_object(Sphere(center, 0.5f, kind == 3 ? mirror : kind == 2 ? dense : glass));
+
+            // Hollow shells
+            if (kind == 1)
+                world.add_object(Sphere(center, -0.45f, glass));
+        }
+    }
+
+    return world;
+}
+
+/**
+ * A field of rotated and scaled copies of one mesh and sphere shape, about fifteen million
+ * triangles that are only stored once.
+ */
+static World build_instances()
+{
+    constexpr int GRID = 40;
+
+    seed_random_stream(2);
+    World world;
+    const auto ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
+    const auto clay = world.add_material(Lambertian(color(0.7f, 0.4f, 0.3f)));
+    const auto steel = world.add_material(Metal(color(0.7f, 0.7f, 0.75f), 0.3f));
+    world.add_object(Sphere(point3(0, -1000, 0), 1000, ground));
+
+    auto shape = std::make_shared<Shape>();
+    shape->add_mesh(TriangleMesh::uv_sphere(point3(0.0f, 1.0f, 0.0f), 1.0f, 48, 96), clay, MeshLayout::Packets);
+    shape->add_object(Sphere(point3(0.0f, 2.4f, 0.0f), 0.4f, steel));
+    shape->compute_bvh();
+
+    const float spacing = 0.5f;
+    for (int x = 0; x < GRID; x++)
+    {
+        for (int z = 0; z < GRID; z++)
+        {
+            const vec3 offset((float(x) - 0.5f * float(GRID - 1)) * spacing, 0.0f, (float(z) - 0.5f * float(GRID - 1)) * spacing);
+            const float scale = random_float(0.08f, 0.16f);
+            const float angle = random_float(0.0f, 360.0f);
+            world.add_instance(shape, Transform::translate(offset)
+                * Transform::rotate(vec3(0, 1, 0), angle)
+                * Transform::scale(vec3(scale, scale, scale)));
+        }
+    }
+
+    return world;
+}
+
+static CameraSettings camera_at(const point3& eye, const point3& target, const float vfov)
+{
+    CameraSettings camera;
+    camera.eye = eye;
+    camera.target = target;
+    camera.vfov = vfov;
+    return camera;
+}
+
+static const BenchScene SCENES[] =
+{
+    { "default", 320, 180, 32, CameraSettings(), build_default },
+    { "particles", 320, 180, 8, camera_at(point3(8, 3, 6), point3(0, 1.4f, 0), 30.0f), build_particles },
+    { "meshes", 320, 180, 16, camera_at(point3(0, 3, 9), point3(0, 0.8f, 0), 40.0f), build_meshes },
+    { "glass", 320, 180, 64, camera_at(point3(2, 5, 7), point3(0, 0.3f, 0), 45.0f), build_glass },
+    { "instances", 320, 180, 16, camera_at(point3(6, 4, 8), point3(0, 0, 0), 45.0f), build_instances },
+};
+
+/**
+ * Reads the linear RGB floats of a PFM written by `Image::save`, bottom row first. Throws
+ * `std::runtime_error` if it isn't one of those or isn't `width` by `height`.
+ */
+static std::vector<float> read_pfm(const std::string& path, const size_t width, const size_t height)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("unable to open '" + path + "'");
+
+    std::string magic;
+    size_t w = 0, h = 0;
+    float scale = 0.0f;
+    in >> magic >> w >> h >> scale;
+    in.get();
+    if (magic != "PF" || scale >= 0.0f)
+        throw std::runtime_error("'" + path + "' isn't a little endian color PFM");
+    if (w != width || h != height)
+        throw std::runtime_error("'" + path + "' is " + std::to_string(w) + "x" + std::to_string(h)
+            + ", not " + std::to_string(width) + "x" + std::to_string(height));
+
+    std::vector<float> pixels(width * height * 3);
+    if (!in.read(reinterpret_cast<char*>(pixels.data()), std::streamsize(pixels.size() * sizeof(float))))
+        throw std::runtime_error("'" + path + "' is truncated");
+    return pixels;
+}
+
+/**
+ * Root mean square difference over every channel, with both clamped to [0, 1] so a few bright
+ * fireflies don't swamp the rest of the image.
+ */
+static double rmse(const Image& image, const std::vector<float>& reference)
+{
+    std::vector<float> row(image.width() * 3);
+    double sum = 0.0;
+    for (size_t y = 0; y < image.height(); y++)
+    {
+        image.linear_row(y, 1.0f, row.data());
+        const float* ref = reference.data() + y * row.size();
+        for (size_t i = 0; i < row.size(); i++)
+        {
+            const double d = std::fmin(std::fmax(row[i], 0.0f), 1.0f) - std::fmin(std::fmax(ref[i], 0.0f), 1.0f);
+            sum += d * d;
+        }
+    }
+    return std::sqrt(sum / double(reference.size()));
+}
+
+static std::string reference_path(const std::string& directory, const char* scene)
+{
+    return directory + "/" + scene + ".pfm";
+}
+
+/**
+ * Builds and renders `scene`, keeping the fastest of `repeats` renders. Compares the image with
+ * the reference in `references`, or writes it there when `update` is set.
+ */
+static BenchResult run_scene(
+    const BenchScene& scene,
+    const size_t threads,
+    const int repeats,
+    const std::string& references,
+    const bool update
+)
+{
+    reset_peak_rss();
+
+    BenchResult result;
+    result.name = scene.name;
+    result.width = scene.width;
+    result.height = scene.height;
+    result.samples = scene.samples;
+
+    const auto build_start = Clock::now();
+    World world = scene.build();
+    world.compute_bvh();
+    result.build_seconds = seconds_since(build_start);
+
+    RenderArgs args = {};
+    args.thread_count = threads;
+    args.samples = scene.samples;
+    args.width = scene.width;
+    args.height = scene.height;
+
+    Renderer renderer(args);
+    const auto camera = scene.camera.make_camera(float(scene.width) / float(scene.height));
+
+    Image image(0, 0);
+    result.render_seconds = 1e30;
+    for (int i = 0; i < repeats; i++)
+    {
+        const auto start = Clock::now();
+        auto rendered = renderer.render(camera, world);
+        result.render_seconds = std::min(result.render_seconds, seconds_since(start));
+        if (i == 0)
+            image = std::move(rendered);
+    }
+
+    result.mrays_per_second = double(renderer.stats().traced_rays()) / result.render_seconds * 1e-6;
+    result.peak_rss_mb = peak_rss_mb();
+
+    if (!references.empty())
+    {
+        const auto path = reference_path(references, scene.name);
+        if (update)
+        {
+            image.save(path.c_str(), ResolveSettings());
+            result.rmse = 0.0;
+        }
+        else
+        {
+            result.rmse = rmse(image, read_pfm(path, scene.width, scene.height));
+        }
+    }
+
+    return result;
+}
+
+static void write_baseline(const std::string& path, const std::vector<BenchResult>& results, const size_t threads)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("unable to open '" + path + "' for writing");
+
+    const Tolerances tolerances;
+    out << std::setprecision(6)
+        << "{\n"
+        << "    \"threads\": " << threads << ",\n"
+        << "    \"tolerances\": {\n"
+        << "        \"render_seconds\": " << tolerances.time << ",\n"
+        << "        \"mrays_per_second\": " << tolerances.throughput << ",\n"
+        << "        \"peak_rss_mb\": " << tolerances.memory << ",\n"
+        << "        \"rmse\": " << tolerances.rmse << "\n"
+        << "    },\n"
+        << "    \"scenes\": {";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "        \"" << r.name << "\": {\n"
+            << "            \"width\": " << r.width << ",\n"
+            << "            \"height\": " << r.height << ",\n"
+            << "            \"samples\": " << r.samples << ",\n"
+            << "            \"build_seconds\": " << r.build_seconds << ",\n"
+            << "            \"render_seconds\": " << r.render_seconds << ",\n"
+            << "            \"mrays_per_second\": " << r.mrays_per_second << ",\n"
+            << "            \"peak_rss_mb\": " << r.peak_rss_mb << "\n"
+            << "        }";
+    }
+
+    out << "\n    }\n}\n";
+    if (!out.flush())
+        throw std::runtime_error("unable to write '" + path + "'");
+}
+
+static double number(const JsonValue& object, const char* key, const double fallback)
+{
+    const auto* value = object.find(key);
+    return value != nullptr && value->is_number() ? value->as_number() : fallback;
+}
+
+/**
+ * Checks `results` against the baseline at `path`, printing every regression. Returns how many
+ * there were. Throws `std::runtime_error` if the baseline can't be read.
+ */
+static size_t compare_baseline(const std::string& path, const std::vector<BenchResult>& results, const size_t threads)
+{
+    const MappedFile file(path.c_str());
+    const auto doc = JsonValue::parse(file.data(), file.data() + file.size());
+    const auto* scenes = doc.find("scenes");
+    if (!doc.is_object() || scenes == nullptr || !scenes->is_object())
+        throw std::runtime_error("'" + path + "' has no \"scenes\" object");
+
+    Tolerances tolerances;
+    if (const auto* t = doc.find("tolerances"))
+    {
+        tolerances.time = number(*t, "render_seconds", tolerances.time);
+        tolerances.throughput = number(*t, "mrays_per_second", tolerances.throughput);
+        tolerances.memory = number(*t, "peak_rss_mb", tolerances.memory);
+        tolerances.rmse = number(*t, "rmse", tolerances.rmse);
+    }
+
+    const size_t baseline_threads = size_t(number(doc, "threads", 0.0));
+    if (baseline_threads != threads)
+    {
+        std::cout << "Warning: the baseline was recorded with " << baseline_threads << " threads, this run used "
+            << threads << ", so timings aren't comparable" << std::endl;
+    }
+
+    size_t regressions = 0;
+    const auto regress = [&](const BenchResult& r, const char* metric, const double value, const double base)
+    {
+        std::cout << "REGRESSION " << r.name << " " << metric << ": " << value << " against a baseline of " << base << std::endl;
+        regressions++;
+    };
+
+    for (const auto& r : results)
+    {
+        const auto* base = scenes->find(r.name.c_str());
+        if (base == nullptr)
+        {
+            std::cout << "Warning: the baseline has no scene '" << r.name << "'" << std::endl;
+            continue;
+        }
+
+        if (number(*base, "width", 0.0) != double(r.width) || number(*base, "height", 0.0) != double(r.height)
+            || number(*base, "samples", 0.0) != double(r.samples))
+        {
+            std::cout << "REGRESSION " << r.name << ": rendered at a different size or sample count than the baseline" << std::endl;
+            regressions++;
+            continue;
+        }
+
+        const double seconds = number(*base, "render_seconds", 0.0);
+        if (seconds > 0.0 && r.render_seconds > seconds * (1.0 + tolerances.time))
+            regress(r, "render_seconds", r.render_seconds, seconds);
+
+        const double mrays = number(*base, "mrays_per_second", 0.0);
+        if (mrays > 0.0 && r.mrays_per_second > 0.0 && r.mrays_per_second < mrays * (1.0 - tolerances.throughput))
+            regress(r, "mrays_per_second", r.mrays_per_second, mrays);
+
+        const double rss = number(*base, "peak_rss_mb", 0.0);
+        if (rss > 0.0 && r.peak_rss_mb > rss * (1.0 + tolerances.memory) + MEMORY_SLACK_MB)
+            regress(r, "peak_rss_mb", r.peak_rss_mb, rss);
+
+        if (r.rmse > tolerances.rmse)
+        {
+            std::cout << "REGRESSION " << r.name << " rmse: " << r.rmse << " against the reference, above the tolerance of "
+                << tolerances.rmse << std::endl;
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, const char** argv)
+{
+    args::ArgumentParser p("Renders the benchmark scenes and checks them against a baseline.");
+    args::HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    args::ValueFlag<std::string> scene_name(p, "name", "Only render this scene: default, particles, meshes, glass or instances.", { "scene" });
+    args::ValueFlag<int> threads(p, "threads", "Number of render threads. Defaults to one per core.", { "threads" }, int(std::max(1u, std::thread::hardware_concurrency())));
+    args::ValueFlag<int> repeats(p, "count", "Renders of each scene, of which the fastest is kept.", { "repeats" }, 3);
+    args::ValueFlag<std::string> references(p, "directory", "Directory of reference images to measure the error of each render against.", { "references" });
+    args::ValueFlag<std::string> baseline(p, "path", "JSON baseline to check the results against.", { "baseline" });
+    args::Flag update(p, "update", "Record the references and the baseline from this run instead of checking against them.", { "update" });
+
+    try
+    {
+        p.ParseCLI(argc, argv);
+    }
+    catch (const args::Help&)
+    {
+        std::cout << p;
+        return 0;
+    }
+    catch (const args::ParseError& e)
+    {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (threads.Get() <= 0 || repeats.Get() <= 0)
+    {
+        std::cerr << "Thread and repeat counts must be positive integers." << std::endl;
+        return 1;
+    }
+
+    std::vector<const BenchScene*> scenes = {};
+    for (const auto& scene : SCENES)
+    {
+        if (!scene_name || scene_name.Get() == scene.name)
+            scenes.push_back(&scene);
+    }
+
+    if (scenes.empty())
+    {
+        std::cerr << "There is no scene named '" << scene_name.Get() << "'." << std::endl;
+        return 1;
+    }
+
+#if !ENABLE_STATS
+    std::cout << "Warning: built without ENABLE_STATS, so Mrays/s isn't measured" << std::endl;
+#endif
+
+    const size_t thread_count = size_t(threads.Get());
+    std::cout << std::left << std::setw(12) << "scene" << std::right
+        << std::setw(10) << "size" << std::setw(6) << "spp"
+        << std::setw(10) << "build s" << std::setw(10) << "render s" << std::setw(10) << "Mrays/s"
+        << std::setw(12) << "peak MB" << std::setw(10) << "RMSE" << std::endl;
+
+    if (update && references)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(references.Get(), error);
+    }
+
+    std::vector<BenchResult> results = {};
+    for (const auto* scene : scenes)
+    {
+        try
+        {
+            results.push_back(run_scene(*scene, thread_count, repeats.Get(), references ? references.Get() : std::string(), update));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to run scene '" << scene->name << "': " << e.what() << std::endl;
+            return 1;
+        }
+
+        const auto& r = results.back();
+        std::ostringstream size;
+        size << r.width << "x" << r.height;
+        std::cout << std::left << std::setw(12) << r.name << std::right << std::fixed
+            << std::setw(10) << size.str() << std::setw(6) << r.samples
+            << std::setprecision(3) << std::setw(10) << r.build_seconds << std::setw(10) << r.render_seconds
+            << std::setprecision(2) << std::setw(10) << r.mrays_per_second << std::setw(12) << r.peak_rss_mb;
+        if (r.rmse >= 0.0)
+            std::cout << std::setprecision(5) << std::setw(10) << r.rmse;
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    if (!baseline)
+        return 0;
+
+    try
+    {
+        if (update)
+        {
+            write_baseline(baseline.Get(), results, thread_count);
+            std::cout << "Baseline written to '" << baseline.Get() << "'" << std::endl;
+            return 0;
+        }
+
+        const size_t regressions = compare_baseline(baseline.Get(), results, thread_count);
+        if (regressions > 0)
+        {
+            std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << " against the baseline" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to use baseline: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "No regressions against the baseline" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -14,24 +14,50 @@ public:
     inline point3 min() const { return minimum; }
     inline point3 max() const { return maximum; }
 
+    /**
+     * Slab test. The exit distance is rounded outward to cover the error in computing the slab
+     * distances (Ize, "Robust BVH Ray Traversal"), so rays grazing a face or hitting a flat box
+     * are never missed. A NaN slab distance leaves that axis unconstrained instead of rejecting
+     * the box.
+     */
     inline bool hit(const ray& r, float t_min, float t_max) const
     { 
-        const auto invD = r.inv_direction();
-        auto t1 = (minimum - r.origin()) * invD;
-        auto t2 = (maximum - r.origin()) * invD;
+        // 1 + 2 * gamma(3) where gamma(n) = n * eps / (1 - n * eps)
+        constexpr float ROUND_UP = 1.0f + 2.0f * (3.0f * 0x1.0p-24f) / (1.0f - 3.0f * 0x1.0p-24f);
 
-        auto tmin1 = vec3::min(t1, t2);
-        auto tmax1 = vec3::max(t1, t2);
+        const auto inv_d = r.inv_direction();
+        const auto org_inv = r.scaled_origin();
+        const auto err = r.scaled_origin_error();
+        const auto t1 = vec3::fma(minimum, inv_d, -org_inv);
+        const auto t2 = vec3::fma(maximum, inv_d, -org_inv);
 
-        t_min = tmin1.e[0] > t_min ? tmin1.e[0] : t_min;
-        t_min = tmin1.e[1] > t_min ? tmin1.e[1] : t_min;
-        t_min = tmin1.e[2] > t_min ? tmin1.e[2] : t_min;
+#if ENABLE_SIMD
+        // minps/maxps return their second operand when either is NaN, so the ray's interval
+        // is kept for that axis
+        const __m128 t_near = _mm_sub_ps(_mm_min_ps(t1.v, t2.v), err.v);
+        const __m128 t_far = _mm_fmadd_ps(_mm_max_ps(t1.v, t2.v), _mm_set1_ps(ROUND_UP), err.v);
+        const __m128 n = _mm_max_ps(t_near, _mm_set1_ps(t_min));
+        const __m128 f = _mm_min_ps(t_far, _mm_set1_ps(t_max));
 
-        t_max = tmax1.e[0] < t_max ? tmax1.e[0] : t_max;
-        t_max = tmax1.e[1] < t_max ? tmax1.e[1] : t_max;
-        t_max = tmax1.e[2] < t_max ? tmax1.e[2] : t_max;
+        // Reduce lanes x, y and z. The padding lane is ignored
+        const __m128 n_xy = _mm_max_ss(n, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1)));
+        const __m128 f_xy = _mm_min_ss(f, _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1)));
+        const __m128 n_max = _mm_max_ss(n_xy, _mm_movehl_ps(n, n));
+        const __m128 f_min = _mm_min_ss(f_xy, _mm_movehl_ps(f, f));
+        return _mm_comile_ss(n_max, f_min);
+#else
+        for (int i = 0; i < 3; i++)
+        {
+            const float t_near = std::fmin(t1.e[i], t2.e[i]) - err.e[i];
+            const float t_far = std::fmax(t1.e[i], t2.e[i]) * ROUND_UP + err.e[i];
 
-        return t_max >= t_min && t_min < t_max;
+            // Written so a NaN comparison keeps the current bound
+            t_min = t_near > t_min ? t_near : t_min;
+            t_max = t_far < t_max ? t_far : t_max;
+        }
+
+        return t_min <= t_max;
+#endif
     }
 
     inline static aabb surrounding_box(const aabb& box0, const aabb& box1) 
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Non-owning, read-only view of a contiguous array. Used for buffers that either live in a
+ * `std::vector` or directly in a memory mapped file.
+ */
+template<typename T> class ArrayView
+{
+public:
+
+    constexpr ArrayView() noexcept : m_data(nullptr), m_size(0) {}
+    constexpr ArrayView(const T* data, const size_t size) noexcept : m_data(data), m_size(size) {}
+    inline ArrayView(const std::vector<T>& v) noexcept : m_data(v.data()), m_size(v.size()) {}
+
+    inline const T* data() const noexcept { return m_data; }
+    inline size_t size() const noexcept { return m_size; }
+    inline bool empty() const noexcept { return m_size == 0; }
+
+    inline const T& operator[](const size_t i) const noexcept { return m_data[i]; }
+
+    inline const T* begin() const noexcept { return m_data; }
+    inline const T* end() const noexcept { return m_data + m_size; }
+
+private:
+
+    const T* m_data;
+    size_t m_size;
+};
\ No newline at end of file
@@ -2,7 +2,14 @@
 
 #include "vec3.hpp"
 #include "ray.hpp"
+#include "ray_batch.hpp"
+#include "image.hpp"
 
+/**
+ * Thin lens camera. Rays leave from a disk of diameter `aperture` around the eye and converge on
+ * the plane `focus_distance` in front of it, so only that plane is sharp. An aperture of 0 is a
+ * pinhole with everything in focus.
+ */
 class Camera
 {
 public:
@@ -12,22 +19,74 @@ public:
         const point3& target,
         const vec3& up,
         const float vfov,
-        const float aspect_ratio
+        const float aspect_ratio,
+        const float aperture = 0.0f,
+        const float focus_distance = 1.0f,
+        const float shutter_open = 0.0f,
+        const float shutter_close = 0.0f
     );
 
+    /**
+     * A ray through the screen at `u`, `v`, from a random point on the lens and cast at a random
+     * time while the shutter is open.
+     */
     inline ray screen_to_world(const float u, const float v) const noexcept
     {
+        // A pinhole or closed shutter doesn't draw samples so static renders keep their sequence
+        point3 origin = m_eye;
+        if (m_lens_radius > 0.0f)
+        {
+            const float su = random_float();
+            const float sv = random_float();
+            float lens_x, lens_y;
+            sample_disk(su, sv, lens_x, lens_y);
+            origin += m_lens_radius * (lens_x * m_u + lens_y * m_v);
+        }
+
+        const float time = m_shutter_open == m_shutter_close
+            ? m_shutter_open
+            : random_float(m_shutter_open, m_shutter_close);
+
         return ray
         (
-            m_eye, 
-            m_lower_left + u*m_horizontal + v*m_vertical - m_eye
+            origin,
+            m_lower_left + u*m_horizontal + v*m_vertical - origin,
+            time
         );
     }
 
+    /**
+     * Generates `samples` rays for every pixel of `rect` into `batch`, pixels in row-major order
+     * with their samples next to each other. Each ray is jittered within its pixel the way a
+     * `screen_to_world` call at `(x + random) / (image_width - 1)` would be, and the rays are
+     * built eight at a time.
+     */
+    void generate_rays(
+        const PixelRect& rect,
+        const size_t image_width,
+        const size_t image_height,
+        const size_t samples,
+        RayBatch& batch
+    ) const;
+
+    /**
+     * Maps a point in the unit square onto the unit disk with Shirley and Chiu's concentric
+     * mapping, which keeps strata compact and area uniform.
+     */
+    static void sample_disk(const float su, const float sv, float& x, float& y) noexcept;
+
 private:
 
     point3 m_eye;
     point3 m_lower_left;
     vec3 m_horizontal;
     vec3 m_vertical;
+
+    // Lens basis: right and up in the image plane
+    vec3 m_u;
+    vec3 m_v;
+    float m_lens_radius;
+
+    float m_shutter_open;
+    float m_shutter_close;
 };
\ No newline at end of file
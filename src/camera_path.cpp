@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "camera_path.hpp"
+#include "transform.hpp"
+
+// Enough keys that the spline stays within a fraction of a percent of the circle
+constexpr int TURNTABLE_KEYS = 16;
+
+CameraPath CameraPath::turntable(const CameraSettings& start, const float duration)
+{
+    CameraPath path;
+    for (int i = 0; i <= TURNTABLE_KEYS; i++)
+    {
+        const float turn = float(i) / float(TURNTABLE_KEYS);
+        const auto rotation = Transform::rotate(start.up, 360.0f * turn);
+
+        CameraSettings settings = start;
+        settings.eye = start.target + rotation.apply_vector(start.eye - start.target);
+        path.add_keyframe(duration * turn, settings);
+    }
+
+    path.m_closed = true;
+    return path;
+}
+
+void CameraPath::add_keyframe(const float time, const CameraSettings& settings)
+{
+    if (!m_keys.empty() && !(time > m_keys.back().time))
+        throw std::runtime_error("camera keyframes must be in increasing time");
+
+    m_keys.push_back(CameraKeyframe { time, settings });
+}
+
+static inline vec3 catmull_rom(const vec3& p0, const vec3& p1, const vec3& p2, const vec3& p3, const float u)
+{
+    const float u2 = u * u;
+    const float u3 = u2 * u;
+    return 0.5f * (
+        2.0f * p1
+        + u * (p2 - p0)
+        + u2 * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3)
+        + u3 * (3.0f * p1 - p0 - 3.0f * p2 + p3)
+    );
+}
+
+CameraSettings CameraPath::at(const float time) const
+{
+    if (time <= m_keys.front().time)
+        return m_keys.front().settings;
+    if (time >= m_keys.back().time)
+        return m_keys.back().settings;
+
+    // First keyframe after `time`
+    const auto next = std::upper_bound(
+        m_keys.begin(),
+        m_keys.end(),
+        time,
+        [](const float t, const CameraKeyframe& key) { return t < key.time; }
+    );
+    const size_t i = size_t(next - m_keys.begin()) - 1;
+
+    // The ends repeat their keyframe in place of the missing neighbour, unless the path is closed
+    // and the neighbour is the one next to the shared first and last key
+    const size_t last = m_keys.size() - 1;
+    const size_t i0 = i > 0 ? i - 1 : (m_closed && last > 1 ? last - 1 : 0);
+    const size_t i3 = i + 2 <= last ? i + 2 : (m_closed && last > 1 ? 1 : last);
+    const auto& k0 = m_keys[i0].settings;
+    const auto& k1 = m_keys[i].settings;
+    const auto& k2 = m_keys[i + 1].settings;
+    const auto& k3 = m_keys[i3].settings;
+    const float u = (time - m_keys[i].time) / (m_keys[i + 1].time - m_keys[i].time);
+
+    CameraSettings settings = k1;
+    settings.eye = catmull_rom(k0.eye, k1.eye, k2.eye, k3.eye, u);
+    settings.target = catmull_rom(k0.target, k1.target, k2.target, k3.target, u);
+    settings.up = (1.0f - u) * k1.up + u * k2.up;
+    settings.vfov = (1.0f - u) * k1.vfov + u * k2.vfov;
+    settings.aperture = (1.0f - u) * k1.aperture + u * k2.aperture;
+    settings.focus_distance = (1.0f - u) * k1.focus_distance + u * k2.focus_distance;
+    return settings;
+}
\ No newline at end of file
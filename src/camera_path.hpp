@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "camera.hpp"
+
+struct CameraSettings
+{
+    point3 eye = point3(13, 2, 3);
+    point3 target = point3(0, 0, 0);
+    vec3 up = vec3(0, 1, 0);
+    float vfov = 20.0f;
+
+    // Lens diameter, 0 for a pinhole, and distance to the plane in focus, 0 to focus on `target`
+    float aperture = 0.0f;
+    float focus_distance = 0.0f;
+
+    // Part of the frame the shutter is open for. Moving objects blur over this interval
+    float shutter_open = 0.0f;
+    float shutter_close = 0.0f;
+
+    inline Camera make_camera(const float aspect_ratio) const
+    {
+        const float focus = focus_distance > 0.0f ? focus_distance : (eye - target).length();
+        return Camera(eye, target, up, vfov, aspect_ratio, aperture, focus, shutter_open, shutter_close);
+    }
+};
+
+struct CameraKeyframe
+{
+    float time;
+    CameraSettings settings;
+};
+
+/**
+ * Camera settings keyed in time. The eye and target follow Catmull-Rom splines through the
+ * keyframes so the camera doesn't jerk at them; `up`, the field of view and the lens are blended
+ * linearly. The shutter is held from the keyframe before.
+ */
+class CameraPath
+{
+public:
+
+    CameraPath() = default;
+
+    /**
+     * One full turn of the eye around the target about `up`, over `duration` seconds. The path is
+     * closed, so a sequence looping over it keeps its speed through the wrap.
+     */
+    static CameraPath turntable(const CameraSettings& start, const float duration);
+
+    /**
+     * Keyframes must be added in increasing time. Throws `std::runtime_error` otherwise.
+     */
+    void add_keyframe(const float time, const CameraSettings& settings);
+
+    inline bool empty() const noexcept { return m_keys.empty(); }
+    inline bool closed() const noexcept { return m_closed; }
+    inline const std::vector<CameraKeyframe>& keyframes() const noexcept { return m_keys; }
+
+    inline float start_time() const noexcept { return m_keys.empty() ? 0.0f : m_keys.front().time; }
+    inline float end_time() const noexcept { return m_keys.empty() ? 0.0f : m_keys.back().time; }
+
+    /**
+     * Settings at `time`, holding the first and last keyframes outside of the path. The path
+     * must not be empty.
+     */
+    CameraSettings at(const float time) const;
+
+private:
+
+    std::vector<CameraKeyframe> m_keys;
+
+    // The last keyframe repeats the first, and the splines take their end neighbours from across
+    // the seam instead of repeating the end keys
+    bool m_closed = false;
+};
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
-#define ENABLE_SIMD 1
+#ifndef ENABLE_SIMD
+    #define ENABLE_SIMD 1
+#endif
 
 #include <random>
 
@@ -40,6 +42,23 @@ inline void seed_random_float(unsigned int seed)
     g_random_state.seed[3] = distribution(generator);
 }
 
+/**
+ * Seeds this thread's generator from `stream` alone, expanded with splitmix64. Unlike
+ * `seed_random_float` the result doesn't depend on which thread asks or in what order, so work
+ * split into numbered pieces draws the same numbers however it is scheduled.
+ */
+inline void seed_random_stream(uint64_t stream)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        stream += 0x9e3779b97f4a7c15ull;
+        uint64_t z = stream;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        g_random_state.seed[i] = z ^ (z >> 31);
+    }
+}
+
 inline float random_float() 
 {
     const uint64_t result = g_random_state.seed[0] + g_random_state.seed[3];
@@ -0,0 +1,70 @@
+#include "default_world.hpp"
+#include "common.hpp"
+#include "sphere.hpp"
+#include "material.hpp"
+
+World construct_default_world(const bool motion_blur)
+{    
+    seed_random_float(500);
+    auto world = World();
+
+    const auto material_ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
+    world.add_object(Sphere(point3(0, -1000, -1), 1000, material_ground));
+
+    for (int x = -11; x < 11; x++)
+    {
+        for (int y = -11; y < 11; y++)
+        {
+            const auto choose_mat = random_float();
+            const point3 center(x + 0.9f * random_float(), 0.2f, y + 0.9f * random_float());
+
+            // Drawn whether or not it's used, so motion blur moves the spheres without changing
+            // the rest of the scene
+            const auto bounce = random_float(0.0f, 0.5f);
+
+            if ((center - point3(4, 0.2f, 0)).length() > 0.9f)
+            {
+                MaterialId sphere_material;
+
+                if (choose_mat < 0.9f)
+                {
+                    // Diffuse
+                    const auto albedo = color::random() * color::random();
+                    sphere_material = world.add_material(Lambertian(albedo));
+                }
+                else if (choose_mat < 0.95f)
+                {
+                    // Metal
+                    const auto albedo = color::random(0.5f, 1.0f);
+                    const auto fuzz = random_float(0.0f, 0.5f);
+                    sphere_material = world.add_material(Metal(albedo, fuzz));
+                }
+                else
+                {
+                    // Glass
+                    sphere_material = world.add_material(Dielectric(1.5f));
+                }
+
+                // Diffuse spheres bounce up while the shutter is open
+                const auto center_end = motion_blur && choose_mat < 0.9f
+                    ? center + vec3(0.0f, bounce, 0.0f)
+                    : center;
+                world.add_object(Sphere(center, center_end, 0.2f, sphere_material));
+            }
+            
+        }
+    }
+
+    auto material_center = world.add_material(Lambertian(color(0.1f, 0.2f, 0.5f)));
+    auto material_left   = world.add_material(Dielectric(1.5f));
+    auto material_right  = world.add_material(Metal(color(0.8f, 0.6f, 0.2f), 0.0f));
+
+    world.add_object(Sphere(point3( 0.0f, -100.5f, -1.0f), 100.0f, material_ground));
+
+    world.add_object(Sphere(point3( .0f, 1.0f, 0.0f),  1.0f, material_center));
+    world.add_object(Sphere(point3(-4.0f, 1.0f, 0.0f), 1.0f, material_left));
+    world.add_object(Sphere(point3(-4.0f, 1.0f, 0.0f), -0.95f, material_left));
+    world.add_object(Sphere(point3(4.0f, 1.0f, 0.0f), 1.0f, material_right));
+
+    return world;
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "world.hpp"
+
+/**
+ * The scene rendered when no other is given: a large ground sphere, a grid of small spheres with
+ * random diffuse, metal and glass materials, and three large spheres in the middle, viewed well by
+ * the default `CameraSettings`. With `motion_blur` the small diffuse spheres move up while the
+ * shutter is open, and the scene is otherwise the same as without it. Draws from the generator after `seed_random_float(500)`, so the first world
+ * made in a process is always the same.
+ */
+World construct_default_world(const bool motion_blur);
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include <cassert>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "denoiser.hpp"
+#include "fast_math.hpp"
+#include "trace.hpp"
+
+// Filter passes. Pass `i` spaces its taps `2^i` pixels apart
+constexpr size_t DENOISE_PASSES = 5;
+
+// Border around the planes wide enough for the last pass's farthest taps. Its normals are zero,
+// so it never weighs in
+constexpr size_t DENOISE_PAD = 2 << (DENOISE_PASSES - 1);
+
+// Rows each task filters
+constexpr size_t DENOISE_BAND = Image::TILE_SIZE;
+
+// Luminance differences are measured in standard deviations of the pixel's noise
+constexpr float SIGMA_LUMINANCE = 4.0f;
+
+// Depth differences are measured relative to the pixel's depth, per pixel of distance
+constexpr float SIGMA_DEPTH = 0.02f;
+
+// Albedo below this would amplify noise in the demodulated radiance without bound
+constexpr float MIN_ALBEDO = 1e-3f;
+
+// Stands in for the infinite depth of the sky
+constexpr float FAR_DEPTH = 1e30f;
+
+/**
+ * Features and ping-ponged radiance as padded row-major planes, so eight neighbouring pixels load
+ * with one instruction and taps never need bounds checks.
+ */
+struct DenoisePlanes
+{
+    DenoisePlanes(const size_t width, const size_t height) :
+        stride(DENOISE_PAD + (width + 7) / 8 * 8 + DENOISE_PAD),
+        rows(height + 2 * DENOISE_PAD)
+    {
+        for (auto* plane : { &normal[0], &normal[1], &normal[2], &depth, &variance_blurred })
+            plane->resize(stride * rows, 0.0f);
+        for (size_t i = 0; i < 2; i++)
+        {
+            for (auto* plane : { &radiance[i][0], &radiance[i][1], &radiance[i][2], &variance[i] })
+                plane->resize(stride * rows, 0.0f);
+        }
+    }
+
+    inline size_t index(const size_t x, const size_t y) const noexcept
+    {
+        return (y + DENOISE_PAD) * stride + x + DENOISE_PAD;
+    }
+
+    size_t stride;
+    size_t rows;
+
+    std::vector<float> normal[3];
+    std::vector<float> depth;
+    std::vector<float> radiance[2][3];
+    std::vector<float> variance[2];
+    std::vector<float> variance_blurred;
+};
+
+static inline float8 luminance(const float8& r, const float8& g, const float8& b)
+{
+    return float8::fma(r, float8(0.2126f), float8::fma(g, float8(0.7152f), b * float8(0.0722f)));
+}
+
+/**
+ * Fills the planes for row `y` with radiance divided by albedo, its variance likewise, unit
+ * normals and finite depths. Pixels that missed everything get a zero normal.
+ */
+static void demodulate_row(const Image& image, const size_t y, DenoisePlanes& planes)
+{
+    const size_t width = image.width();
+    std::vector<float> rgb(width * 3), albedo(width * 3), normal(width * 3), depth(width), variance(width);
+    image.linear_row(y, 1.0f, rgb.data());
+    image.aov_row(Aov::Albedo, y, albedo.data());
+    image.aov_row(Aov::Normal, y, normal.data());
+    image.aov_row(Aov::Depth, y, depth.data());
+    image.aov_row(Aov::Variance, y, variance.data());
+
+    for (size_t x = 0; x < width; x++)
+    {
+        const size_t i = planes.index(x, y);
+        const float* a = &albedo[x * 3];
+        const float* n = &normal[x * 3];
+
+        float lum_albedo = 0.0f;
+        for (size_t c = 0; c < 3; c++)
+        {
+            const float albedo_c = std::fmax(a[c], MIN_ALBEDO);
+            planes.radiance[0][c][i] = rgb[x * 3 + c] / albedo_c;
+            lum_albedo += (c == 0 ? 0.2126f : c == 1 ? 0.7152f : 0.0722f) * albedo_c;
+        }
+        planes.variance[0][i] = variance[x] / (lum_albedo * lum_albedo);
+
+        // Normals averaged across an edge are shorter than unit, and those of the sky are zero
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        const float scale = length > 1e-3f ? 1.0f / length : 0.0f;
+        for (size_t c = 0; c < 3; c++)
+            planes.normal[c][i] = n[c] * scale;
+
+        planes.depth[i] = std::isfinite(depth[x]) ? depth[x] : FAR_DEPTH;
+    }
+}
+
+/**
+ * Blurs row `y` of `variance` with a 3x3 binomial kernel. A single pixel's variance estimate is
+ * itself noisy, and edge-stopping on it directly lets speckles through.
+ */
+static void blur_variance_row(const std::vector<float>& variance, const size_t y, const size_t width, DenoisePlanes& planes)
+{
+    const size_t stride = planes.stride;
+    for (size_t x = 0; x < width; x += 8)
+    {
+        const float* src = variance.data() + planes.index(x, y);
+        float8 sum(0.0f);
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            const float* row = src + dy * ptrdiff_t(stride);
+            const float8 h = float8::fma(float8::load_unaligned(row), float8(2.0f),
+                float8::load_unaligned(row - 1) + float8::load_unaligned(row + 1));
+            sum = float8::fma(h, float8(dy == 0 ? 2.0f : 1.0f), sum);
+        }
+        (sum * float8(1.0f / 16.0f)).store_unaligned(planes.variance_blurred.data() + planes.index(x, y));
+    }
+}
+
+/**
+ * One à-trous pass over row `y`, with taps `step` pixels apart, from plane set `src` into the
+ * other one.
+ */
+static void filter_row(const size_t y, const size_t width, const size_t step, const size_t src, DenoisePlanes& planes)
+{
+    static constexpr float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+    const size_t dst = 1 - src;
+    const ptrdiff_t stride = ptrdiff_t(planes.stride);
+    const float* const r = planes.radiance[src][0].data();
+    const float* const g = planes.radiance[src][1].data();
+    const float* const b = planes.radiance[src][2].data();
+    const float* const var = planes.variance[src].data();
+    const float* const nx = planes.normal[0].data();
+    const float* const ny = planes.normal[1].data();
+    const float* const nz = planes.normal[2].data();
+    const float* const z = planes.depth.data();
+
+    for (size_t x = 0; x < width; x += 8)
+    {
+        const size_t p = planes.index(x, y);
+        const float8 pnx = float8::load_unaligned(nx + p);
+        const float8 pny = float8::load_unaligned(ny + p);
+        const float8 pnz = float8::load_unaligned(nz + p);
+        const float8 pr = float8::load_unaligned(r + p);
+        const float8 pg = float8::load_unaligned(g + p);
+        const float8 pb = float8::load_unaligned(b + p);
+        const float8 pvar = float8::load_unaligned(var + p);
+        const float8 pz = float8::load_unaligned(z + p);
+        const float8 pl = luminance(pr, pg, pb);
+        const float8 inv_z = float8(1.0f) / pz;
+
+        const float8 sigma = float8::fma(fast_sqrt(float8::load_unaligned(planes.variance_blurred.data() + p)),
+            float8(SIGMA_LUMINANCE), float8(1e-6f));
+        const float8 inv_sigma = float8(1.0f) / sigma;
+
+        float8 weight_sum(0.0f), sum_r(0.0f), sum_g(0.0f), sum_b(0.0f), sum_var(0.0f);
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                const ptrdiff_t q = ptrdiff_t(p) + (dy * stride + dx) * ptrdiff_t(step);
+                const float8 qr = float8::load_unaligned(r + q);
+                const float8 qg = float8::load_unaligned(g + q);
+                const float8 qb = float8::load_unaligned(b + q);
+                const float8 qvar = float8::load_unaligned(var + q);
+
+                // max(0, n.n')^128 by seven squarings
+                float8 wn = float8::fma(pnx, float8::load_unaligned(nx + q),
+                    float8::fma(pny, float8::load_unaligned(ny + q), pnz * float8::load_unaligned(nz + q)));
+                wn = float8::max(wn, float8(0.0f));
+                for (int i = 0; i < 7; i++)
+                    wn = wn * wn;
+
+                const float distance = float(step) * std::fmax(1.0f, std::sqrt(float(dx * dx + dy * dy)));
+                const float8 dz = float8::abs(pz - float8::load_unaligned(z + q)) * inv_z * float8(1.0f / (SIGMA_DEPTH * distance));
+                const float8 dl = float8::abs(pl - luminance(qr, qg, qb)) * inv_sigma;
+
+                const float8 w = wn * float8(KERNEL[dy + 2] * KERNEL[dx + 2]) * fast_exp(-(dz + dl));
+                weight_sum += w;
+                sum_r = float8::fma(w, qr, sum_r);
+                sum_g = float8::fma(w, qg, sum_g);
+                sum_b = float8::fma(w, qb, sum_b);
+                sum_var = float8::fma(w * w, qvar, sum_var);
+            }
+        }
+
+        // Pixels nothing weighs in on, the sky's, keep their value
+        const mask8 filtered = weight_sum > float8(0.0f);
+        const float8 inv_weight = float8(1.0f) / float8::select(filtered, weight_sum, float8(1.0f));
+        float8::select(filtered, sum_r * inv_weight, pr).store_unaligned(planes.radiance[dst][0].data() + p);
+        float8::select(filtered, sum_g * inv_weight, pg).store_unaligned(planes.radiance[dst][1].data() + p);
+        float8::select(filtered, sum_b * inv_weight, pb).store_unaligned(planes.radiance[dst][2].data() + p);
+        float8::select(filtered, sum_var * inv_weight * inv_weight, pvar).store_unaligned(planes.variance[dst].data() + p);
+    }
+}
+
+/**
+ * Multiplies row `y` of the filtered radiance by albedo again and writes it back over the image's
+ * sums, scaled by each pixel's sample count.
+ */
+static void remodulate_row(Image& image, const size_t y, const DenoisePlanes& planes, const size_t src)
+{
+    const size_t width = image.width();
+    std::vector<float> albedo(width * 3);
+    image.aov_row(Aov::Albedo, y, albedo.data());
+
+    for (size_t x = 0; x < width; x++)
+    {
+        const size_t i = planes.index(x, y);
+        const size_t tile = (y / Image::TILE_SIZE) * image.tiles_x() + x / Image::TILE_SIZE;
+        Pixel& pixel = image.tile(tile).pixels[(y % Image::TILE_SIZE) * Image::TILE_SIZE + x % Image::TILE_SIZE];
+
+        pixel.r = planes.radiance[src][0][i] * std::fmax(albedo[x * 3 + 0], MIN_ALBEDO) * pixel.a;
+        pixel.g = planes.radiance[src][1][i] * std::fmax(albedo[x * 3 + 1], MIN_ALBEDO) * pixel.a;
+        pixel.b = planes.radiance[src][2][i] * std::fmax(albedo[x * 3 + 2], MIN_ALBEDO) * pixel.a;
+    }
+}
+
+void denoise(Image& image, ThreadPool& pool)
+{
+    assert((image.aovs() & DENOISE_AOVS) == DENOISE_AOVS);
+    TRACE_SCOPE("denoise");
+
+    const size_t width = image.width();
+    const size_t height = image.height();
+    const size_t bands = (height + DENOISE_BAND - 1) / DENOISE_BAND;
+    DenoisePlanes planes(width, height);
+
+    // Every band of a pass reads its neighbours' rows from the last pass, so passes don't overlap
+    const auto for_each_row = [&](const auto& fn)
+    {
+        pool.parallel_for(bands, [&](const size_t band)
+        {
+            const size_t end = std::min(height, (band + 1) * DENOISE_BAND);
+            for (size_t y = band * DENOISE_BAND; y < end; y++)
+                fn(y);
+        });
+    };
+
+    for_each_row([&](const size_t y) { demodulate_row(image, y, planes); });
+
+    size_t src = 0;
+    for (size_t pass = 0; pass < DENOISE_PASSES; pass++)
+    {
+        for_each_row([&](const size_t y) { blur_variance_row(planes.variance[src], y, width, planes); });
+        for_each_row([&](const size_t y) { filter_row(y, width, size_t(1) << pass, src, planes); });
+        src = 1 - src;
+    }
+
+    for_each_row([&](const size_t y) { remodulate_row(image, y, planes, src); });
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "image.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * AOVs `denoise` needs the image to have.
+ */
+constexpr AovMask DENOISE_AOVS =
+    aov_bit(Aov::Depth) | aov_bit(Aov::Normal) | aov_bit(Aov::Albedo) | aov_bit(Aov::Variance);
+
+/**
+ * Filters the noise out of `image`'s beauty pass in place with an edge-avoiding à-trous wavelet
+ * filter guided by its feature buffers, in the manner of SVGF. Radiance is divided by albedo so
+ * texture detail isn't blurred, then filtered in passes of a 5x5 kernel whose taps spread twice
+ * as far each pass. Taps are weighted down across changes of normal and depth, and across
+ * luminance differences large next to the pixel's estimated standard deviation, which the passes
+ * shrink as they go. Pixels that saw only the sky are left as they are. Sample counts are kept.
+ *
+ * `image` must have every AOV in `DENOISE_AOVS`. Rows are filtered in bands on `pool`, eight
+ * pixels at a time.
+ */
+void denoise(Image& image, ThreadPool& pool);
\ No newline at end of file
@@ -0,0 +1,366 @@
+#pragma once
+
+// Approximate math used while shading. Each `fast_*` function documents its worst case error
+// over the stated domain, measured against the double precision result.
+//
+// Call sites should use the `math_*` wrappers, which pick the exact or approximate version
+// depending on ENABLE_FAST_MATH. `pow_int` is exact (up to rounding) and always used.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include "common.hpp"
+#include "float8.hpp"
+
+#ifndef ENABLE_FAST_MATH
+    #define ENABLE_FAST_MATH 0
+#endif
+
+constexpr float LOG2_E = 1.44269504f;
+constexpr float LN_2 = 0.693147181f;
+
+inline float float_from_bits(const uint32_t bits)
+{
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint32_t bits_from_float(const float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/**
+ * Computes `x^N` with ceil(log2(N)) multiplies.
+ */
+template<unsigned N, typename T> inline T pow_int(const T& x)
+{
+    if constexpr (N == 0)
+    {
+        return T(1.0f);
+    }
+    else if constexpr (N == 1)
+    {
+        return x;
+    }
+    else
+    {
+        const T h = pow_int<N / 2>(x);
+        if constexpr (N % 2 == 0) return h * h;
+        else return h * h * x;
+    }
+}
+
+/**
+ * Approximates `1 / sqrt(x)` for positive normal `x`. Max relative error 2.5e-7 with SIMD
+ * (hardware estimate plus one Newton-Raphson step) and 5e-6 without (bit trick plus two steps).
+ */
+inline float fast_rsqrt(const float x)
+{
+#if ENABLE_SIMD
+    const __m128 v = _mm_set_ss(x);
+    const __m128 y = _mm_rsqrt_ss(v);
+    const __m128 yy = _mm_mul_ss(y, y);
+    const __m128 s = _mm_sub_ss(_mm_set_ss(1.5f), _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), v), yy));
+    return _mm_cvtss_f32(_mm_mul_ss(y, s));
+#else
+    float y = float_from_bits(0x5F375A86u - (bits_from_float(x) >> 1));
+    y = y * (1.5f - 0.5f * x * y * y);
+    y = y * (1.5f - 0.5f * x * y * y);
+    return y;
+#endif
+}
+
+/**
+ * Approximates `sqrt(x)` for non-negative `x` with the same relative error as `fast_rsqrt`.
+ */
+inline float fast_sqrt(const float x)
+{
+    return x * fast_rsqrt(std::fmax(x, FLT_MIN));
+}
+
+/**
+ * Approximates `2^x`. Max relative error 2.2e-7 over [-126, 127]. Inputs outside that range are
+ * clamped.
+ */
+inline float fast_exp2(float x)
+{
+    x = std::fmin(std::fmax(x, -126.0f), 127.0f);
+    const float n = std::nearbyint(x);
+    const float f = (x - n) * LN_2;
+
+    // Taylor series of e^f for f in [-ln(2)/2, ln(2)/2]
+    float p = 1.0f / 720.0f;
+    p = p * f + 1.0f / 120.0f;
+    p = p * f + 1.0f / 24.0f;
+    p = p * f + 1.0f / 6.0f;
+    p = p * f + 0.5f;
+    p = p * f + 1.0f;
+    p = p * f + 1.0f;
+
+    return p * float_from_bits(uint32_t(int32_t(n) + 127) << 23);
+}
+
+/**
+ * Approximates `log2(x)` for positive normal `x`. Max absolute error 1.4e-7 on [0.5, 2] and max
+ * relative error 1e-7 elsewhere.
+ */
+inline float fast_log2(const float x)
+{
+    const uint32_t bits = bits_from_float(x);
+    float e = float(int32_t(bits >> 23) - 127);
+    float m = float_from_bits((bits & 0x007FFFFFu) | 0x3F800000u);
+
+    // Center the mantissa on 1 so the series below converges quickly
+    if (m > 1.41421356f)
+    {
+        m *= 0.5f;
+        e += 1.0f;
+    }
+
+    // log2(m) = 2/ln(2) * atanh(t) with t = (m - 1) / (m + 1), |t| < 0.172
+    const float t = (m - 1.0f) / (m + 1.0f);
+    const float t2 = t * t;
+    float p = 2.0f / (7.0f * LN_2);
+    p = p * t2 + 2.0f / (5.0f * LN_2);
+    p = p * t2 + 2.0f / (3.0f * LN_2);
+    p = p * t2 + 2.0f / LN_2;
+
+    return e + t * p;
+}
+
+/**
+ * Approximates `e^x`. Max relative error 2.5e-7 for |x| < 1, growing to 4e-6 at |x| = 87 where
+ * rounding `x * log2(e)` dominates.
+ */
+inline float fast_exp(const float x)
+{
+    return fast_exp2(x * LOG2_E);
+}
+
+/**
+ * Approximates `ln(x)` for positive normal `x`. Max absolute error 1e-7 on [0.5, 2].
+ */
+inline float fast_log(const float x)
+{
+    return fast_log2(x) * LN_2;
+}
+
+/**
+ * Approximates `x^y` for positive `x`. The relative error is roughly `2e-7 * (1 + |y log2(x)|)`,
+ * so it grows without bound as `x` goes to 0. For `x^5` it's at most 4.5e-6 over [1e-4, 1].
+ */
+inline float fast_pow(const float x, const float y)
+{
+    return fast_exp2(y * fast_log2(x));
+}
+
+/**
+ * Approximates `tan(x)`. Max relative error 2.5e-7 for |x| < pi/2. Further out the absolute error
+ * grows by about 1e-9 per period because of the range reduction.
+ */
+inline float fast_tan(const float x)
+{
+    // Reduce to r in [-pi/4, pi/4] with a two part pi/2 to keep the reduction accurate
+    const float k = std::nearbyint(x * 0.636619772f);
+    const float r = (x - k * 1.5703125f) - k * 4.83826794897e-4f;
+    const float r2 = r * r;
+
+    // Lambert's continued fraction truncated to a [7/6] rational
+    const float num = r * (135135.0f + r2 * (-17325.0f + r2 * (378.0f - r2)));
+    const float den = 135135.0f + r2 * (-62370.0f + r2 * (3150.0f - 28.0f * r2));
+
+    // tan(r + pi/2) = -1 / tan(r)
+    return (int32_t(k) & 1) ? -den / num : num / den;
+}
+
+
+
+/**
+ * Eight-wide versions of the approximations above with the same error bounds. Without SIMD they
+ * evaluate the scalar versions lane by lane.
+ */
+inline float8 fast_rsqrt(const float8& x)
+{
+#if ENABLE_SIMD
+    const __m256 y = _mm256_rsqrt_ps(x.v);
+    const __m256 hx = _mm256_mul_ps(_mm256_set1_ps(0.5f), x.v);
+    const __m256 s = _mm256_fnmadd_ps(hx, _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f));
+    return float8(_mm256_mul_ps(y, s));
+#else
+    float8 res;
+    for (int i = 0; i < 8; i++) res.e[i] = fast_rsqrt(x.e[i]);
+    return res;
+#endif
+}
+
+inline float8 fast_sqrt(const float8& x)
+{
+    return x * fast_rsqrt(float8::max(x, float8(FLT_MIN)));
+}
+
+inline float8 fast_exp2(const float8& x)
+{
+#if ENABLE_SIMD
+    const __m256 c = _mm256_min_ps(_mm256_max_ps(x.v, _mm256_set1_ps(-126.0f)), _mm256_set1_ps(127.0f));
+    const __m256 n = _mm256_round_ps(c, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 f = _mm256_mul_ps(_mm256_sub_ps(c, n), _mm256_set1_ps(LN_2));
+
+    __m256 p = _mm256_set1_ps(1.0f / 720.0f);
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 120.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 24.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f / 6.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f));
+    p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.0f));
+
+    const __m256i scale = _mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)),
+        23
+    );
+    return float8(_mm256_mul_ps(p, _mm256_castsi256_ps(scale)));
+#else
+    float8 res;
+    for (int i = 0; i < 8; i++) res.e[i] = fast_exp2(x.e[i]);
+    return res;
+#endif
+}
+
+inline float8 fast_log2(const float8& x)
+{
+#if ENABLE_SIMD
+    const __m256i bits = _mm256_castps_si256(x.v);
+    __m256 e = _mm256_cvtepi32_ps(
+        _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127))
+    );
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+        _mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+        _mm256_set1_epi32(0x3F800000)
+    ));
+
+    const __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+    m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+    e = _mm256_add_ps(e, _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+    const __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(2.0f / (7.0f * LN_2));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(2.0f / (5.0f * LN_2)));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(2.0f / (3.0f * LN_2)));
+    p = _mm256_fmadd_ps(p, t2, _mm256_set1_ps(2.0f / LN_2));
+
+    return float8(_mm256_fmadd_ps(t, p, e));
+#else
+    float8 res;
+    for (int i = 0; i < 8; i++) res.e[i] = fast_log2(x.e[i]);
+    return res;
+#endif
+}
+
+inline float8 fast_exp(const float8& x)
+{
+    return fast_exp2(x * float8(LOG2_E));
+}
+
+inline float8 fast_log(const float8& x)
+{
+    return fast_log2(x) * float8(LN_2);
+}
+
+inline float8 fast_pow(const float8& x, const float8& y)
+{
+    return fast_exp2(y * fast_log2(x));
+}
+
+#if ENABLE_SIMD
+/**
+ * Four-wide `fast_sqrt`, used for `vec3`.
+ */
+inline __m128 fast_sqrt(const __m128 x)
+{
+    const __m128 c = _mm_max_ps(x, _mm_set1_ps(FLT_MIN));
+    const __m128 y = _mm_rsqrt_ps(c);
+    const __m128 hx = _mm_mul_ps(_mm_set1_ps(0.5f), c);
+    const __m128 s = _mm_fnmadd_ps(hx, _mm_mul_ps(y, y), _mm_set1_ps(1.5f));
+    return _mm_mul_ps(x, _mm_mul_ps(y, s));
+}
+#endif
+
+
+
+inline float math_rsqrt(const float x)
+{
+#if ENABLE_FAST_MATH
+    return fast_rsqrt(x);
+#else
+    return 1.0f / std::sqrt(x);
+#endif
+}
+
+inline float math_sqrt(const float x)
+{
+#if ENABLE_FAST_MATH
+    return fast_sqrt(x);
+#else
+    return std::sqrt(x);
+#endif
+}
+
+inline float math_pow(const float x, const float y)
+{
+#if ENABLE_FAST_MATH
+    return fast_pow(x, y);
+#else
+    return std::pow(x, y);
+#endif
+}
+
+inline float math_exp(const float x)
+{
+#if ENABLE_FAST_MATH
+    return fast_exp(x);
+#else
+    return std::exp(x);
+#endif
+}
+
+inline float math_log(const float x)
+{
+#if ENABLE_FAST_MATH
+    return fast_log(x);
+#else
+    return std::log(x);
+#endif
+}
+
+inline float math_tan(const float x)
+{
+#if ENABLE_FAST_MATH
+    return fast_tan(x);
+#else
+    return std::tan(x);
+#endif
+}
+
+inline float8 math_rsqrt(const float8& x)
+{
+#if ENABLE_FAST_MATH
+    return fast_rsqrt(x);
+#else
+    return float8(1.0f) / float8::sqrt(x);
+#endif
+}
+
+inline float8 math_sqrt(const float8& x)
+{
+#if ENABLE_FAST_MATH
+    return fast_sqrt(x);
+#else
+    return float8::sqrt(x);
+#endif
+}
\ No newline at end of file
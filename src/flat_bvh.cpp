@@ -0,0 +1,578 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include "flat_bvh.hpp"
+
+constexpr size_t SAH_BINS = 16;
+constexpr float TRAVERSAL_COST = 1.0f;
+
+// Past this depth nodes are split in half by count so the tree stays within `MAX_DEPTH`
+constexpr size_t MAX_SAH_DEPTH = 64;
+
+static_assert(MAX_SAH_DEPTH + 32 < FlatBvh::MAX_DEPTH, "median splits must fit in the stack");
+
+constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+// Roughly how many subtrees a refit splits the tree into, unless they'd be smaller than this
+constexpr size_t REFIT_SUBTREES = 256;
+constexpr size_t MIN_REFIT_SUBTREE_NODES = 64;
+
+using Clock = std::chrono::steady_clock;
+
+static inline float half_area(const point3& lo, const point3& hi)
+{
+    const auto d = hi - lo;
+    return d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+}
+
+static inline void store_bounds(FlatBvhNode& node, const point3& lo, const point3& hi)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        node.lo[i] = lo[i];
+        node.hi[i] = hi[i];
+    }
+}
+
+struct BuildTask
+{
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+
+    // Node whose `offset` must point at this task's node, when it is a second child
+    uint32_t parent;
+};
+
+struct SahBin
+{
+    point3 lo = point3(INFINITY, INFINITY, INFINITY);
+    point3 hi = point3(-INFINITY, -INFINITY, -INFINITY);
+    uint32_t count = 0;
+};
+
+/**
+ * Builds the nodes over `prims[begin, end)`, reordering that range, and appends them to `nodes`.
+ * Child indices are relative to the start of `nodes`; leaf offsets index `prims`.
+ */
+static void build_nodes(
+    const std::vector<aabb>& bounds,
+    const std::vector<point3>& centroids,
+    uint32_t* prims,
+    const uint32_t begin,
+    const uint32_t end,
+    const uint32_t depth,
+    const BvhBuilder builder,
+    std::vector<FlatBvhNode>& nodes
+)
+{
+    std::vector<BuildTask> stack = { BuildTask { begin, end, depth, NO_PARENT } };
+    while (!stack.empty())
+    {
+        const auto task = stack.back();
+        stack.pop_back();
+
+        const auto node_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        if (task.parent != NO_PARENT)
+            nodes[task.parent].offset = node_index;
+
+        point3 lo = bounds[prims[task.begin]].min();
+        point3 hi = bounds[prims[task.begin]].max();
+        point3 c_lo = centroids[prims[task.begin]];
+        point3 c_hi = c_lo;
+        for (uint32_t i = task.begin + 1; i < task.end; i++)
+        {
+            lo = vec3::min(lo, bounds[prims[i]].min());
+            hi = vec3::max(hi, bounds[prims[i]].max());
+            c_lo = vec3::min(c_lo, centroids[prims[i]]);
+            c_hi = vec3::max(c_hi, centroids[prims[i]]);
+        }
+        store_bounds(nodes[node_index], lo, hi);
+
+        const uint32_t n = task.end - task.begin;
+        const auto make_leaf = [&]()
+        {
+            nodes[node_index].offset = task.begin;
+            nodes[node_index].count = uint16_t(n);
+            nodes[node_index].axis = 0;
+        };
+
+        if (n <= 2)
+        {
+            make_leaf();
+            continue;
+        }
+
+        // Find the cheapest bin boundary over all three axes
+        int best_axis = -1;
+        size_t best_split = 0;
+        float best_cost = INFINITY;
+        const auto c_extent = c_hi - c_lo;
+
+        const bool sah = builder == BvhBuilder::Sah && task.depth < MAX_SAH_DEPTH;
+        for (int axis = 0; axis < 3 && sah; axis++)
+        {
+            if (!(c_extent[axis] > 0.0f))
+                continue;
+
+            SahBin bins[SAH_BINS];
+            const float scale = float(SAH_BINS) / c_extent[axis];
+            for (uint32_t i = task.begin; i < task.end; i++)
+            {
+                const auto b = std::min(size_t((centroids[prims[i]][axis] - c_lo[axis]) * scale), SAH_BINS - 1);
+                bins[b].lo = vec3::min(bins[b].lo, bounds[prims[i]].min());
+                bins[b].hi = vec3::max(bins[b].hi, bounds[prims[i]].max());
+                bins[b].count++;
+            }
+
+            // Sweep from the right to get the cost of everything above each boundary
+            float right_cost[SAH_BINS];
+            SahBin right;
+            for (size_t b = SAH_BINS - 1; b > 0; b--)
+            {
+                right.lo = vec3::min(right.lo, bins[b].lo);
+                right.hi = vec3::max(right.hi, bins[b].hi);
+                right.count += bins[b].count;
+                right_cost[b] = right.count == 0 ? 0.0f : half_area(right.lo, right.hi) * float(right.count);
+            }
+
+            SahBin left;
+            for (size_t b = 0; b + 1 < SAH_BINS; b++)
+            {
+                left.lo = vec3::min(left.lo, bins[b].lo);
+                left.hi = vec3::max(left.hi, bins[b].hi);
+                left.count += bins[b].count;
+                const float left_cost = left.count == 0 ? 0.0f : half_area(left.lo, left.hi) * float(left.count);
+                const float cost = left_cost + right_cost[b + 1];
+                if (left.count != 0 && left.count != n && cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b + 1;
+                }
+            }
+        }
+
+        // Without a cost to weigh, median trees split until leaves are full
+        const float parent_area = half_area(lo, hi);
+        const float split_cost = parent_area > 0.0f
+            ? TRAVERSAL_COST + best_cost / parent_area
+            : INFINITY;
+
+        if (n <= FlatBvh::MAX_LEAF_SIZE && !(split_cost < float(n)))
+        {
+            make_leaf();
+            continue;
+        }
+
+        uint32_t mid;
+        if (best_axis >= 0)
+        {
+            const float scale = float(SAH_BINS) / c_extent[best_axis];
+            const auto split = std::partition(
+                prims + task.begin,
+                prims + task.end,
+                [&](const uint32_t prim)
+                {
+                    const auto b = std::min(size_t((centroids[prim][best_axis] - c_lo[best_axis]) * scale), SAH_BINS - 1);
+                    return b < best_split;
+                }
+            );
+            mid = uint32_t(split - prims);
+        }
+        else
+        {
+            // Median builds, coincident centroids or too deep for SAH: split in half along the
+            // widest axis
+            best_axis = c_extent.x() > c_extent.y()
+                ? (c_extent.x() > c_extent.z() ? 0 : 2)
+                : (c_extent.y() > c_extent.z() ? 1 : 2);
+            mid = task.begin + n / 2;
+            std::nth_element(
+                prims + task.begin,
+                prims + mid,
+                prims + task.end,
+                [&](const uint32_t a, const uint32_t b)
+                {
+                    return centroids[a][best_axis] < centroids[b][best_axis];
+                }
+            );
+        }
+
+        nodes[node_index].count = 0;
+        nodes[node_index].axis = uint16_t(best_axis);
+
+        // The first child is popped next so it lands directly after its parent
+        stack.push_back(BuildTask { mid, task.end, task.depth + 1, node_index });
+        stack.push_back(BuildTask { task.begin, mid, task.depth + 1, NO_PARENT });
+    }
+}
+
+FlatBvh FlatBvh::build(const std::vector<aabb>& bounds, const BvhBuilder builder)
+{
+    FlatBvh bvh;
+    bvh.m_builder = builder;
+    const size_t count = bounds.size();
+    if (count == 0)
+        return bvh;
+
+    if (count >= std::numeric_limits<uint32_t>::max() / 2)
+        throw std::runtime_error("too many primitives for a FlatBvh");
+
+    std::vector<point3> centroids(count);
+    for (size_t i = 0; i < count; i++)
+        centroids[i] = 0.5f * (bounds[i].min() + bounds[i].max());
+
+    auto& prims = bvh.m_primitive_data;
+    auto& nodes = bvh.m_node_data;
+    prims.resize(count);
+    std::iota(prims.begin(), prims.end(), 0);
+    nodes.reserve(2 * count / MAX_LEAF_SIZE + 1);
+
+    build_nodes(bounds, centroids, prims.data(), 0, uint32_t(count), 0, builder, nodes);
+
+    bvh.m_nodes = nodes;
+    bvh.m_primitives = prims;
+    return bvh;
+}
+
+FlatBvh FlatBvh::view(
+    ArrayView<FlatBvhNode> nodes,
+    ArrayView<uint32_t> primitives,
+    std::shared_ptr<const void> backing
+)
+{
+    // Children always come after their parent, so depths can be found in one forward pass
+    std::vector<uint8_t> depth(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const auto& node = nodes[i];
+        if (node.is_leaf())
+        {
+            if (size_t(node.offset) + node.count > primitives.size())
+                throw std::runtime_error("BVH leaf refers to missing primitives");
+            continue;
+        }
+
+        if (node.axis > 2 || node.offset <= i + 1 || node.offset >= nodes.size() || size_t(depth[i]) + 1 >= MAX_DEPTH)
+            throw std::runtime_error("malformed BVH node");
+
+        depth[i + 1] = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+        depth[node.offset] = std::max<uint8_t>(depth[node.offset], depth[i] + 1);
+    }
+
+    FlatBvh bvh;
+    bvh.m_nodes = nodes;
+    bvh.m_primitives = primitives;
+    bvh.m_backing = std::move(backing);
+    return bvh;
+}
+
+static double seconds_since(const Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static inline float node_area(const FlatBvhNode& node)
+{
+    const auto box = node.bounds();
+    return half_area(box.min(), box.max());
+}
+
+/**
+ * SAH cost of the nodes in `[begin, end)`, not yet divided by the area of the first.
+ */
+static float subtree_cost(const FlatBvhNode* nodes, const uint32_t begin, const uint32_t end)
+{
+    float cost = 0.0f;
+    for (uint32_t i = begin; i < end; i++)
+        cost += node_area(nodes[i]) * (nodes[i].is_leaf() ? float(nodes[i].count) : TRAVERSAL_COST);
+    return cost;
+}
+
+static inline float relative_cost(const float cost, const FlatBvhNode& root)
+{
+    const float area = node_area(root);
+    return area > 0.0f ? cost / area : 0.0f;
+}
+
+/**
+ * One past the last node of the subtree at `index`. Nodes are depth first, so that's the leaf at
+ * the end of its chain of second children.
+ */
+static uint32_t subtree_end(const FlatBvhNode* nodes, uint32_t index)
+{
+    while (!nodes[index].is_leaf())
+        index = nodes[index].offset;
+    return index + 1;
+}
+
+/**
+ * Recomputes the bounds of the nodes in `[begin, end)` from the last one back, so children are
+ * refit before their parents.
+ */
+static void refit_nodes(
+    FlatBvhNode* nodes,
+    const uint32_t* prims,
+    const std::vector<aabb>& bounds,
+    const uint32_t begin,
+    const uint32_t end
+)
+{
+    for (uint32_t i = end; i-- > begin;)
+    {
+        auto& node = nodes[i];
+        point3 lo, hi;
+
+        if (node.is_leaf())
+        {
+            lo = bounds[prims[node.offset]].min();
+            hi = bounds[prims[node.offset]].max();
+            for (uint32_t k = node.offset + 1; k < node.offset + node.count; k++)
+            {
+                lo = vec3::min(lo, bounds[prims[k]].min());
+                hi = vec3::max(hi, bounds[prims[k]].max());
+            }
+        }
+        else
+        {
+            lo = vec3::min(vec3::load(nodes[i + 1].lo), vec3::load(nodes[node.offset].lo));
+            hi = vec3::max(vec3::load(nodes[i + 1].hi), vec3::load(nodes[node.offset].hi));
+        }
+
+        store_bounds(node, lo, hi);
+    }
+}
+
+FlatBvh FlatBvh::build(const std::vector<aabb>& start, const std::vector<aabb>& end, const BvhBuilder builder)
+{
+    if (start.size() != end.size())
+        throw std::runtime_error("a moving BVH needs bounds at both time keys for every primitive");
+
+    std::vector<aabb> swept(start.size());
+    for (size_t i = 0; i < start.size(); i++)
+        swept[i] = aabb::surrounding_box(start[i], end[i]);
+
+    FlatBvh bvh = build(swept, builder);
+    if (bvh.empty())
+        return bvh;
+
+    // Each key is refit to its own bounds over the swept topology
+    const auto count = uint32_t(bvh.m_node_data.size());
+    bvh.m_end_node_data = bvh.m_node_data;
+    refit_nodes(bvh.m_node_data.data(), bvh.m_primitive_data.data(), start, 0, count);
+    refit_nodes(bvh.m_end_node_data.data(), bvh.m_primitive_data.data(), end, 0, count);
+    return bvh;
+}
+
+void FlatBvh::init_refit()
+{
+    m_refit_subtrees.clear();
+    m_refit_top.clear();
+
+    // Walk down until subtrees are small enough, remembering the nodes passed on the way
+    const FlatBvhNode* nodes = m_node_data.data();
+    const auto max_size = uint32_t(std::max(m_node_data.size() / REFIT_SUBTREES, MIN_REFIT_SUBTREE_NODES));
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    while (!stack.empty())
+    {
+        const auto index = stack.back().first;
+        const auto depth = stack.back().second;
+        stack.pop_back();
+
+        const uint32_t end = subtree_end(nodes, index);
+        if (end - index <= max_size)
+        {
+            m_refit_subtrees.push_back(RefitSubtree {
+                index, depth, relative_cost(subtree_cost(nodes, index, end), nodes[index])
+            });
+            continue;
+        }
+
+        m_refit_top.push_back(index);
+        stack.emplace_back(nodes[index].offset, depth + 1);
+        stack.emplace_back(index + 1, depth + 1);
+    }
+
+    m_built_cost = relative_cost(subtree_cost(nodes, 0, uint32_t(m_node_data.size())), nodes[0]);
+}
+
+void FlatBvh::rebuild_subtrees(
+    const std::vector<aabb>& bounds,
+    ThreadPool& pool,
+    const std::vector<size_t>& which,
+    std::vector<float>& costs,
+    BvhRefitStats& stats
+)
+{
+    const FlatBvhNode* old_nodes = m_node_data.data();
+    uint32_t* prims = m_primitive_data.data();
+    std::vector<point3> centroids(bounds.size());
+    std::vector<std::vector<FlatBvhNode>> built(which.size());
+    std::vector<size_t> prim_counts(which.size());
+
+    pool.parallel_for(which.size(), [&](const size_t i)
+    {
+        auto& sub = m_refit_subtrees[which[i]];
+
+        // A subtree's leaves cover one run of the primitive list
+        uint32_t first = sub.root;
+        while (!old_nodes[first].is_leaf()) first++;
+        const uint32_t last = subtree_end(old_nodes, sub.root) - 1;
+        const uint32_t begin = old_nodes[first].offset;
+        const uint32_t end = old_nodes[last].offset + old_nodes[last].count;
+
+        for (uint32_t k = begin; k < end; k++)
+            centroids[prims[k]] = 0.5f * (bounds[prims[k]].min() + bounds[prims[k]].max());
+
+        build_nodes(bounds, centroids, prims, begin, end, sub.depth, m_builder, built[i]);
+        costs[which[i]] = subtree_cost(built[i].data(), 0, uint32_t(built[i].size()));
+        sub.built_cost = relative_cost(costs[which[i]], built[i][0]);
+        prim_counts[i] = end - begin;
+    });
+
+    // Splice the new subtrees in. Everything after a subtree that changed size moves with it.
+    std::vector<FlatBvhNode> spliced = {};
+    spliced.reserve(m_node_data.size());
+    std::vector<uint32_t> old_ends = {};
+    std::vector<uint32_t> shifts = {};
+    uint32_t cursor = 0;
+    size_t next = 0;
+
+    for (size_t i = 0; i < m_refit_subtrees.size(); i++)
+    {
+        auto& sub = m_refit_subtrees[i];
+        const uint32_t end = subtree_end(old_nodes, sub.root);
+        spliced.insert(spliced.end(), old_nodes + cursor, old_nodes + sub.root);
+
+        const auto new_root = uint32_t(spliced.size());
+        const bool rebuilt = next < which.size() && which[next] == i;
+        const FlatBvhNode* src = rebuilt ? built[next].data() : old_nodes + sub.root;
+        const size_t src_count = rebuilt ? built[next].size() : end - sub.root;
+        const uint32_t src_root = rebuilt ? 0 : sub.root;
+        for (size_t k = 0; k < src_count; k++)
+        {
+            auto node = src[k];
+            if (!node.is_leaf())
+                node.offset = node.offset - src_root + new_root;
+            spliced.push_back(node);
+        }
+
+        if (rebuilt)
+        {
+            stats.rebuilt_primitives += prim_counts[next];
+            next++;
+        }
+
+        sub.root = new_root;
+        old_ends.push_back(end);
+        shifts.push_back(uint32_t(spliced.size()) - end);
+        cursor = end;
+    }
+    spliced.insert(spliced.end(), old_nodes + cursor, old_nodes + m_node_data.size());
+
+    // How far a node outside every subtree moved: as far as the last subtree before it
+    const auto moved = [&](const uint32_t index)
+    {
+        const auto it = std::upper_bound(old_ends.begin(), old_ends.end(), index);
+        return it == old_ends.begin() ? index : index + shifts[size_t(it - old_ends.begin()) - 1];
+    };
+
+    for (auto& top : m_refit_top)
+    {
+        const uint32_t new_index = moved(top);
+        spliced[new_index].offset = moved(old_nodes[top].offset);
+        top = new_index;
+    }
+
+    m_node_data = std::move(spliced);
+    m_nodes = m_node_data;
+    stats.rebuilt_subtrees += which.size();
+}
+
+BvhRefitStats FlatBvh::refit(const std::vector<aabb>& bounds, ThreadPool& pool, const float rebuild_threshold)
+{
+    BvhRefitStats stats;
+    if (bounds.size() != m_primitives.size())
+        throw std::runtime_error("refit needs new bounds for every primitive in the BVH");
+    if (has_motion())
+        throw std::runtime_error("a BVH with motion keys can't be refit");
+    if (m_nodes.empty())
+        return stats;
+
+    // A tree used in place is read only, so take a copy
+    if (m_node_data.empty())
+    {
+        m_node_data.assign(m_nodes.begin(), m_nodes.end());
+        m_primitive_data.assign(m_primitives.begin(), m_primitives.end());
+        m_nodes = m_node_data;
+        m_primitives = m_primitive_data;
+        m_backing.reset();
+    }
+
+    // The bounds are still the ones the tree was built with, so this records the built costs
+    if (m_refit_subtrees.empty())
+        init_refit();
+
+    auto start = Clock::now();
+    std::vector<float> costs(m_refit_subtrees.size());
+    pool.parallel_for(m_refit_subtrees.size(), [&](const size_t i)
+    {
+        const uint32_t root = m_refit_subtrees[i].root;
+        const uint32_t end = subtree_end(m_node_data.data(), root);
+        refit_nodes(m_node_data.data(), m_primitive_data.data(), bounds, root, end);
+        costs[i] = subtree_cost(m_node_data.data(), root, end);
+    });
+    stats.subtrees = m_refit_subtrees.size();
+    stats.refit_seconds = seconds_since(start);
+
+    // Rebuilding a subtree keeps its root's bounds, so the nodes above can be refit first
+    start = Clock::now();
+    float top_cost = 0.0f;
+    for (auto it = m_refit_top.rbegin(); it != m_refit_top.rend(); ++it)
+    {
+        refit_nodes(m_node_data.data(), m_primitive_data.data(), bounds, *it, *it + 1);
+        top_cost += node_area(m_node_data[*it]) * TRAVERSAL_COST;
+    }
+    stats.refit_seconds += seconds_since(start);
+
+    // What the tree would cost with its degraded subtrees rebuilt as well as when first built
+    std::vector<size_t> degraded = {};
+    size_t degraded_nodes = 0;
+    float cost = top_cost;
+    for (size_t i = 0; i < m_refit_subtrees.size(); i++)
+    {
+        const auto& sub = m_refit_subtrees[i];
+        const auto& root = m_node_data[sub.root];
+        if (relative_cost(costs[i], root) > rebuild_threshold * sub.built_cost)
+        {
+            degraded.push_back(i);
+            degraded_nodes += subtree_end(m_node_data.data(), sub.root) - sub.root;
+            cost += sub.built_cost * node_area(root);
+        }
+        else
+        {
+            cost += costs[i];
+        }
+    }
+
+    // Rebuilding subtrees can't fix the nodes above them, and rebuilding most of the tree piece
+    // by piece is no cheaper than starting over
+    start = Clock::now();
+    if (relative_cost(cost, m_node_data[0]) > rebuild_threshold * m_built_cost
+        || degraded_nodes * 2 > m_node_data.size())
+    {
+        *this = build(bounds, m_builder);
+        stats.full_rebuild = true;
+    }
+    else if (!degraded.empty())
+    {
+        rebuild_subtrees(bounds, pool, degraded, costs, stats);
+    }
+    stats.rebuild_seconds = seconds_since(start);
+
+    return stats;
+}
\ No newline at end of file
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "array_view.hpp"
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * One node of a `FlatBvh`, sized and aligned so two share a cache line. Nodes are stored depth
+ * first: an interior node's first child directly follows it.
+ */
+struct alignas(32) FlatBvhNode
+{
+    float lo[3];
+
+    // First entry in the primitive list for a leaf, index of the second child otherwise
+    uint32_t offset;
+
+    float hi[3];
+
+    // Number of primitives in a leaf, 0 for interior nodes
+    uint16_t count;
+
+    // Axis an interior node was split along
+    uint16_t axis;
+
+    inline bool is_leaf() const noexcept { return count != 0; }
+
+    // The loads read `offset` and `count` into the padding lane, which `vec3::load` clears
+    inline aabb bounds() const noexcept { return aabb(vec3::load(lo), vec3::load(hi)); }
+};
+
+static_assert(sizeof(FlatBvhNode) == 32, "FlatBvhNode must stay 32 bytes");
+
+/**
+ * What a `FlatBvh::refit` did and how long it took.
+ */
+struct BvhRefitStats
+{
+    // Subtrees refit in parallel, and how many of them were rebuilt
+    size_t subtrees = 0;
+    size_t rebuilt_subtrees = 0;
+    size_t rebuilt_primitives = 0;
+
+    // The nodes above the subtrees degraded as well, so the whole hierarchy was rebuilt
+    bool full_rebuild = false;
+
+    double refit_seconds = 0.0;
+    double rebuild_seconds = 0.0;
+};
+
+/**
+ * How a `FlatBvh` chooses where to split its nodes.
+ */
+enum class BvhBuilder
+{
+    // Binned surface area heuristic over all three axes
+    Sah,
+
+    // Half the primitives on each side along the widest axis of their centroids. Kept for
+    // comparing tree quality
+    Median
+};
+
+/**
+ * Bounding volume hierarchy stored as a single array of nodes plus the primitive order, built
+ * with binned SAH or median splits. Holds no pointers, so it can be written to disk and read back in place.
+ */
+class FlatBvh
+{
+public:
+
+    static constexpr size_t MAX_LEAF_SIZE = 4;
+
+    // Deeper than any tree the builder produces
+    static constexpr size_t MAX_DEPTH = 128;
+
+    // Subtrees are rebuilt once their SAH cost grows by half over what it was when built
+    static constexpr float DEFAULT_REBUILD_THRESHOLD = 1.5f;
+
+    FlatBvh() = default;
+
+    FlatBvh(const FlatBvh&) = delete;
+    FlatBvh& operator=(const FlatBvh&) = delete;
+
+    FlatBvh(FlatBvh&&) = default;
+    FlatBvh& operator=(FlatBvh&&) = default;
+
+    /**
+     * Builds a hierarchy over primitives with the given bounds, splitting nodes as `builder`
+     * says. Leaves refer to primitives by their index in `bounds`.
+     */
+    static FlatBvh build(const std::vector<aabb>& bounds, const BvhBuilder builder = BvhBuilder::Sah);
+
+    /**
+     * Builds a hierarchy over moving primitives with bounds at two time keys: `start` when the
+     * shutter opens and `end` when it closes. The topology is chosen from the boxes swept between
+     * the two, and every node keeps a box for each key. Traversal blends the two at the ray's
+     * time, so a node is only as large as its primitives are at that instant. Throws
+     * `std::runtime_error` if the two lists differ in size.
+     */
+    static FlatBvh build(
+        const std::vector<aabb>& start,
+        const std::vector<aabb>& end,
+        const BvhBuilder builder = BvhBuilder::Sah
+    );
+
+    /**
+     * Uses prebuilt nodes and primitive indices in place. `backing` keeps their memory alive.
+     * Throws `std::runtime_error` if a node refers outside of the arrays.
+     */
+    static FlatBvh view(
+        ArrayView<FlatBvhNode> nodes,
+        ArrayView<uint32_t> primitives,
+        std::shared_ptr<const void> backing
+    );
+
+    /**
+     * Updates the hierarchy for primitives that moved, keeping its topology. `bounds` holds the
+     * new bounds of the primitives it was built over, in the same order. The tree is cut into
+     * subtrees that are refit bottom up on `pool`, then the few nodes above them are refit.
+     *
+     * Refitting loosens a tree as primitives move apart, so any subtree whose SAH cost has
+     * grown past `rebuild_threshold` times its cost when built is rebuilt over the same
+     * primitives. When the whole tree has degraded that far it is rebuilt from scratch. A tree
+     * used in place is copied first. Throws `std::runtime_error` if `bounds` has the wrong size
+     * or the tree has motion keys, which have to be rebuilt instead.
+     */
+    BvhRefitStats refit(
+        const std::vector<aabb>& bounds,
+        ThreadPool& pool,
+        const float rebuild_threshold = DEFAULT_REBUILD_THRESHOLD
+    );
+
+    inline bool empty() const noexcept { return m_nodes.empty(); }
+    inline ArrayView<FlatBvhNode> nodes() const noexcept { return m_nodes; }
+    inline ArrayView<uint32_t> primitives() const noexcept { return m_primitives; }
+
+    /**
+     * The nodes' bounds when the shutter closes, parallel to `nodes()`. Empty unless the tree was
+     * built over moving primitives.
+     */
+    inline ArrayView<FlatBvhNode> end_nodes() const noexcept { return m_end_node_data; }
+    inline bool has_motion() const noexcept { return !m_end_node_data.empty(); }
+
+    /**
+     * How the tree was built, and how refits rebuild it. Trees used in place count as SAH.
+     */
+    inline BvhBuilder builder() const noexcept { return m_builder; }
+
+    inline size_t memory_usage() const noexcept
+    {
+        return (m_nodes.size() + m_end_node_data.size()) * sizeof(FlatBvhNode)
+            + m_primitives.size() * sizeof(uint32_t);
+    }
+
+    /**
+     * Walks the nodes hit by `r`, nearest child first, calling `hit_primitive(index, t_max)` for
+     * every primitive in a leaf that is hit. The callback returns true on a hit and lowers
+     * `t_max` to the hit distance so farther nodes are culled.
+     */
+    template<typename F> inline bool traverse(
+        const ray& r,
+        const float t_min,
+        float t_max,
+        F&& hit_primitive
+    ) const
+    {
+        if (m_nodes.empty())
+            return false;
+
+        // Static trees never pay for blending boxes
+        return m_end_node_data.empty()
+            ? traverse_nodes<false>(r, t_min, t_max, hit_primitive)
+            : traverse_nodes<true>(r, t_min, t_max, hit_primitive);
+    }
+
+private:
+
+    template<bool Motion, typename F> inline bool traverse_nodes(
+        const ray& r,
+        const float t_min,
+        float t_max,
+        F& hit_primitive
+    ) const
+    {
+        const int signs = r.sign_bits();
+        const vec3 time(r.time(), r.time(), r.time());
+        uint32_t stack[MAX_DEPTH];
+        size_t stack_size = 0;
+        uint32_t current = 0;
+        bool hit_any = false;
+
+        // Counted locally and published once, keeping the thread local out of the loop
+        uint64_t box_tests = 0;
+        uint64_t nodes_visited = 0;
+
+        while (true)
+        {
+            const auto& node = m_nodes[current];
+            const aabb box = Motion ? blend_bounds(node, m_end_node_data[current], time) : node.bounds();
+            box_tests++;
+            if (box.hit(r, t_min, t_max))
+            {
+                nodes_visited++;
+                if (!node.is_leaf())
+                {
+                    // A ray travelling down the split axis reaches the second child first
+                    const bool second_first = (signs >> node.axis) & 1;
+                    stack[stack_size++] = second_first ? current + 1 : node.offset;
+                    current = second_first ? node.offset : current + 1;
+                    continue;
+                }
+
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+                {
+                    if (hit_primitive(m_primitives[i], t_max))
+                        hit_any = true;
+                }
+            }
+
+            if (stack_size == 0)
+                break;
+            current = stack[--stack_size];
+        }
+
+        RAY_STAT(box_tests, box_tests);
+        RAY_STAT(nodes_visited, nodes_visited);
+        return hit_any;
+    }
+
+    // Blends with fused multiply-adds, since this sits on the traversal's critical path
+    static inline aabb blend_bounds(const FlatBvhNode& start, const FlatBvhNode& end, const vec3& time) noexcept
+    {
+        const auto lo = vec3::load(start.lo);
+        const auto hi = vec3::load(start.hi);
+        return aabb(vec3::fma(time, vec3::load(end.lo) - lo, lo), vec3::fma(time, vec3::load(end.hi) - hi, hi));
+    }
+
+    struct RefitSubtree
+    {
+        uint32_t root;
+        uint32_t depth;
+
+        // SAH cost relative to the root's area when the subtree was built
+        float built_cost;
+    };
+
+    void init_refit();
+
+    void rebuild_subtrees(
+        const std::vector<aabb>& bounds,
+        ThreadPool& pool,
+        const std::vector<size_t>& which,
+        std::vector<float>& costs,
+        BvhRefitStats& stats
+    );
+
+    ArrayView<FlatBvhNode> m_nodes;
+    ArrayView<uint32_t> m_primitives;
+
+    std::vector<FlatBvhNode> m_node_data;
+    std::vector<uint32_t> m_primitive_data;
+    std::shared_ptr<const void> m_backing;
+
+    // Node bounds when the shutter closes, for trees over moving primitives
+    std::vector<FlatBvhNode> m_end_node_data;
+
+    BvhBuilder m_builder = BvhBuilder::Sah;
+
+    // Set up by the first refit: the subtrees refit in parallel, the nodes above them in depth
+    // first order, and the whole tree's cost when built
+    std::vector<RefitSubtree> m_refit_subtrees;
+    std::vector<uint32_t> m_refit_top;
+    float m_built_cost = 0.0f;
+};
\ No newline at end of file
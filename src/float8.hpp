@@ -0,0 +1,407 @@
+#pragma once
+
+// Eight-wide float lanes and masks used by the batched kernels. When ENABLE_SIMD is off every
+// operation falls back to a scalar loop with identical results, which is useful for testing.
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "common.hpp"
+
+/**
+ * Per-lane boolean produced by comparing two `float8`s. With SIMD enabled each lane is either all
+ * ones or all zeros so it can be used directly as a blend mask.
+ */
+class alignas(32) mask8
+{
+public:
+
+#if ENABLE_SIMD
+    inline mask8() : v(_mm256_setzero_ps()) {}
+    inline explicit mask8(const bool b) : v(_mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0))) {}
+#else
+    inline mask8() : e{} {}
+    inline explicit mask8(const bool b) : e{}
+    {
+        for (int i = 0; i < 8; i++) e[i] = b;
+    }
+#endif
+
+    inline bool operator[](int i) const
+    {
+        return (bits() >> i) & 1;
+    }
+
+    /**
+     * Returns the lanes packed into the low eight bits of an integer. Bit `i` is set when lane
+     * `i` is true.
+     */
+    inline int bits() const
+    {
+#if ENABLE_SIMD
+        return _mm256_movemask_ps(v);
+#else
+        int out = 0;
+        for (int i = 0; i < 8; i++) out |= (e[i] ? 1 : 0) << i;
+        return out;
+#endif
+    }
+
+    inline bool any() const { return bits() != 0; }
+    inline bool all() const { return bits() == 0xFF; }
+    inline bool none() const { return bits() == 0; }
+
+    inline mask8 operator&(const mask8& o) const
+    {
+        mask8 res;
+#if ENABLE_SIMD
+        res.v = _mm256_and_ps(v, o.v);
+#else
+        for (int i = 0; i < 8; i++) res.e[i] = e[i] && o.e[i];
+#endif
+        return res;
+    }
+
+    inline mask8 operator|(const mask8& o) const
+    {
+        mask8 res;
+#if ENABLE_SIMD
+        res.v = _mm256_or_ps(v, o.v);
+#else
+        for (int i = 0; i < 8; i++) res.e[i] = e[i] || o.e[i];
+#endif
+        return res;
+    }
+
+    inline mask8 operator^(const mask8& o) const
+    {
+        mask8 res;
+#if ENABLE_SIMD
+        res.v = _mm256_xor_ps(v, o.v);
+#else
+        for (int i = 0; i < 8; i++) res.e[i] = e[i] != o.e[i];
+#endif
+        return res;
+    }
+
+    inline mask8 operator!() const
+    {
+        return *this ^ mask8(true);
+    }
+
+    /**
+     * Returns `a & !b` in a single operation.
+     */
+    inline static mask8 and_not(const mask8& a, const mask8& b)
+    {
+        mask8 res;
+#if ENABLE_SIMD
+        res.v = _mm256_andnot_ps(b.v, a.v);
+#else
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] && !b.e[i];
+#endif
+        return res;
+    }
+
+    inline static mask8 from_bits(const int bits)
+    {
+        mask8 res;
+#if ENABLE_SIMD
+        const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i set = _mm256_and_si256(_mm256_set1_epi32(bits), lane_bits);
+        res.v = _mm256_castsi256_ps(_mm256_cmpeq_epi32(set, lane_bits));
+#else
+        for (int i = 0; i < 8; i++) res.e[i] = (bits >> i) & 1;
+#endif
+        return res;
+    }
+
+public:
+
+#if ENABLE_SIMD
+    __m256 v;
+#else
+    bool e[8];
+#endif
+};
+
+class alignas(32) float8
+{
+public:
+
+#if ENABLE_SIMD
+    inline float8() : v(_mm256_setzero_ps()) {}
+    inline float8(const float s) : v(_mm256_set1_ps(s)) {}
+    inline explicit float8(const __m256 m) : v(m) {}
+    inline float8(
+        float e0, float e1, float e2, float e3,
+        float e4, float e5, float e6, float e7
+    ) : v(_mm256_setr_ps(e0, e1, e2, e3, e4, e5, e6, e7)) {}
+#else
+    inline float8() : e{0,0,0,0,0,0,0,0} {}
+    inline float8(const float s) : e{s,s,s,s,s,s,s,s} {}
+    inline float8(
+        float e0, float e1, float e2, float e3,
+        float e4, float e5, float e6, float e7
+    ) : e{e0, e1, e2, e3, e4, e5, e6, e7} {}
+#endif
+
+    inline float operator[](int i) const { return e[i]; }
+    inline float& operator[](int i) { return e[i]; }
+
+    /**
+     * Loads eight consecutive floats. `src` must be 32 byte aligned.
+     */
+    inline static float8 load(const float* src)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_load_ps(src));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = src[i];
+        return res;
+#endif
+    }
+
+    inline static float8 load_unaligned(const float* src)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_loadu_ps(src));
+#else
+        return load(src);
+#endif
+    }
+
+    /**
+     * Stores eight consecutive floats. `dst` must be 32 byte aligned.
+     */
+    inline void store(float* dst) const
+    {
+#if ENABLE_SIMD
+        _mm256_store_ps(dst, v);
+#else
+        for (int i = 0; i < 8; i++) dst[i] = e[i];
+#endif
+    }
+
+    inline void store_unaligned(float* dst) const
+    {
+#if ENABLE_SIMD
+        _mm256_storeu_ps(dst, v);
+#else
+        store(dst);
+#endif
+    }
+
+    inline float8 operator-() const
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_xor_ps(v, _mm256_set1_ps(-0.0f)));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = -e[i];
+        return res;
+#endif
+    }
+
+    inline float8& operator+=(const float8& o) { return *this = *this + o; }
+    inline float8& operator-=(const float8& o) { return *this = *this - o; }
+    inline float8& operator*=(const float8& o) { return *this = *this * o; }
+    inline float8& operator/=(const float8& o) { return *this = *this / o; }
+
+    inline friend float8 operator+(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_add_ps(a.v, b.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] + b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend float8 operator-(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_sub_ps(a.v, b.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] - b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend float8 operator*(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_mul_ps(a.v, b.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] * b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend float8 operator/(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_div_ps(a.v, b.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] / b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend mask8 operator<(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        mask8 res;
+        res.v = _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+        return res;
+#else
+        mask8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] < b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend mask8 operator<=(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        mask8 res;
+        res.v = _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);
+        return res;
+#else
+        mask8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] <= b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend mask8 operator>(const float8& a, const float8& b) { return b < a; }
+    inline friend mask8 operator>=(const float8& a, const float8& b) { return b <= a; }
+
+    inline friend mask8 operator==(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        mask8 res;
+        res.v = _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ);
+        return res;
+#else
+        mask8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] == b.e[i];
+        return res;
+#endif
+    }
+
+    inline friend mask8 operator!=(const float8& a, const float8& b) { return !(a == b); }
+
+    inline static float8 min(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_min_ps(a.v, b.v));
+#else
+        // Matches minps: the second operand is returned when either is NaN
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] < b.e[i] ? a.e[i] : b.e[i];
+        return res;
+#endif
+    }
+
+    inline static float8 max(const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_max_ps(a.v, b.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = a.e[i] > b.e[i] ? a.e[i] : b.e[i];
+        return res;
+#endif
+    }
+
+    inline static float8 abs(const float8& a)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = std::fabs(a.e[i]);
+        return res;
+#endif
+    }
+
+    inline static float8 sqrt(const float8& a)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_sqrt_ps(a.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = std::sqrt(a.e[i]);
+        return res;
+#endif
+    }
+
+    /**
+     * Computes `a * b + c`. Uses a fused multiply-add when SIMD is enabled.
+     */
+    inline static float8 fma(const float8& a, const float8& b, const float8& c)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_fmadd_ps(a.v, b.v, c.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = std::fma(a.e[i], b.e[i], c.e[i]);
+        return res;
+#endif
+    }
+
+    /**
+     * Per lane, returns `a` where `m` is true and `b` otherwise.
+     */
+    inline static float8 select(const mask8& m, const float8& a, const float8& b)
+    {
+#if ENABLE_SIMD
+        return float8(_mm256_blendv_ps(b.v, a.v, m.v));
+#else
+        float8 res;
+        for (int i = 0; i < 8; i++) res.e[i] = m.e[i] ? a.e[i] : b.e[i];
+        return res;
+#endif
+    }
+
+    inline float horizontal_min() const
+    {
+        float res = e[0];
+        for (int i = 1; i < 8; i++) res = std::min(res, e[i]);
+        return res;
+    }
+
+    inline float horizontal_sum() const
+    {
+#if ENABLE_SIMD
+        const __m128 lo = _mm256_castps256_ps128(v);
+        const __m128 hi = _mm256_extractf128_ps(v, 1);
+        __m128 s = _mm_add_ps(lo, hi);
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_movehdup_ps(s));
+        return _mm_cvtss_f32(s);
+#else
+        float res = 0.0f;
+        for (int i = 0; i < 8; i++) res += e[i];
+        return res;
+#endif
+    }
+
+public:
+
+#if ENABLE_SIMD
+    union
+    {
+        float e[8];
+        __m256 v;
+    };
+#else
+    float e[8];
+#endif
+};
\ No newline at end of file
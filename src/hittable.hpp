@@ -26,4 +26,18 @@ public:
 
     virtual bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const = 0;
     virtual bool bounding_box(aabb& output_box) const = 0;
+
+    /**
+     * Bounds when the shutter opens and when it closes. Objects that move do so linearly between
+     * the two, so a box blended between them at a ray's time holds the object at that time.
+     * Objects that don't move return `bounding_box` for both.
+     */
+    virtual bool motion_bounds(aabb& start, aabb& end) const
+    {
+        if (!bounding_box(start))
+            return false;
+
+        end = start;
+        return true;
+    }
 };
\ No newline at end of file
@@ -1,45 +1,270 @@
 #include <cassert>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
 #include "image.hpp"
-#include "stb_image_write.h"
+#include "image_formats.hpp"
+#include "fast_math.hpp"
+#include "trace.hpp"
 
-Image::Image(const size_t width, const size_t height) :
+Image::Image(const size_t width, const size_t height, const AovMask aovs) :
+    m_tiles(),
+    m_aov_planes(),
+    m_aovs(aovs),
     m_width(width),
     m_height(height),
-    m_pixels()
+    m_tiles_x((width + TILE_SIZE - 1) / TILE_SIZE)
 {
-    m_pixels.resize(m_width * m_height);
+    m_tiles.resize(m_tiles_x * ((height + TILE_SIZE - 1) / TILE_SIZE));
+
+    for (size_t i = 0; i < AOV_COUNT; i++)
+    {
+        const Aov aov = Aov(i);
+        if (has_aov(aov) && aov != Aov::SampleCount)
+            m_aov_planes[i].resize(m_tiles.size() * aov_lines_per_tile(aov));
+    }
+}
+
+/**
+ * Converts `count` floats to bytes, scaling [0, 1] to [0, 255].
+ */
+static inline void to_bytes(const float* src, uint8_t* dst, const size_t count)
+{
+    size_t i = 0;
+#if ENABLE_SIMD
+    const __m256 scale = _mm256_set1_ps(255.999f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(255.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), zero), one);
+        const __m256i ints = _mm256_cvttps_epi32(v);
+        const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1));
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(words, words));
+    }
+#endif
+
+    for (; i < count; i++)
+        dst[i] = static_cast<uint8_t>(std::fmax(0.0f, std::fmin(src[i] * 255.999f, 255.0f)));
+}
+
+/**
+ * Spreads each of the two pixels' sample counts across its four lanes.
+ */
+static inline float8 sample_counts(const float8& pixels)
+{
+#if ENABLE_SIMD
+    return float8(_mm256_permute_ps(pixels.v, _MM_SHUFFLE(3, 3, 3, 3)));
+#else
+    return float8(pixels[3], pixels[3], pixels[3], pixels[3], pixels[7], pixels[7], pixels[7], pixels[7]);
+#endif
+}
+
+static inline float8 tonemap(const float8& c, const Tonemap op)
+{
+    switch (op)
+    {
+    case Tonemap::Reinhard:
+        return c / (c + float8(1.0f));
+
+    case Tonemap::Aces:
+    {
+        // Narkowicz's fit of the ACES filmic curve
+        const float8 num = c * float8::fma(c, float8(2.51f), float8(0.03f));
+        const float8 den = float8::fma(c, float8::fma(c, float8(2.43f), float8(0.59f)), float8(0.14f));
+        return num / den;
+    }
+
+    default:
+        return c;
+    }
+}
+
+/**
+ * The sRGB transfer function for values in [0, 1]. `fast_pow` is well within 8 bit precision.
+ */
+static inline float8 encode_srgb(const float8& c)
+{
+    const float8 curve = float8::fma(fast_pow(float8::max(c, float8(FLT_MIN)), float8(1.0f / 2.4f)), float8(1.055f), float8(-0.055f));
+    return float8::select(c <= float8(0.0031308f), c * float8(12.92f), curve);
 }
 
-void Image::average(const Image& other)
+void Image::merge(const Image& other)
 {
-    assert(m_width == other.width() && m_height == other.height());
+    assert(other.m_width == m_width && other.m_height == m_height);
+    TRACE_SCOPE("merge");
 
-    for (size_t y = 0; y < m_height; y++)
+    constexpr size_t FLOATS = sizeof(Tile) / sizeof(float);
+    for (size_t tile = 0; tile < m_tiles.size(); tile++)
     {
-        for (size_t x = 0; x < m_width; x++)
+        float* dst = &m_tiles[tile].pixels[0].r;
+        const float* src = &other.m_tiles[tile].pixels[0].r;
+        for (size_t i = 0; i < FLOATS; i += 8)
+            (float8::load(dst + i) + float8::load(src + i)).store(dst + i);
+    }
+
+    for (const Aov aov : { Aov::Normal, Aov::Albedo, Aov::Variance })
+    {
+        auto& dst = m_aov_planes[size_t(aov)];
+        const auto& src = other.m_aov_planes[size_t(aov)];
+        if (dst.empty() || src.empty())
+            continue;
+
+        for (size_t line = 0; line < dst.size(); line++)
         {
-            const size_t idx = (((m_height - 1) - y) * m_width) + x;
-            m_pixels[idx].r = (m_pixels[idx].r + other.m_pixels[idx].r) / 2.0f;
-            m_pixels[idx].g = (m_pixels[idx].g + other.m_pixels[idx].g) / 2.0f;
-            m_pixels[idx].b = (m_pixels[idx].b + other.m_pixels[idx].b) / 2.0f;
+            for (size_t i = 0; i < 16; i += 8)
+                (float8::load(dst[line].values + i) + float8::load(src[line].values + i)).store(dst[line].values + i);
         }
     }
 }
 
-void Image::save(const char* path) const
+void Image::resolve_row(const size_t row, uint8_t* dst, const ResolveSettings& settings) const
 {
-    assert(path != nullptr);
+    assert(row < m_height);
+
+    const float8 exposure(std::exp2(settings.exposure));
+    const mask8 alpha = mask8::from_bits(0x88);
+    const size_t y = (m_height - 1) - row;
+    const Tile* tiles = m_tiles.data() + (y / TILE_SIZE) * m_tiles_x;
+
+    // A tile row is a run of contiguous pixels, so the row is resolved in tile wide runs, two
+    // pixels at a time. Pixels outside the image have no samples and resolve to black
+    for (size_t tx = 0; tx < m_tiles_x; tx++)
+    {
+        const float* src = &tiles[tx].pixels[(y % TILE_SIZE) * TILE_SIZE].r;
+        alignas(32) float resolved[TILE_SIZE * 4];
+        for (size_t i = 0; i < TILE_SIZE * 4; i += 8)
+        {
+            const float8 sums = float8::load(src + i);
+            const float8 counts = sample_counts(sums);
+            const float8 scale = exposure / float8::select(counts > float8(0.0f), counts, float8(1.0f));
+
+            float8 c = tonemap(sums * scale, settings.tonemap);
+            c = encode_srgb(float8::min(float8::max(c, float8(0.0f)), float8(1.0f)));
+            float8::select(alpha, float8(1.0f), c).store(resolved + i);
+        }
+
+        const size_t x = tx * TILE_SIZE;
+        to_bytes(resolved, dst + x * 4, std::min(TILE_SIZE, m_width - x) * 4);
+    }
+}
 
-    std::vector<uint8_t> bytes = {};
-    bytes.reserve(4 * m_width * m_height);
+void Image::to_rgba8(uint8_t* dst, const ResolveSettings& settings) const
+{
+    for (size_t row = 0; row < m_height; row++)
+        resolve_row(row, dst + row * m_width * 4, settings);
+}
+
+void Image::linear_row(const size_t y, const float scale, float* dst) const
+{
+    assert(y < m_height);
+
+    const Tile* tiles = m_tiles.data() + (y / TILE_SIZE) * m_tiles_x;
+    for (size_t x = 0; x < m_width; x++)
+    {
+        const Pixel& p = tiles[x / TILE_SIZE].pixels[(y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+        const float s = p.a > 0.0f ? scale / p.a : 0.0f;
+        dst[x * 3 + 0] = p.r * s;
+        dst[x * 3 + 1] = p.g * s;
+        dst[x * 3 + 2] = p.b * s;
+    }
+}
+
+void Image::aov_row(const Aov aov, const size_t y, float* dst) const
+{
+    assert(y < m_height && has_aov(aov));
+
+    const size_t channels = aov_channels(aov);
+    const bool summed = aov == Aov::Normal || aov == Aov::Albedo;
+    const Tile* tiles = m_tiles.data() + (y / TILE_SIZE) * m_tiles_x;
+    for (size_t x = 0; x < m_width; x++)
+    {
+        const size_t tile = (y / TILE_SIZE) * m_tiles_x + x / TILE_SIZE;
+        const size_t index = (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+        const float count = tiles[x / TILE_SIZE].pixels[index].a;
+        if (aov == Aov::SampleCount)
+        {
+            dst[x] = count;
+            continue;
+        }
+
+        const float* src = aov_tile(aov, tile) + index * channels;
+        if (aov == Aov::Variance)
+        {
+            // E[l^2] - E[l]^2 over the samples, divided by their count for the mean's variance
+            const Pixel& p = tiles[x / TILE_SIZE].pixels[index];
+            const float mean = count > 0.0f ? luminance(p.r, p.g, p.b) / count : 0.0f;
+            dst[x] = count > 0.0f ? std::fmax(0.0f, src[0] / count - mean * mean) / count : 0.0f;
+            continue;
+        }
+
+        const float s = summed ? (count > 0.0f ? 1.0f / count : 0.0f) : 1.0f;
+        for (size_t c = 0; c < channels; c++)
+            dst[x * channels + c] = src[c] * s;
+    }
+}
+
+static bool has_extension(const char* path, const char* extension)
+{
+    const size_t length = std::strlen(path);
+    const size_t ext_length = std::strlen(extension);
+    if (length < ext_length)
+        return false;
 
-    for (const auto& pixel : m_pixels)
+    for (size_t i = 0; i < ext_length; i++)
     {
-        bytes.push_back(static_cast<uint8_t>(std::fmax(0.0, std::fmin(pixel.r * 255.999, 255.0))));
-        bytes.push_back(static_cast<uint8_t>(std::fmax(0.0, std::fmin(pixel.g * 255.999, 255.0))));
-        bytes.push_back(static_cast<uint8_t>(std::fmax(0.0, std::fmin(pixel.b * 255.999, 255.0))));
-        bytes.push_back(static_cast<uint8_t>(std::fmax(0.0, std::fmin(pixel.a * 255.999, 255.0))));
+        if (std::tolower((unsigned char)path[length - ext_length + i]) != extension[i])
+            return false;
     }
+    return true;
+}
+
+ImageFormat image_format(const char* path)
+{
+    if (has_extension(path, ".png")) return ImageFormat::Png;
+    if (has_extension(path, ".pfm")) return ImageFormat::Pfm;
+    if (has_extension(path, ".hdr")) return ImageFormat::Hdr;
+    if (has_extension(path, ".exr")) return ImageFormat::Exr;
+    throw std::runtime_error(std::string("'") + path + "' isn't a .png, .pfm, .hdr or .exr file");
+}
+
+void Image::encode(std::ostream& out, const ImageFormat format, const ResolveSettings& settings, ThreadPool* pool) const
+{
+    TRACE_SCOPE("encode");
+    const float scale = std::exp2(settings.exposure);
+    switch (format)
+    {
+    case ImageFormat::Pfm:
+        write_pfm(*this, out, scale);
+        return;
+
+    case ImageFormat::Hdr:
+        write_rgbe(*this, out, scale);
+        return;
+
+    case ImageFormat::Exr:
+        write_exr(*this, out, scale);
+        return;
+
+    default:
+        write_png(*this, out, settings, pool);
+        return;
+    }
+}
+
+void Image::save(const char* path, const ResolveSettings& settings, ThreadPool* pool) const
+{
+    assert(path != nullptr);
+    TRACE_SCOPE("save");
+
+    const ImageFormat format = image_format(path);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error(std::string("unable to open '") + path + "' for writing");
 
-    stbi_write_png(path, (int)m_width, (int)m_height, 4, bytes.data(), m_width * 4);
+    encode(out, format, settings, pool);
+    if (!out.flush())
+        throw std::runtime_error(std::string("unable to write '") + path + "'");
 }
\ No newline at end of file
@@ -1,10 +1,19 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <iosfwd>
 #include <vector>
 #include <algorithm>
 #include "vec3.hpp"
 
-struct Pixel 
+class ThreadPool;
+
+/**
+ * Linear radiance summed over `a` samples. Keeping sums rather than averages lets more samples be
+ * added to a pixel, or whole images of the same view be merged, before the image is resolved.
+ */
+struct Pixel
 {
     float r;
     float g;
@@ -12,41 +21,240 @@ struct Pixel
     float a;
 };
 
+/**
+ * A rectangle of pixels in an image, in pixel coordinates.
+ */
+struct PixelRect
+{
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+
+    inline size_t pixel_count() const noexcept { return width * height; }
+};
+
+enum class Tonemap
+{
+    None,
+    Reinhard,
+    Aces
+};
+
+/**
+ * How linear radiance becomes display values when an image is resolved. `exposure` is in stops,
+ * applied before the tone curve. Without a tone curve values above 1 clip.
+ */
+struct ResolveSettings
+{
+    float exposure = 0.0f;
+    Tonemap tonemap = Tonemap::None;
+};
+
+/**
+ * Extra planes captured from each camera ray's first hit, for compositing and denoising. Normal
+ * and albedo are summed over a pixel's samples like the beauty pass. Depth and material id come
+ * from the pixel's first sample alone, since averages across an edge describe no surface.
+ * Variance sums the squared luminance of the samples and is read back as the variance of the
+ * pixel's mean luminance. The sample count is every pixel's own and takes no plane.
+ */
+enum class Aov
+{
+    Depth,
+    Normal,
+    Albedo,
+    MaterialId,
+    Variance,
+    SampleCount
+};
+
+constexpr size_t AOV_COUNT = 6;
+
+/**
+ * A set of AOVs, one bit per `Aov`.
+ */
+using AovMask = uint32_t;
+
+constexpr AovMask aov_bit(const Aov aov) { return AovMask(1) << uint32_t(aov); }
+
+/**
+ * Floats per pixel in an AOV's plane and in its rows.
+ */
+constexpr size_t aov_channels(const Aov aov)
+{
+    return aov == Aov::Normal || aov == Aov::Albedo ? 3 : 1;
+}
+
+/**
+ * Rec. 709 luminance of linear RGB.
+ */
+inline float luminance(const float r, const float g, const float b)
+{
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+enum class ImageFormat
+{
+    Png,
+    Pfm,
+    Hdr,
+    Exr
+};
+
+/**
+ * The format named by `path`'s extension, ignoring case. Throws `std::runtime_error` when it isn't
+ * one `Image::save` writes.
+ */
+ImageFormat image_format(const char* path);
+
+/**
+ * Pixels stored in square tiles, each row-major and aligned to cache lines, with the tiles
+ * themselves in row-major order. A worker filling one tile never shares a cache line with a
+ * worker filling another. `y` runs up the image; the rows are flipped when converted to the
+ * usual top-down linear layout for output.
+ */
 class Image
 {
 public:
 
-    Image(const size_t width, const size_t height);
+    static constexpr size_t TILE_SIZE = 8;
+
+    struct alignas(64) Tile
+    {
+        Pixel pixels[TILE_SIZE * TILE_SIZE];
+    };
+
+    /**
+     * An image with a plane for each AOV in `aovs`, tiled like the pixels. AOVs left out take no
+     * memory.
+     */
+    Image(const size_t width, const size_t height, const AovMask aovs = 0);
 
     inline size_t width() const noexcept { return m_width; }
     inline size_t height() const noexcept { return m_height; }
     inline float aspect_ratio() const noexcept { return float(m_width) / float(m_height); }
 
+    inline AovMask aovs() const noexcept { return m_aovs; }
+    inline bool has_aov(const Aov aov) const noexcept { return (m_aovs & aov_bit(aov)) != 0; }
+
+    inline size_t tiles_x() const noexcept { return m_tiles_x; }
+    inline size_t tile_count() const noexcept { return m_tiles.size(); }
+
+    /**
+     * Pixels covered by `tile`. Tiles on the right and top edges are clipped to the image.
+     */
+    inline PixelRect tile_rect(const size_t tile) const noexcept
+    {
+        const size_t x = (tile % m_tiles_x) * TILE_SIZE;
+        const size_t y = (tile / m_tiles_x) * TILE_SIZE;
+        return PixelRect { x, y, std::min(TILE_SIZE, m_width - x), std::min(TILE_SIZE, m_height - y) };
+    }
+
+    /**
+     * Pixel `(x, y)` of `tile_rect(tile)` is at `x + y * TILE_SIZE`.
+     */
+    inline Tile& tile(const size_t tile) noexcept { return m_tiles[tile]; }
+    inline const Tile& tile(const size_t tile) const noexcept { return m_tiles[tile]; }
+
+    /**
+     * `tile`'s part of the plane of `aov`, which must have one. Pixel `(x, y)` of
+     * `tile_rect(tile)` starts at `(x + y * TILE_SIZE) * aov_channels(aov)`. Each tile starts on
+     * a cache line of its own.
+     */
+    inline float* aov_tile(const Aov aov, const size_t tile) noexcept
+    {
+        assert(!m_aov_planes[size_t(aov)].empty());
+        return m_aov_planes[size_t(aov)][tile * aov_lines_per_tile(aov)].values;
+    }
+
+    inline const float* aov_tile(const Aov aov, const size_t tile) const noexcept
+    {
+        assert(!m_aov_planes[size_t(aov)].empty());
+        return m_aov_planes[size_t(aov)][tile * aov_lines_per_tile(aov)].values;
+    }
+
+    /**
+     * Replaces the pixel with the single sample `value`.
+     */
     inline void set_pixel(const size_t x, const size_t y, const color& value) noexcept
     {
-        if (x >= m_width || y >= m_height) return;
-        m_pixels[(((m_height - 1) - y) * m_width) + x] = Pixel 
-        {
-            value.x(),
-            value.y(),
-            value.z(),
-            1.0f
-        };
+        assert(x < m_width && y < m_height);
+        pixel(x, y) = Pixel { value.x(), value.y(), value.z(), 1.0f };
     }
 
     inline Pixel get_pixel(const size_t x, const size_t y) const noexcept
     {
-        if (x >= m_width || y >= m_height) return Pixel { 0, 0, 0, 0};
-        return m_pixels[(((m_height - 1) - y) * m_width) + x];
+        assert(x < m_width && y < m_height);
+        return m_tiles[(y / TILE_SIZE) * m_tiles_x + x / TILE_SIZE].pixels[(y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
     }
 
-    void average(const Image& other);
+    /**
+     * Adds the sums and sample counts of `other`, which must be the same size, to this image's,
+     * along with the normal, albedo and squared luminance sums of AOVs both images have. Depth and material id keep
+     * this image's first samples.
+     */
+    void merge(const Image& other);
 
-    void save(const char* path) const;
+    /**
+     * Resolves to 8 bit sRGB, top row first: each pixel's sum is divided by its sample count,
+     * exposed, tone mapped and encoded. Alpha is opaque. `dst` must hold
+     * `4 * width() * height()` bytes.
+     */
+    void to_rgba8(uint8_t* dst, const ResolveSettings& settings = {}) const;
+
+    /**
+     * `to_rgba8` for the single output row `row`, counted from the top. `dst` must hold
+     * `4 * width()` bytes.
+     */
+    void resolve_row(const size_t row, uint8_t* dst, const ResolveSettings& settings) const;
+
+    /**
+     * Writes row `y` as `3 * width()` floats of RGB radiance, averaged over each pixel's samples
+     * and multiplied by `scale`.
+     */
+    void linear_row(const size_t y, const float scale, float* dst) const;
+
+    /**
+     * Writes row `y` of `aov` as `aov_channels(aov)` floats per pixel, sums averaged over the
+     * pixel's samples.
+     */
+    void aov_row(const Aov aov, const size_t y, float* dst) const;
+
+    /**
+     * Writes the image to `out` as `format`. PNG is resolved with `settings` and compressed on
+     * `pool` when one is given. PFM, Radiance HDR and OpenEXR keep linear radiance, exposed but
+     * not tone mapped. Only OpenEXR holds AOVs, as extra layers. Throws `std::runtime_error` if encoding fails; the stream's state is left
+     * for the caller to check.
+     */
+    void encode(std::ostream& out, const ImageFormat format, const ResolveSettings& settings, ThreadPool* pool = nullptr) const;
+
+    /**
+     * `encode`s the image to `path` in the format `image_format(path)` names. Throws
+     * `std::runtime_error` when the format is unknown or the file can't be written.
+     */
+    void save(const char* path, const ResolveSettings& settings = {}, ThreadPool* pool = nullptr) const;
 
 private:
 
-    std::vector<Pixel> m_pixels;
+    struct alignas(64) CacheLine
+    {
+        float values[16];
+    };
+
+    static constexpr size_t aov_lines_per_tile(const Aov aov)
+    {
+        return TILE_SIZE * TILE_SIZE * aov_channels(aov) / 16;
+    }
+
+    inline Pixel& pixel(const size_t x, const size_t y) noexcept
+    {
+        return m_tiles[(y / TILE_SIZE) * m_tiles_x + x / TILE_SIZE].pixels[(y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+    }
+
+    std::vector<Tile> m_tiles;
+    std::vector<CacheLine> m_aov_planes[AOV_COUNT];
+    AovMask m_aovs;
     size_t m_width;
     size_t m_height;
+    size_t m_tiles_x;
 };
\ No newline at end of file
@@ -0,0 +1,592 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "image_formats.hpp"
+#include "fast_math.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "stb_image_write.h"
+
+#if ENABLE_ZLIB
+    #include <zlib.h>
+#endif
+
+static inline bool little_endian()
+{
+    const uint16_t probe = 1;
+    uint8_t low;
+    std::memcpy(&low, &probe, 1);
+    return low == 1;
+}
+
+#if ENABLE_ZLIB
+
+// Raw scanline bytes each block of rows holds at most, the last block aside
+constexpr size_t PNG_BLOCK_BYTES = 512 * 1024;
+
+// Filtered renders compress nearly as well at zlib's fastest level as at its default, at a third
+// of the time
+constexpr int PNG_COMPRESSION_LEVEL = Z_BEST_SPEED;
+
+/**
+ * Filters `row` against `prev` with whichever of PNG's five filters leaves the smallest sum of
+ * absolute signed bytes, which usually compresses best. `dst` gets the filter type followed by the
+ * filtered row.
+ */
+static void filter_png_row(const uint8_t* row, const uint8_t* prev, const size_t size, uint8_t* dst, uint8_t* scratch)
+{
+    constexpr size_t BPP = 4;
+
+    size_t best_sum = SIZE_MAX;
+    for (uint8_t type = 0; type < 5; type++)
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            const int a = i >= BPP ? row[i - BPP] : 0;
+            const int b = prev[i];
+            const int c = i >= BPP ? prev[i - BPP] : 0;
+
+            int predicted = 0;
+            switch (type)
+            {
+            case 1: predicted = a; break;
+            case 2: predicted = b; break;
+            case 3: predicted = (a + b) / 2; break;
+            case 4:
+            {
+                const int pa = std::abs(b - c);
+                const int pb = std::abs(a - c);
+                const int pc = std::abs(a + b - 2 * c);
+                predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+                break;
+            }
+            default: break;
+            }
+
+            scratch[i] = uint8_t(row[i] - predicted);
+            sum += size_t(std::abs(int(int8_t(scratch[i]))));
+        }
+
+        if (sum < best_sum)
+        {
+            best_sum = sum;
+            dst[0] = type;
+            std::memcpy(dst + 1, scratch, size);
+        }
+    }
+}
+
+/**
+ * A block of rows compressed into raw deflate data. Blocks other than the last end in a sync
+ * flush, so they finish on a byte boundary without marking the end of the stream.
+ */
+struct PngBlock
+{
+    std::vector<uint8_t> data;
+    uLong adler;
+    size_t raw_size;
+};
+
+static void compress_png_block(
+    const Image& image,
+    const ResolveSettings& settings,
+    const size_t first_row,
+    const size_t rows,
+    const bool last,
+    PngBlock& block
+)
+{
+    const size_t stride = 4 * image.width();
+
+    // Each row is filtered against the one above it, which the block before owns, so the block
+    // resolves that row again rather than waiting for it
+    std::vector<uint8_t> prev(stride, 0);
+    std::vector<uint8_t> row(stride);
+    std::vector<uint8_t> scratch(stride);
+    std::vector<uint8_t> raw(rows * (stride + 1));
+    if (first_row > 0)
+        image.resolve_row(first_row - 1, prev.data(), settings);
+
+    for (size_t i = 0; i < rows; i++)
+    {
+        image.resolve_row(first_row + i, row.data(), settings);
+        filter_png_row(row.data(), prev.data(), stride, &raw[i * (stride + 1)], scratch.data());
+        std::swap(row, prev);
+    }
+
+    z_stream stream = {};
+    if (deflateInit2(&stream, PNG_COMPRESSION_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error("unable to start PNG compression");
+
+    // A sync flush adds at most an empty stored block to the bound
+    block.data.resize(deflateBound(&stream, uLong(raw.size())) + 16);
+    stream.next_in = raw.data();
+    stream.avail_in = uInt(raw.size());
+    stream.next_out = block.data.data();
+    stream.avail_out = uInt(block.data.size());
+
+    const int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool complete = (last ? result == Z_STREAM_END : result == Z_OK) && stream.avail_in == 0 && stream.avail_out > 0;
+    block.data.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    if (!complete)
+        throw std::runtime_error("PNG compression failed");
+
+    block.adler = adler32(adler32(0, nullptr, 0), raw.data(), uInt(raw.size()));
+    block.raw_size = raw.size();
+}
+
+static inline void put_be32(uint8_t* dst, const uint32_t v)
+{
+    dst[0] = uint8_t(v >> 24);
+    dst[1] = uint8_t(v >> 16);
+    dst[2] = uint8_t(v >> 8);
+    dst[3] = uint8_t(v);
+}
+
+/**
+ * Writes a chunk whose data is `parts` laid end to end.
+ */
+static void write_png_chunk(std::ostream& out, const char* type, std::initializer_list<std::pair<const uint8_t*, size_t>> parts)
+{
+    size_t size = 0;
+    for (const auto& part : parts)
+        size += part.second;
+
+    uint8_t header[8];
+    put_be32(header, uint32_t(size));
+    std::memcpy(header + 4, type, 4);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    uLong crc = crc32(crc32(0, nullptr, 0), header + 4, 4);
+    for (const auto& part : parts)
+    {
+        out.write(reinterpret_cast<const char*>(part.first), std::streamsize(part.second));
+        crc = crc32(crc, part.first, uInt(part.second));
+    }
+
+    uint8_t footer[4];
+    put_be32(footer, uint32_t(crc));
+    out.write(reinterpret_cast<const char*>(footer), sizeof(footer));
+}
+
+void write_png(const Image& image, std::ostream& out, const ResolveSettings& settings, ThreadPool* pool)
+{
+    constexpr uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    constexpr uint8_t ZLIB_HEADER[2] = { 0x78, 0x9C };
+
+    const size_t stride = 4 * image.width() + 1;
+    const size_t rows_per_block = std::max<size_t>(1, PNG_BLOCK_BYTES / stride);
+    const size_t block_count = (image.height() + rows_per_block - 1) / rows_per_block;
+
+    std::vector<PngBlock> blocks(block_count);
+    const auto compress = [&](const size_t b)
+    {
+        TRACE_SCOPE_ARG("png block", "block", b);
+        const size_t first_row = b * rows_per_block;
+        const size_t rows = std::min(rows_per_block, image.height() - first_row);
+        compress_png_block(image, settings, first_row, rows, b + 1 == block_count, blocks[b]);
+    };
+
+    if (pool != nullptr)
+        pool->parallel_for(block_count, compress);
+    else
+    {
+        for (size_t b = 0; b < block_count; b++)
+            compress(b);
+    }
+
+    // The blocks' checksums combine into the stream's without seeing the data again
+    uLong adler = adler32(0, nullptr, 0);
+    for (const auto& block : blocks)
+        adler = adler32_combine(adler, block.adler, z_off_t(block.raw_size));
+
+    uint8_t ihdr[13] = {};
+    put_be32(ihdr, uint32_t(image.width()));
+    put_be32(ihdr + 4, uint32_t(image.height()));
+    ihdr[8] = 8; // Bit depth
+    ihdr[9] = 6; // RGBA
+
+    uint8_t trailer[4];
+    put_be32(trailer, uint32_t(adler));
+
+    out.write(reinterpret_cast<const char*>(SIGNATURE), sizeof(SIGNATURE));
+    write_png_chunk(out, "IHDR", { { ihdr, sizeof(ihdr) } });
+
+    // One IDAT per block, the zlib header going in the first and the checksum in the last
+    for (size_t b = 0; b < block_count; b++)
+    {
+        const auto& data = blocks[b].data;
+        write_png_chunk(out, "IDAT", {
+            { ZLIB_HEADER, b == 0 ? sizeof(ZLIB_HEADER) : 0 },
+            { data.data(), data.size() },
+            { trailer, b + 1 == block_count ? sizeof(trailer) : 0 }
+        });
+    }
+    write_png_chunk(out, "IEND", {});
+}
+
+#else
+
+void write_png(const Image& image, std::ostream& out, const ResolveSettings& settings, ThreadPool*)
+{
+    std::vector<uint8_t> bytes(4 * image.width() * image.height());
+    image.to_rgba8(bytes.data(), settings);
+
+    const auto write = [](void* context, void* data, const int size)
+    {
+        static_cast<std::ostream*>(context)->write(static_cast<const char*>(data), size);
+    };
+    if (!stbi_write_png_to_func(write, &out, int(image.width()), int(image.height()), 4, bytes.data(), int(image.width() * 4)))
+        throw std::runtime_error("PNG encoding failed");
+}
+
+#endif
+
+void write_pfm(const Image& image, std::ostream& out, const float scale)
+{
+    // A negative scale marks the floats as little endian
+    out << "PF\n" << image.width() << " " << image.height() << "\n" << (little_endian() ? "-1.0" : "1.0") << "\n";
+
+    // PFM rows go bottom up, the same way the image's do
+    std::vector<float> row(3 * image.width());
+    for (size_t y = 0; y < image.height(); y++)
+    {
+        image.linear_row(y, scale, row.data());
+        out.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size() * sizeof(float)));
+    }
+}
+
+static inline void to_rgbe(const float* rgb, uint8_t* out)
+{
+    const float m = std::fmax(rgb[0], std::fmax(rgb[1], rgb[2]));
+    if (!(m > 1e-32f))
+    {
+        out[0] = out[1] = out[2] = out[3] = 0;
+        return;
+    }
+
+    // The largest channel's mantissa fills the byte and the others share its exponent
+    int e;
+    const float f = std::frexp(m, &e) * 256.0f / m;
+    out[0] = uint8_t(rgb[0] * f);
+    out[1] = uint8_t(rgb[1] * f);
+    out[2] = uint8_t(rgb[2] * f);
+    out[3] = uint8_t(e + 128);
+}
+
+/**
+ * Run length encodes one component of a scanline. Runs of four or more equal bytes are stored as
+ * a count above 128 and the byte, everything else as literal spans of up to 128 bytes.
+ */
+static void encode_rgbe_component(const uint8_t* src, const size_t count, std::vector<uint8_t>& dst)
+{
+    constexpr size_t MIN_RUN = 4;
+    constexpr size_t MAX_RUN = 127;
+    constexpr size_t MAX_LITERAL = 128;
+
+    const auto run_at = [&](const size_t i)
+    {
+        size_t n = 1;
+        while (i + n < count && n < MAX_RUN && src[i + n] == src[i])
+            n++;
+        return n;
+    };
+
+    size_t i = 0;
+    while (i < count)
+    {
+        const size_t run = run_at(i);
+        if (run >= MIN_RUN)
+        {
+            dst.push_back(uint8_t(128 + run));
+            dst.push_back(src[i]);
+            i += run;
+            continue;
+        }
+
+        // Extend the literal span until a run worth encoding starts
+        size_t end = i + run;
+        while (end < count && end - i < MAX_LITERAL && run_at(end) < MIN_RUN)
+            end++;
+        end = std::min(end, i + MAX_LITERAL);
+
+        dst.push_back(uint8_t(end - i));
+        dst.insert(dst.end(), src + i, src + end);
+        i = end;
+    }
+}
+
+void write_rgbe(const Image& image, std::ostream& out, const float scale)
+{
+    const size_t width = image.width();
+    out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << image.height() << " +X " << width << "\n";
+
+    // Readers only accept encoded scanlines within these widths
+    const bool encode = width >= 8 && width <= 0x7FFF;
+
+    std::vector<float> row(3 * width);
+    std::vector<uint8_t> pixels(4 * width);
+    std::vector<uint8_t> component(width);
+    std::vector<uint8_t> encoded;
+
+    for (size_t row_index = 0; row_index < image.height(); row_index++)
+    {
+        image.linear_row(image.height() - 1 - row_index, scale, row.data());
+        for (size_t x = 0; x < width; x++)
+            to_rgbe(&row[x * 3], &pixels[x * 4]);
+
+        if (!encode)
+        {
+            out.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(pixels.size()));
+            continue;
+        }
+
+        encoded.assign({ 2, 2, uint8_t(width >> 8), uint8_t(width & 0xFF) });
+        for (size_t c = 0; c < 4; c++)
+        {
+            for (size_t x = 0; x < width; x++)
+                component[x] = pixels[x * 4 + c];
+            encode_rgbe_component(component.data(), width, encoded);
+        }
+        out.write(reinterpret_cast<const char*>(encoded.data()), std::streamsize(encoded.size()));
+    }
+}
+
+static inline uint16_t float_to_half(const float f)
+{
+    const uint32_t bits = bits_from_float(f);
+    const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    const uint32_t abs = bits & 0x7FFFFFFF;
+
+    // NaNs stay quiet NaNs with the top of their payload, and anything from 65520 up rounds to
+    // infinity
+    if (abs > 0x7F800000)
+        return sign | 0x7E00 | uint16_t((abs >> 13) & 0x3FF);
+    if (abs >= 0x477FF000)
+        return sign | 0x7C00;
+
+    // Below 2^-14 halves are denormal, in steps of 2^-24
+    if (abs < 0x38800000)
+        return sign | uint16_t(std::nearbyint(float_from_bits(abs) * 16777216.0f));
+
+    // Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits to even
+    uint32_t half = (abs - 0x38000000) >> 13;
+    const uint32_t dropped = abs & 0x1FFF;
+    if (dropped > 0x1000 || (dropped == 0x1000 && (half & 1)))
+        half++;
+    return sign | uint16_t(half);
+}
+
+void floats_to_halves(const float* src, uint16_t* dst, const size_t count)
+{
+    size_t i = 0;
+#if ENABLE_SIMD
+    for (; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+
+    for (; i < count; i++)
+        dst[i] = float_to_half(src[i]);
+}
+
+/**
+ * Little endian header fields and attributes. EXR attributes are a name, a type name, the value's
+ * size and the value.
+ */
+class ExrHeader
+{
+public:
+
+    inline void put_u8(const uint8_t v) { m_bytes.push_back(v); }
+
+    inline void put_u32(const uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+            m_bytes.push_back(uint8_t(v >> (8 * i)));
+    }
+
+    inline void put_float(const float v) { put_u32(bits_from_float(v)); }
+
+    inline void put_string(const char* s) { m_bytes.insert(m_bytes.end(), s, s + std::strlen(s) + 1); }
+
+    inline void attribute(const char* name, const char* type, const uint32_t size)
+    {
+        put_string(name);
+        put_string(type);
+        put_u32(size);
+    }
+
+    inline const std::vector<uint8_t>& bytes() const noexcept { return m_bytes; }
+
+private:
+
+    std::vector<uint8_t> m_bytes;
+};
+
+/**
+ * An EXR channel and the rows its values come from: the beauty pass when `aov` is empty,
+ * otherwise the AOV's, one `component` of each pixel.
+ */
+struct ExrChannel
+{
+    std::string name;
+    bool half;
+    int aov;
+    size_t component;
+};
+
+void write_exr(const Image& image, std::ostream& out, const float scale)
+{
+    constexpr uint32_t EXR_MAGIC = 20000630;
+    constexpr uint32_t EXR_VERSION = 2;
+    constexpr uint32_t PIXEL_TYPE_HALF = 1;
+    constexpr uint32_t PIXEL_TYPE_FLOAT = 2;
+    constexpr int BEAUTY = -1;
+
+    // Half floats are written in native order
+    if (!little_endian())
+        throw std::runtime_error("EXR output needs a little endian host");
+
+    const size_t width = image.width();
+    const size_t height = image.height();
+    const uint32_t max_x = uint32_t(width - 1);
+    const uint32_t max_y = uint32_t(height - 1);
+
+    // Colors and directions fit in halves. Depth, ids and counts keep full floats. AOVs go in
+    // layers named the way compositors expect
+    std::vector<ExrChannel> channels = { { "R", true, BEAUTY, 0 }, { "G", true, BEAUTY, 1 }, { "B", true, BEAUTY, 2 } };
+    if (image.has_aov(Aov::Depth))
+        channels.push_back({ "Z", false, int(Aov::Depth), 0 });
+    if (image.has_aov(Aov::Normal))
+    {
+        for (size_t c = 0; c < 3; c++)
+            channels.push_back({ std::string("normal.") + "XYZ"[c], true, int(Aov::Normal), c });
+    }
+    if (image.has_aov(Aov::Albedo))
+    {
+        for (size_t c = 0; c < 3; c++)
+            channels.push_back({ std::string("albedo.") + "RGB"[c], true, int(Aov::Albedo), c });
+    }
+    if (image.has_aov(Aov::MaterialId))
+        channels.push_back({ "materialId", false, int(Aov::MaterialId), 0 });
+    if (image.has_aov(Aov::Variance))
+        channels.push_back({ "variance", false, int(Aov::Variance), 0 });
+    if (image.has_aov(Aov::SampleCount))
+        channels.push_back({ "sampleCount", false, int(Aov::SampleCount), 0 });
+
+    // Channels are stored in alphabetical order
+    std::sort(channels.begin(), channels.end(), [](const ExrChannel& a, const ExrChannel& b) { return a.name < b.name; });
+
+    ExrHeader header;
+    header.put_u32(EXR_MAGIC);
+    header.put_u32(EXR_VERSION);
+
+    uint32_t chlist_size = 1;
+    for (const auto& channel : channels)
+        chlist_size += uint32_t(channel.name.size() + 1 + 16);
+
+    header.attribute("channels", "chlist", chlist_size);
+    for (const auto& channel : channels)
+    {
+        header.put_string(channel.name.c_str());
+        header.put_u32(channel.half ? PIXEL_TYPE_HALF : PIXEL_TYPE_FLOAT);
+        header.put_u32(0); // Linear flag and reserved bytes
+        header.put_u32(1); // x sampling
+        header.put_u32(1); // y sampling
+    }
+    header.put_u8(0);
+
+    header.attribute("compression", "compression", 1);
+    header.put_u8(0);
+
+    for (const char* window : { "dataWindow", "displayWindow" })
+    {
+        header.attribute(window, "box2i", 16);
+        header.put_u32(0);
+        header.put_u32(0);
+        header.put_u32(max_x);
+        header.put_u32(max_y);
+    }
+
+    header.attribute("lineOrder", "lineOrder", 1);
+    header.put_u8(0);
+    header.attribute("pixelAspectRatio", "float", 4);
+    header.put_float(1.0f);
+    header.attribute("screenWindowCenter", "v2f", 8);
+    header.put_float(0.0f);
+    header.put_float(0.0f);
+    header.attribute("screenWindowWidth", "float", 4);
+    header.put_float(1.0f);
+    header.put_u8(0);
+
+    // Uncompressed scanlines are all the same size, so the offset table is known up front
+    uint64_t line_size = 0;
+    for (const auto& channel : channels)
+        line_size += width * (channel.half ? sizeof(uint16_t) : sizeof(float));
+
+    const uint64_t first_line = header.bytes().size() + height * sizeof(uint64_t);
+    std::vector<uint64_t> offsets(height);
+    for (size_t y = 0; y < height; y++)
+        offsets[y] = first_line + y * (2 * sizeof(uint32_t) + line_size);
+
+    out.write(reinterpret_cast<const char*>(header.bytes().data()), std::streamsize(header.bytes().size()));
+    out.write(reinterpret_cast<const char*>(offsets.data()), std::streamsize(offsets.size() * sizeof(uint64_t)));
+
+    std::vector<float> beauty(3 * width);
+    std::vector<float> aov_rows[AOV_COUNT];
+    for (size_t i = 0; i < AOV_COUNT; i++)
+    {
+        if (image.has_aov(Aov(i)))
+            aov_rows[i].resize(aov_channels(Aov(i)) * width);
+    }
+
+    std::vector<float> plane(width);
+    std::vector<uint16_t> halves(width);
+    std::vector<char> data(line_size);
+
+    // EXR's y runs down the image
+    for (size_t line = 0; line < height; line++)
+    {
+        const size_t y = height - 1 - line;
+        image.linear_row(y, scale, beauty.data());
+        for (size_t i = 0; i < AOV_COUNT; i++)
+        {
+            if (!aov_rows[i].empty())
+                image.aov_row(Aov(i), y, aov_rows[i].data());
+        }
+
+        char* dst = data.data();
+        for (const auto& channel : channels)
+        {
+            const bool from_beauty = channel.aov == BEAUTY;
+            const float* src = from_beauty ? beauty.data() : aov_rows[channel.aov].data();
+            const size_t stride = from_beauty ? 3 : aov_channels(Aov(channel.aov));
+            for (size_t x = 0; x < width; x++)
+                plane[x] = src[x * stride + channel.component];
+
+            if (channel.half)
+            {
+                floats_to_halves(plane.data(), halves.data(), width);
+                std::memcpy(dst, halves.data(), width * sizeof(uint16_t));
+                dst += width * sizeof(uint16_t);
+            }
+            else
+            {
+                std::memcpy(dst, plane.data(), width * sizeof(float));
+                dst += width * sizeof(float);
+            }
+        }
+
+        const uint32_t chunk[2] = { uint32_t(line), uint32_t(line_size) };
+        out.write(reinterpret_cast<const char*>(chunk), sizeof(chunk));
+        out.write(data.data(), std::streamsize(line_size));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ostream>
+#include "image.hpp"
+
+// Encoders behind `Image::encode`. They write to `out` without checking its state, which is left
+// to whoever owns the stream, and throw `std::runtime_error` when encoding itself fails.
+
+/**
+ * PNG resolved with `settings`. With zlib, blocks of rows are resolved, filtered and deflated
+ * independently, on `pool` when one is given, and joined into a single stream the way pigz does.
+ * Otherwise stb's encoder converts the whole image first.
+ */
+void write_png(const Image& image, std::ostream& out, const ResolveSettings& settings, ThreadPool* pool);
+
+/**
+ * Writers for the high dynamic range formats. Each takes the image's linear radiance, averaged
+ * over its samples and scaled by `scale`, and streams it to `out` one row at a time.
+ */
+
+/**
+ * Portable float map: 32 bit float RGB, little endian, bottom row first.
+ */
+void write_pfm(const Image& image, std::ostream& out, const float scale);
+
+/**
+ * Radiance RGBE: a shared 8 bit exponent per pixel, with the usual run length encoded scanlines.
+ */
+void write_rgbe(const Image& image, std::ostream& out, const float scale);
+
+/**
+ * Single part scanline OpenEXR with uncompressed half float R, G and B channels. The image's AOVs
+ * become extra channels: "Z", "normal.XYZ" and "albedo.RGB" layers, "materialId",
+ * "variance" and "sampleCount". Depth, ids, variance and counts are full floats.
+ */
+void write_exr(const Image& image, std::ostream& out, const float scale);
+
+/**
+ * Converts `count` floats to IEEE half floats, rounding to nearest even. Values too large for a
+ * half become infinity.
+ */
+void floats_to_halves(const float* src, uint16_t* dst, const size_t count);
@@ -0,0 +1,293 @@
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "json.hpp"
+
+// Nesting deeper than this is rejected instead of overflowing the stack
+constexpr size_t MAX_JSON_DEPTH = 256;
+
+/**
+ * Recursive descent parser over an in-memory document.
+ */
+class JsonParser
+{
+public:
+
+    inline JsonParser(const char* begin, const char* end) : m_pos(begin), m_end(end), m_line(1) {}
+
+    JsonValue parse_document()
+    {
+        auto value = parse_value(0);
+        skip_space();
+        if (m_pos != m_end)
+            fail("unexpected trailing characters");
+        return value;
+    }
+
+private:
+
+    [[noreturn]] void fail(const char* what) const
+    {
+        throw std::runtime_error("JSON error on line " + std::to_string(m_line) + ": " + what);
+    }
+
+    void skip_space()
+    {
+        while (m_pos < m_end)
+        {
+            const char c = *m_pos;
+            if (c == '\n') m_line++;
+            else if (c != ' ' && c != '\t' && c != '\r') return;
+            m_pos++;
+        }
+    }
+
+    void expect(const char c)
+    {
+        skip_space();
+        if (m_pos >= m_end || *m_pos != c)
+            fail((std::string("expected '") + c + "'").c_str());
+        m_pos++;
+    }
+
+    bool consume_separator()
+    {
+        skip_space();
+        if (m_pos >= m_end || *m_pos != ',')
+            return false;
+        m_pos++;
+        return true;
+    }
+
+    bool consume_literal(const char* literal)
+    {
+        const size_t len = std::strlen(literal);
+        if (size_t(m_end - m_pos) < len || std::memcmp(m_pos, literal, len) != 0)
+            return false;
+        m_pos += len;
+        return true;
+    }
+
+    JsonValue parse_value(const size_t depth)
+    {
+        if (depth > MAX_JSON_DEPTH)
+            fail("document is nested too deeply");
+
+        skip_space();
+        if (m_pos >= m_end)
+            fail("unexpected end of document");
+
+        JsonValue value;
+        value.m_line = m_line;
+
+        switch (*m_pos)
+        {
+        case '{':
+        {
+            m_pos++;
+            value.m_type = JsonValue::Type::Object;
+            skip_space();
+            if (m_pos < m_end && *m_pos == '}')
+            {
+                m_pos++;
+                break;
+            }
+
+            while (true)
+            {
+                skip_space();
+                if (m_pos >= m_end || *m_pos != '"')
+                    fail("expected a member name");
+                auto key = parse_string();
+                if (value.find(key.c_str()) != nullptr)
+                    fail(("duplicate member '" + key + "'").c_str());
+                expect(':');
+                value.m_object.emplace_back(std::move(key), parse_value(depth + 1));
+                if (!consume_separator())
+                    break;
+            }
+
+            expect('}');
+            break;
+        }
+        case '[':
+        {
+            m_pos++;
+            value.m_type = JsonValue::Type::Array;
+            skip_space();
+            if (m_pos < m_end && *m_pos == ']')
+            {
+                m_pos++;
+                break;
+            }
+
+            do
+            {
+                value.m_array.push_back(parse_value(depth + 1));
+            } while (consume_separator());
+
+            expect(']');
+            break;
+        }
+        case '"':
+            value.m_type = JsonValue::Type::String;
+            value.m_string = parse_string();
+            break;
+        case 't':
+        case 'f':
+            value.m_type = JsonValue::Type::Bool;
+            value.m_bool = *m_pos == 't';
+            if (!consume_literal(value.m_bool ? "true" : "false"))
+                fail("unknown literal");
+            break;
+        case 'n':
+            if (!consume_literal("null"))
+                fail("unknown literal");
+            break;
+        default:
+            value.m_type = JsonValue::Type::Number;
+            value.m_number = parse_number();
+            break;
+        }
+
+        return value;
+    }
+
+    double parse_number()
+    {
+        // from_chars accepts a few forms JSON doesn't (like "inf"), which is harmless here
+        double number = 0.0;
+        const auto res = std::from_chars(m_pos, m_end, number);
+        if (res.ec != std::errc() || res.ptr == m_pos)
+            fail("expected a value");
+        m_pos = res.ptr;
+        return number;
+    }
+
+    static void append_utf8(std::string& out, const uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            out += char(cp);
+        }
+        else if (cp < 0x800)
+        {
+            out += char(0xC0 | (cp >> 6));
+            out += char(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            out += char(0xE0 | (cp >> 12));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += char(0xF0 | (cp >> 18));
+            out += char(0x80 | ((cp >> 12) & 0x3F));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    uint32_t parse_hex4()
+    {
+        if (m_end - m_pos < 4)
+            fail("truncated \\u escape");
+
+        uint32_t cp = 0;
+        const auto res = std::from_chars(m_pos, m_pos + 4, cp, 16);
+        if (res.ptr != m_pos + 4)
+            fail("malformed \\u escape");
+        m_pos += 4;
+        return cp;
+    }
+
+    std::string parse_string()
+    {
+        m_pos++;
+        std::string out = {};
+
+        while (true)
+        {
+            if (m_pos >= m_end)
+                fail("unterminated string");
+
+            const char c = *m_pos++;
+            if (c == '"')
+                return out;
+            if (c == '\n')
+                fail("newline in string");
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+
+            if (m_pos >= m_end)
+                fail("unterminated string");
+
+            switch (*m_pos++)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                uint32_t cp = parse_hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && m_end - m_pos >= 2 && m_pos[0] == '\\' && m_pos[1] == 'u')
+                {
+                    m_pos += 2;
+                    const uint32_t low = parse_hex4();
+                    if (low < 0xDC00 || low >= 0xE000)
+                        fail("unpaired surrogate in \\u escape");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default:
+                fail("unknown escape in string");
+            }
+        }
+    }
+
+    const char* m_pos;
+    const char* m_end;
+    size_t m_line;
+};
+
+JsonValue JsonValue::parse(const char* begin, const char* end)
+{
+    return JsonParser(begin, end).parse_document();
+}
+
+const JsonValue* JsonValue::find(const char* key) const noexcept
+{
+    for (const auto& member : m_object)
+    {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+const char* JsonValue::type_name(const Type type) noexcept
+{
+    switch (type)
+    {
+    case Type::Null: return "null";
+    case Type::Bool: return "a boolean";
+    case Type::Number: return "a number";
+    case Type::String: return "a string";
+    case Type::Array: return "an array";
+    case Type::Object: return "an object";
+    }
+    return "unknown";
+}
\ No newline at end of file
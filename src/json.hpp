@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A parsed JSON document. Object members keep the order they appear in, so errors can be
+ * reported in file order.
+ */
+class JsonValue
+{
+public:
+
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    using Member = std::pair<std::string, JsonValue>;
+
+    inline JsonValue() : m_type(Type::Null), m_bool(false), m_number(0.0), m_line(0) {}
+
+    /**
+     * Parses a complete document. Throws `std::runtime_error` naming the line of the first
+     * syntax error.
+     */
+    static JsonValue parse(const char* begin, const char* end);
+
+    inline Type type() const noexcept { return m_type; }
+    inline bool is_null() const noexcept { return m_type == Type::Null; }
+    inline bool is_bool() const noexcept { return m_type == Type::Bool; }
+    inline bool is_number() const noexcept { return m_type == Type::Number; }
+    inline bool is_string() const noexcept { return m_type == Type::String; }
+    inline bool is_array() const noexcept { return m_type == Type::Array; }
+    inline bool is_object() const noexcept { return m_type == Type::Object; }
+
+    /**
+     * Line the value starts on, for error messages.
+     */
+    inline size_t line() const noexcept { return m_line; }
+
+    // Only meaningful for values of the matching type
+    inline bool as_bool() const noexcept { return m_bool; }
+    inline double as_number() const noexcept { return m_number; }
+    inline const std::string& as_string() const noexcept { return m_string; }
+    inline const std::vector<JsonValue>& as_array() const noexcept { return m_array; }
+    inline const std::vector<Member>& as_object() const noexcept { return m_object; }
+
+    /**
+     * Member named `key` of an object, or null if there is none.
+     */
+    const JsonValue* find(const char* key) const noexcept;
+
+    static const char* type_name(const Type type) noexcept;
+
+private:
+
+    friend class JsonParser;
+
+    Type m_type;
+    bool m_bool;
+    double m_number;
+    size_t m_line;
+    std::string m_string;
+    std::vector<JsonValue> m_array;
+    std::vector<Member> m_object;
+};
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include <vector>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
 
 #include "args.hpp"
 #include "common.hpp"
@@ -12,17 +18,107 @@
 #include "sphere.hpp"
 #include "material.hpp"
 #include "renderer.hpp"
+#include "mesh_loader.hpp"
+#include "scene_file.hpp"
+#include "output_queue.hpp"
+#include "scene_description.hpp"
+#include "trace.hpp"
+#include "default_world.hpp"
 
-static World construct_default_world();
+/**
+ * Settings for rendering more than one frame.
+ */
+struct SequenceArgs
+{
+    size_t frames;
+
+    // The camera path ends where it starts, so the last frame stops a step short of its end
+    bool loop;
+
+    // Bounce the small spheres, refitting the BVH every frame
+    bool animate;
+    float rebuild_threshold;
+
+    // Frames are numbered before the output's extension
+    std::string output;
+
+    // Where to write the whole sequence's ray statistics, if anywhere
+    std::string stats_json;
+};
+
+static void render_sequence(World& world, const CameraPath& path, const RenderArgs& args, const SequenceArgs& sequence);
+
+#if ENABLE_STATS
+/**
+ * Writes `stats` for `seconds` of rendering to `path` as JSON. Throws `std::runtime_error` if the
+ * file can't be written.
+ */
+static void write_stats_json(const std::string& path, const RayStats& stats, const double seconds)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("unable to open '" + path + "' for writing");
+
+    stats.write_json(out, seconds);
+    if (!out.flush())
+        throw std::runtime_error("unable to write '" + path + "'");
+}
+#endif
+
+/**
+ * Writes the trace recorded since `trace_start` to `path`. Returns false after reporting why it
+ * couldn't.
+ */
+static bool save_trace(const std::string& path)
+{
+    try
+    {
+        trace_save(path.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to save trace: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
 
 int main(int argc, const char** argv)
 {
     args::ArgumentParser p("parser");
     args::HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
     args::ValueFlag<int> samples(p, "samples", "Number of samples taken per pixel. Must be non-zero.", { "samples" }, 64);
-    args::ValueFlag<int> threads(p, "threads", "Number of threads to use when rendering the image. Must be a power of 2.", { "threads" }, 4);
+    args::ValueFlag<int> threads(p, "threads", "Number of threads to use when rendering the image. Must be non-zero.", { "threads" }, 4);
     args::ValueFlag<int> width(p, "width", "Width in pixels of the image. Must be non-zero.", { "width" }, 560);
     args::ValueFlag<int> height(p, "height", "Height in pixels of the image. Must be non-zero.", { "height" }, 315);
+    args::ValueFlag<std::string> scene_path(p, "path", "JSON scene description to render. Flags given on the command line override its render settings.", { "scene" });
+    args::ValueFlag<std::string> mesh(p, "mesh", "OBJ or binary PLY mesh to add to the scene.", { "mesh" });
+    args::MapFlag<std::string, MeshLayout> mesh_layout(p, "layout", "How --mesh is intersected: triangles, one at a time with the watertight test, or packets of eight with SIMD, which can miss along shared edges.", { "mesh-layout" },
+        std::unordered_map<std::string, MeshLayout> { { "triangles", MeshLayout::Triangles }, { "packets", MeshLayout::Packets } }, MeshLayout::Triangles);
+    args::ValueFlag<std::string> load_scene_path(p, "path", "Render a binary scene file written by --save-scene instead of the default world.", { "load-scene" });
+    args::ValueFlag<std::string> save_scene_path(p, "path", "Write the scene and its BVH to a binary scene file and exit without rendering.", { "save-scene" });
+    args::ValueFlag<std::string> output(p, "path", "Image to write. The extension picks PNG, or PFM, Radiance HDR or OpenEXR for linear output.", { "output" }, "./output.png");
+    args::ValueFlag<int> frames(p, "frames", "Render a sequence of this many frames, numbered before the output's extension, following the scene's camera path.", { "frames" });
+    args::Flag turntable(p, "turntable", "Orbit the camera once around its target over the sequence when the scene has no camera path.", { "turntable" });
+    args::Flag animate(p, "animate", "Bounce the scene's small spheres during the sequence, refitting the BVH between frames instead of rebuilding it.", { "animate" });
+    args::ValueFlag<float> aperture(p, "diameter", "Lens diameter for depth of field. 0 renders with a pinhole.", { "aperture" });
+    args::ValueFlag<float> focus_distance(p, "distance", "Distance from the camera to the plane in focus. Defaults to the distance to the camera's target.", { "focus-distance" });
+    args::Flag motion_blur(p, "motion-blur", "Move the default world's small diffuse spheres while the shutter is open for the whole frame.", { "motion-blur" });
+    args::ValueFlag<float> exposure(p, "stops", "Exposure adjustment applied before tone mapping when the image is saved.", { "exposure" });
+    args::MapFlag<std::string, Tonemap> tonemap(p, "curve", "Tone curve used when the image is saved: none, reinhard or aces.", { "tonemap" },
+        std::unordered_map<std::string, Tonemap> { { "none", Tonemap::None }, { "reinhard", Tonemap::Reinhard }, { "aces", Tonemap::Aces } });
+    args::MapFlagList<std::string, Aov> aov(p, "name", "Capture an AOV into extra layers of the EXR output: depth, normal, albedo, material_id, variance or sample_count. May be repeated.", { "aov" },
+        std::unordered_map<std::string, Aov> { { "depth", Aov::Depth }, { "normal", Aov::Normal }, { "albedo", Aov::Albedo },
+            { "material_id", Aov::MaterialId }, { "variance", Aov::Variance }, { "sample_count", Aov::SampleCount } });
+    args::Flag denoise(p, "denoise", "Filter the noise out of the render using its depth, normal, albedo and variance.", { "denoise" });
+    args::MapFlag<std::string, BvhBuilder> bvh(p, "builder", "How the BVH splits nodes: sah or median. Scenes from --load-scene keep their saved BVH.", { "bvh" },
+        std::unordered_map<std::string, BvhBuilder> { { "sah", BvhBuilder::Sah }, { "median", BvhBuilder::Median } }, BvhBuilder::Sah);
+    args::MapFlag<std::string, Heatmap> heatmap(p, "metric", "Render BVH nodes visited, primitive tests or both (nodes, primitives or cost) per camera ray as a false colored heatmap instead of radiance.", { "heatmap" },
+        std::unordered_map<std::string, Heatmap> { { "nodes", Heatmap::Nodes }, { "primitives", Heatmap::Primitives }, { "cost", Heatmap::Cost } });
+    args::ValueFlag<float> heatmap_scale(p, "value", "Heatmap value shown at the top of the color ramp. Defaults to the image's highest value.", { "heatmap-scale" });
+    args::ValueFlag<std::string> trace(p, "path", "Record the render's phases and every worker's tiles and idle time as a Chrome trace, for chrome://tracing or Perfetto.", { "trace" });
+    args::ValueFlag<std::string> stats_json(p, "path", "Write ray and traversal statistics for the render, or the whole sequence, to a JSON file.", { "stats-json" });
+    args::ValueFlag<float> rebuild_threshold(p, "ratio", "How far a BVH subtree's SAH cost may grow during --animate before it is rebuilt.", { "rebuild-threshold" }, FlatBvh::DEFAULT_REBUILD_THRESHOLD);
     args::CompletionFlag completion(p, {"complete"});
 
     try
@@ -60,111 +156,435 @@ int main(int argc, const char** argv)
         return 1;
     }
 
-    if (threads.Get() <= 0 || (threads.Get() & (threads.Get() - 1)) != 0)
+    if (threads.Get() <= 0)
+    {
+        std::cerr << "Thread count must be a positive integer.";
+        return 1;
+    }
+
+    if (frames && frames.Get() <= 0)
+    {
+        std::cerr << "Frame count must be a positive integer.";
+        return 1;
+    }
+
+    if ((animate || turntable) && !frames)
+    {
+        std::cerr << "--animate and --turntable need a frame count from --frames.";
+        return 1;
+    }
+
+    if (!(rebuild_threshold.Get() >= 1.0f))
+    {
+        std::cerr << "Rebuild threshold must be at least 1.";
+        return 1;
+    }
+
+    if (exposure && !std::isfinite(exposure.Get()))
+    {
+        std::cerr << "Exposure must be a finite number of stops.";
+        return 1;
+    }
+
+    if (heatmap_scale && !(heatmap_scale.Get() > 0.0f && std::isfinite(heatmap_scale.Get())))
+    {
+        std::cerr << "Heatmap scale must be a positive number.";
+        return 1;
+    }
+
+#if !ENABLE_STATS
+    if (stats_json)
+    {
+        std::cerr << "--stats-json needs a build with ENABLE_STATS.";
+        return 1;
+    }
+#endif
+
+    if (trace)
+    {
+#if !ENABLE_TRACE
+        std::cerr << "--trace needs a build with ENABLE_TRACE.";
+        return 1;
+#endif
+        trace_start();
+        trace_thread_name("main");
+    }
+
+    try
+    {
+        image_format(output.Get().c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Output " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (scene_path && load_scene_path)
     {
-        std::cerr << "Thread count must be a non-zero power of 2.";
+        std::cerr << "Only one of --scene and --load-scene can be given.";
         return 1;
     }
 
-    RenderArgs args;
-    args.width = width.Get();
-    args.height = height.Get();
-    args.thread_count = threads.Get();
-    args.samples = samples.Get();
+    if ((aperture && !(aperture.Get() >= 0.0f)) || (focus_distance && !(focus_distance.Get() > 0.0f)))
+    {
+        std::cerr << "Aperture can't be negative and focus distance must be positive.";
+        return 1;
+    }
+
+    if (motion_blur && (scene_path || load_scene_path))
+    {
+        std::cerr << "--motion-blur only applies to the default world. Scene descriptions set 'center_end' and 'shutter' instead.";
+        return 1;
+    }
+
+    SceneDescription scene;
+    if (scene_path)
+    {
+        std::cout << "Loading scene description '" << scene_path.Get() << "'..." << std::endl;
+
+        try
+        {
+            TRACE_SCOPE("load scene description");
+            ThreadPool pool(threads.Get());
+            scene = load_scene_description(scene_path.Get().c_str(), pool, bvh.Get());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to load scene: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    else if (load_scene_path)
+    {
+        std::cout << "Loading scene '" << load_scene_path.Get() << "'..." << std::endl;
+        const auto load_start = std::chrono::steady_clock::now();
+
+        try
+        {
+            TRACE_SCOPE("load scene");
+            scene.world = load_scene(load_scene_path.Get().c_str());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to load scene: " << e.what() << std::endl;
+            return 1;
+        }
+
+        const std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - load_start;
+        std::cout << "Loaded " << scene.world.object_count() << " objects in " << load_time.count() * 1e3 << "ms" << std::endl;
+    }
+    else
+    {
+        std::cout << "Constructing a default world..." << std::endl;
+        TRACE_SCOPE("construct world");
+        scene.world = construct_default_world(motion_blur);
+        if (motion_blur)
+        {
+            scene.camera.shutter_open = 0.0f;
+            scene.camera.shutter_close = 1.0f;
+        }
+    }
+
+    // The lens flags apply to every keyframe of a camera path as well
+    const auto apply_lens = [&](CameraSettings& settings)
+    {
+        if (aperture) settings.aperture = aperture.Get();
+        if (focus_distance) settings.focus_distance = focus_distance.Get();
+    };
+    apply_lens(scene.camera);
+    if ((aperture || focus_distance) && !scene.camera_path.empty())
+    {
+        CameraPath path;
+        for (auto key : scene.camera_path.keyframes())
+        {
+            apply_lens(key.settings);
+            path.add_keyframe(key.time, key.settings);
+        }
+        scene.camera_path = std::move(path);
+    }
+
+    RenderArgs& args = scene.render;
+    if (width) args.width = width.Get();
+    if (height) args.height = height.Get();
+    if (threads) args.thread_count = threads.Get();
+    if (samples) args.samples = samples.Get();
+    if (exposure) args.resolve.exposure = exposure.Get();
+    if (tonemap) args.resolve.tonemap = tonemap.Get();
+    if (aov)
+    {
+        args.aovs = 0;
+        for (const Aov a : aov.Get())
+            args.aovs |= aov_bit(a);
+    }
+    if (denoise) args.denoise = true;
+    if (heatmap) args.heatmap = heatmap.Get();
+    if (heatmap_scale) args.heatmap_scale = heatmap_scale.Get();
+
+#if !ENABLE_STATS
+    if (args.heatmap != Heatmap::None)
+    {
+        std::cerr << "Heatmaps count traversal work with the ray statistics, which need a build with ENABLE_STATS." << std::endl;
+        return 1;
+    }
+#endif
+
+    if (args.aovs != 0 && image_format(output.Get().c_str()) != ImageFormat::Exr)
+    {
+        std::cerr << "AOVs are written as layers of an EXR image, so --output must be an .exr file." << std::endl;
+        return 1;
+    }
 
     std::cout << "Rendering scene width...\n"
         << "Image dimensions: (" << args.width << ", " << args.height << ")\n"
         << "Thread count: " << args.thread_count << "\n"
         << "Sample count: " << args.samples << std::endl;
 
-    auto camera = Camera(
-        point3(13, 2, 3),
-        point3(0, 0, 0),
-        vec3(0, 1, 0),
-        20.0f,
-        float(width.Get()) / float(height.Get())
-    );
-    
-    std::cout << "Constructing a default world..." << std::endl;
-    const auto world = construct_default_world();
-    
-    std::chrono::time_point<std::chrono::system_clock> start, end;
-    start = std::chrono::system_clock::now();
+    const auto camera = scene.camera.make_camera(float(args.width) / float(args.height));
+    auto& world = scene.world;
+
+    if (mesh)
+    {
+        std::cout << "Loading mesh '" << mesh.Get() << "'..." << std::endl;
+
+        try
+        {
+            TRACE_SCOPE("load mesh");
+            ThreadPool pool(args.thread_count);
+            MeshLoadStats load_stats;
+            auto loaded = load_mesh(mesh.Get().c_str(), pool, &load_stats);
+
+            std::cout << "Loaded " << load_stats.triangles << " triangles in "
+                << load_stats.seconds << "s (" << load_stats.megabytes_per_second() << " MB/s)" << std::endl;
+
+            const auto material_mesh = world.add_material(Lambertian(color(0.5f, 0.5f, 0.5f)));
+            world.add_mesh(std::move(loaded), material_mesh, mesh_layout.Get());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to load mesh: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // A loaded scene brings its BVH along unless objects were added to it
+    if (!load_scene_path || mesh)
+    {
+        const auto build_start = std::chrono::steady_clock::now();
+        world.compute_bvh(bvh.Get());
+        const std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - build_start;
+        std::cout << "Built BVH in " << build_time.count() * 1e3 << "ms" << std::endl;
+    }
+
+    if (save_scene_path)
+    {
+        std::cout << "Saving scene '" << save_scene_path.Get() << "'..." << std::endl;
+
+        try
+        {
+            TRACE_SCOPE("save scene");
+            save_scene(world, save_scene_path.Get().c_str());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to save scene: " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (trace && !save_trace(trace.Get()))
+            return 1;
+
+        std::cout << "Complete." << std::endl;
+        return 0;
+    }
+
+    if (frames)
+    {
+        auto path = std::move(scene.camera_path);
+        const bool orbit = turntable && path.empty();
+        if (orbit)
+            path = CameraPath::turntable(scene.camera, 1.0f);
+        else if (path.empty())
+            path.add_keyframe(0.0f, scene.camera);
 
+        const SequenceArgs sequence = { size_t(frames.Get()), orbit, bool(animate), rebuild_threshold.Get(), output.Get(),
+            stats_json ? stats_json.Get() : std::string() };
+        try
+        {
+            render_sequence(world, path, args, sequence);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to render sequence: " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (trace && !save_trace(trace.Get()))
+            return 1;
+        return 0;
+    }
+    
     Renderer renderer(args);
 
     std::cout << "Beginning render..." << std::endl;
+    const auto start = std::chrono::steady_clock::now();
     const auto image = renderer.render(camera, world);
+    const std::chrono::duration<double> elapsed_seconds = std::chrono::steady_clock::now() - start;
 
-    end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsed_seconds = end - start;
-    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
- 
     std::cout << "Render time: " << elapsed_seconds.count() << "s" << std::endl;
+    if (args.heatmap != Heatmap::None)
+        std::cout << "Heatmap scale: " << renderer.heatmap_scale() << std::endl;
+#if ENABLE_STATS
+    renderer.stats().report(std::cout, elapsed_seconds.count());
+    if (stats_json)
+    {
+        try
+        {
+            write_stats_json(stats_json.Get(), renderer.stats(), elapsed_seconds.count());
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Unable to write statistics: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+#endif
+
+    std::cout << "Saving image '" << output.Get() << "'..." << std::endl;
+    const auto save_start = std::chrono::steady_clock::now();
+    try
+    {
+        image.save(output.Get().c_str(), args.resolve, &renderer.pool());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to save image: " << e.what() << std::endl;
+        return 1;
+    }
+    const std::chrono::duration<double> save_time = std::chrono::steady_clock::now() - save_start;
+    std::cout << "Save time: " << save_time.count() << "s" << std::endl;
 
-    std::cout << "Saving image './output.png'..." << std::endl;
-    image.save("./output.png");
+    if (trace && !save_trace(trace.Get()))
+        return 1;
     std::cout << "Complete." << std::endl;
 
     return 0;
 }
 
-World construct_default_world()
-{    
-    seed_random_float(500);
-    auto world = World();
+void render_sequence(World& world, const CameraPath& path, const RenderArgs& args, const SequenceArgs& sequence)
+{
+    constexpr float FRAME_RATE = 24.0f;
+    constexpr float BOUNCE_MAX_RADIUS = 0.5f;
+    constexpr float BOUNCE_HEIGHT = 0.6f;
+    constexpr float BOUNCES_PER_SECOND = 1.5f;
+    constexpr float MAX_DRIFT = 0.4f;
+    constexpr size_t OUTPUT_QUEUE_FRAMES = 2;
 
-    const auto material_ground = world.add_material(Lambertian(color(0.8f, 0.8f, 0.8f)));
-    world.add_object(Sphere(point3(0, -1000, -1), 1000, material_ground));
+    // Small spheres hop in place while drifting apart, which slowly loosens the refit BVH
+    struct Bouncer
+    {
+        Sphere* sphere;
+        point3 base;
+        vec3 drift;
+        float phase;
+    };
 
-    for (int x = -11; x < 11; x++)
+    std::vector<Bouncer> bouncers = {};
+    for (const auto& object : world.objects())
     {
-        for (int y = -11; y < 11; y++)
-        {
-            const auto choose_mat = random_float();
-            const point3 center(x + 0.9f * random_float(), 0.2f, y + 0.9f * random_float());
+        auto* sphere = dynamic_cast<Sphere*>(object.get());
+        if (!sequence.animate || sphere == nullptr || std::abs(sphere->get_radius()) >= BOUNCE_MAX_RADIUS)
+            continue;
+
+        const vec3 drift(random_float(-MAX_DRIFT, MAX_DRIFT), 0.0f, random_float(-MAX_DRIFT, MAX_DRIFT));
+        bouncers.push_back(Bouncer { sphere, sphere->get_center(), drift, random_float() });
+    }
+
+    // The world, BVH and worker threads stay alive for the whole sequence. Refits run on the
+    // render workers, which are idle between frames
+    Renderer renderer(args);
+    const float aspect_ratio = float(args.width) / float(args.height);
+    const size_t extension = sequence.output.rfind('.');
+
+    std::cout << "Rendering " << sequence.frames << " frames";
+    if (sequence.animate)
+        std::cout << " with " << bouncers.size() << " bouncing spheres";
+    std::cout << "..." << std::endl;
+
+    double refit_seconds = 0.0;
+    double rebuild_seconds = 0.0;
+    size_t rebuilt_subtrees = 0;
+    size_t full_rebuilds = 0;
+
+    // Frames are encoded and written on another thread while the next ones render, so the workers
+    // are all busy and each frame is encoded on that one thread
+    OutputQueue output(OUTPUT_QUEUE_FRAMES);
+    const auto sequence_start = std::chrono::steady_clock::now();
+    RayStats ray_stats;
+    double render_seconds = 0.0;
 
-            if ((center - point3(4, 0.2f, 0)).length() > 0.9f)
+    for (size_t frame = 0; frame < sequence.frames; frame++)
+    {
+        const size_t steps = sequence.loop ? sequence.frames : sequence.frames - 1;
+        const float progress = steps > 0 ? float(frame) / float(steps) : 0.0f;
+        const auto camera = path.at(path.start_time() + progress * (path.end_time() - path.start_time())).make_camera(aspect_ratio);
+        std::cout << "Frame " << frame << ": ";
+
+        if (sequence.animate)
+        {
+            const float t = float(frame) / FRAME_RATE;
+            for (const auto& bouncer : bouncers)
             {
-                MaterialId sphere_material;
-
-                if (choose_mat < 0.9f)
-                {
-                    // Diffuse
-                    const auto albedo = color::random() * color::random();
-                    sphere_material = world.add_material(Lambertian(albedo));
-                }
-                else if (choose_mat < 0.95f)
-                {
-                    // Metal
-                    const auto albedo = color::random(0.5f, 1.0f);
-                    const auto fuzz = random_float(0.0f, 0.5f);
-                    sphere_material = world.add_material(Metal(albedo, fuzz));
-                }
-                else
-                {
-                    // Glass
-                    sphere_material = world.add_material(Dielectric(1.5f));
-                }
-
-                world.add_object(Sphere(center, 0.2f, sphere_material));
+                const float height = BOUNCE_HEIGHT * std::abs(std::sin(PI * (t * BOUNCES_PER_SECOND + bouncer.phase)));
+                bouncer.sphere->set_center(bouncer.base + t * bouncer.drift + vec3(0.0f, height, 0.0f));
             }
-            
+
+            const auto refit = world.refit(renderer.pool(), sequence.rebuild_threshold);
+            refit_seconds += refit.refit_seconds;
+            rebuild_seconds += refit.rebuild_seconds;
+            rebuilt_subtrees += refit.rebuilt_subtrees;
+            full_rebuilds += refit.full_rebuild ? 1 : 0;
+
+            std::cout << "refit " << refit.refit_seconds * 1e3 << "ms, ";
+            if (refit.full_rebuild)
+                std::cout << "full rebuild";
+            else
+                std::cout << "rebuilt " << refit.rebuilt_subtrees << "/" << refit.subtrees << " subtrees";
+            std::cout << " in " << refit.rebuild_seconds * 1e3 << "ms, ";
         }
-    }
 
-    auto material_center = world.add_material(Lambertian(color(0.1f, 0.2f, 0.5f)));
-    auto material_left   = world.add_material(Dielectric(1.5f));
-    auto material_right  = world.add_material(Metal(color(0.8f, 0.6f, 0.2f), 0.0f));
+        TRACE_SCOPE_ARG("frame", "frame", frame);
+        const auto render_start = std::chrono::steady_clock::now();
+        auto image = renderer.render(camera, world);
+        const std::chrono::duration<double> render_time = std::chrono::steady_clock::now() - render_start;
+        ray_stats.merge(renderer.stats());
+        render_seconds += render_time.count();
+
+        // Room for an underscore and every digit of a size_t
+        char number[24];
+        std::snprintf(number, sizeof(number), "_%04zu", frame);
+        const std::string name = std::string(sequence.output).insert(extension, number);
+        std::cout << "render " << render_time.count() << "s, saving '" << name << "'" << std::endl;
 
-    world.add_object(Sphere(point3( 0.0f, -100.5f, -1.0f), 100.0f, material_ground));
+        output.push(std::move(image), name, args.resolve);
+    }
 
-    world.add_object(Sphere(point3( .0f, 1.0f, 0.0f),  1.0f, material_center));
-    world.add_object(Sphere(point3(-4.0f, 1.0f, 0.0f), 1.0f, material_left));
-    world.add_object(Sphere(point3(-4.0f, 1.0f, 0.0f), -0.95f, material_left));
-    world.add_object(Sphere(point3(4.0f, 1.0f, 0.0f), 1.0f, material_right));
+    output.finish();
 
-    world.compute_bvh();
+    const std::chrono::duration<double> total = std::chrono::steady_clock::now() - sequence_start;
+    std::cout << "Rendered " << sequence.frames << " frames in " << total.count() << "s ("
+        << double(sequence.frames) / total.count() << " frames/s)" << std::endl;
+    output.stats().report(std::cout);
+#if ENABLE_STATS
+    ray_stats.report(std::cout, render_seconds);
+    if (!sequence.stats_json.empty())
+        write_stats_json(sequence.stats_json, ray_stats, render_seconds);
+#endif
 
-    return std::move(world);
+    if (sequence.animate)
+    {
+        std::cout << "Average refit: " << refit_seconds / double(sequence.frames) * 1e3 << "ms, "
+            << "average rebuild: " << rebuild_seconds / double(sequence.frames) * 1e3 << "ms ("
+            << rebuilt_subtrees << " subtrees, " << full_rebuilds << " full rebuilds)" << std::endl;
+    }
 }
\ No newline at end of file
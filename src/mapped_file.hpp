@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Read-only memory mapping of a whole file. Throws `std::runtime_error` if the file can't be
+ * opened or mapped.
+ */
+class MappedFile
+{
+public:
+
+    explicit MappedFile(const char* path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    ~MappedFile();
+
+    inline const char* data() const noexcept { return m_data; }
+    inline size_t size() const noexcept { return m_size; }
+
+private:
+
+    void release() noexcept;
+
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+};
\ No newline at end of file
@@ -17,7 +17,7 @@ bool Lambertian::scatter(
     if (scatter_dir.near_zero())
         scatter_dir = rec.normal;
 
-    scattered = ray(rec.p, scatter_dir);
+    scattered = ray(rec.p, scatter_dir, r_in.time());
     attenuation = m_albedo;
     return true;
 }
@@ -36,8 +36,13 @@ bool Metal::scatter(
     ray& scattered
 ) const
 {
-    const auto reflected = vec3::reflect(vec3::unit_vector(r_in.direction()), rec.normal);
-    scattered = ray(rec.p, reflected + (m_roughness * vec3::random_in_unit_sphere()));
+    const auto reflected = vec3::reflect(r_in.direction(), rec.normal);
+    RAY_STAT(normalizations_saved, 1);
+
+    // A perfect mirror reflects a unit vector about a unit normal, which is already unit length
+    scattered = m_roughness == 0.0f
+        ? ray::from_unit(rec.p, reflected, r_in.time())
+        : ray(rec.p, reflected + (m_roughness * vec3::random_in_unit_sphere()), r_in.time());
     attenuation = m_albedo;
     return vec3::dot(scattered.direction(), rec.normal) > 0;
 }
@@ -53,7 +58,7 @@ static float reflectance(const float cosine, const float ref_idx)
     // Schlick approximation
     float r0 = (1.0f - ref_idx) / (1.0f + ref_idx);
     r0 = r0 * r0;
-    return r0 + (1.0f - r0) * std::pow(1.0f - cosine, 5.0f);
+    return r0 + (1.0f - r0) * pow_int<5>(1.0f - cosine);
 }
 
 bool Dielectric::scatter(
@@ -67,7 +72,8 @@ bool Dielectric::scatter(
     const float refraction_ratio = 
         rec.front_face ? (1.0f / m_index_of_refraction) : m_index_of_refraction;
     
-    const vec3 unit_dir = vec3::unit_vector(r_in.direction());
+    const vec3 unit_dir = r_in.direction();
+    RAY_STAT(normalizations_saved, 1);
     const float cos_theta = std::fmin(vec3::dot(-unit_dir, rec.normal), 1.0f);
     const float sin_theta = std::sqrt(1.0f - cos_theta*cos_theta);
 
@@ -76,6 +82,7 @@ bool Dielectric::scatter(
         vec3::reflect(unit_dir, rec.normal) :
         vec3::refract(unit_dir, rec.normal, refraction_ratio);
 
-    scattered = ray(rec.p, dir);
+    // Reflecting or refracting a unit vector about a unit normal preserves its length
+    scattered = ray::from_unit(rec.p, dir, r_in.time());
     return true;
 }
\ No newline at end of file
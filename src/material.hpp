@@ -17,6 +17,12 @@ public:
         color& attenuation, 
         ray& scattered
     ) const = 0;
+
+    /**
+     * Surface color reported in the albedo AOV. Materials that don't tint what they scatter,
+     * such as glass, are white.
+     */
+    virtual color albedo() const { return color(1.0f, 1.0f, 1.0f); }
 };
 
 
@@ -27,6 +33,10 @@ public:
 
     Lambertian(const color& albedo);
 
+    inline color get_albedo() const noexcept { return m_albedo; }
+
+    inline color albedo() const override { return m_albedo; }
+
     bool scatter(
         const ray& r_in, 
         const HitRecord& rec, 
@@ -45,6 +55,12 @@ public:
 
     Metal(const color& albedo, const float roughness);
 
+    inline color get_albedo() const noexcept { return m_albedo; }
+
+    inline float get_roughness() const noexcept { return m_roughness; }
+
+    inline color albedo() const override { return m_albedo; }
+
     bool scatter(
         const ray& r_in, 
         const HitRecord& rec, 
@@ -64,6 +80,8 @@ public:
 
     Dielectric(const float index_of_refraction);
 
+    inline float get_index_of_refraction() const noexcept { return m_index_of_refraction; }
+
     bool scatter(
         const ray& r_in, 
         const HitRecord& rec, 
@@ -0,0 +1,876 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "mesh_loader.hpp"
+
+// Chunks smaller than this aren't worth handing to another thread
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+struct TextChunk
+{
+    const char* begin;
+    const char* end;
+};
+
+static std::vector<TextChunk> split_lines(const char* data, const size_t size, const size_t pieces);
+static bool ends_with(const char* str, const char* suffix);
+
+TriangleMesh load_mesh(const char* path, ThreadPool& pool, MeshLoadStats* stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const MappedFile file(path);
+    TriangleMesh mesh;
+
+    if (ends_with(path, ".obj") || ends_with(path, ".OBJ"))
+        mesh = load_obj(file, pool);
+    else if (ends_with(path, ".ply") || ends_with(path, ".PLY"))
+        mesh = load_ply(file, pool);
+    else
+        throw std::runtime_error(std::string("unknown mesh format for '") + path + "'");
+
+    if (stats != nullptr)
+    {
+        stats->bytes = file.size();
+        stats->triangles = mesh.triangle_count();
+        stats->seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+    }
+
+    return mesh;
+}
+
+
+
+// ------------------------------------------------------------------------------------------------
+// OBJ
+// ------------------------------------------------------------------------------------------------
+
+struct ObjCounts
+{
+    size_t positions = 0;
+    size_t uvs = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+    bool face_uvs = false;
+    bool face_normals = false;
+};
+
+/**
+ * Cursor over a single line of an OBJ file.
+ */
+class ObjLine
+{
+public:
+
+    inline ObjLine(const char* begin, const char* end) : m_pos(begin), m_end(end) {}
+
+    inline void skip_space() noexcept
+    {
+        while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r')) m_pos++;
+    }
+
+    inline bool done() noexcept
+    {
+        skip_space();
+        return m_pos >= m_end;
+    }
+
+    inline char peek() const noexcept { return m_pos < m_end ? *m_pos : '\0'; }
+    inline void advance() noexcept { m_pos++; }
+
+    /**
+     * Reads the keyword at the start of the line ("v", "vt", "f", ...).
+     */
+    inline std::pair<const char*, size_t> keyword() noexcept
+    {
+        skip_space();
+        const char* begin = m_pos;
+        while (m_pos < m_end && *m_pos != ' ' && *m_pos != '\t' && *m_pos != '\r') m_pos++;
+        return { begin, size_t(m_pos - begin) };
+    }
+
+    inline float read_float()
+    {
+        skip_space();
+        if (m_pos < m_end && *m_pos == '+') m_pos++;
+
+        float value = 0.0f;
+        const auto res = std::from_chars(m_pos, m_end, value);
+        if (res.ec != std::errc())
+            throw std::runtime_error("malformed number in OBJ file");
+        m_pos = res.ptr;
+        return value;
+    }
+
+    inline bool try_read_int(int64_t& value) noexcept
+    {
+        if (m_pos < m_end && *m_pos == '+') m_pos++;
+        const auto res = std::from_chars(m_pos, m_end, value);
+        if (res.ec != std::errc()) return false;
+        m_pos = res.ptr;
+        return true;
+    }
+
+    /**
+     * Skips the rest of a whitespace separated token.
+     */
+    inline void skip_token() noexcept
+    {
+        while (m_pos < m_end && *m_pos != ' ' && *m_pos != '\t' && *m_pos != '\r') m_pos++;
+    }
+
+private:
+
+    const char* m_pos;
+    const char* m_end;
+};
+
+enum class ObjLineType { Position, TexCoord, Normal, Face, Other };
+
+static inline ObjLineType classify(const std::pair<const char*, size_t>& kw)
+{
+    if (kw.second == 1 && kw.first[0] == 'v') return ObjLineType::Position;
+    if (kw.second == 1 && kw.first[0] == 'f') return ObjLineType::Face;
+    if (kw.second == 2 && kw.first[0] == 'v' && kw.first[1] == 't') return ObjLineType::TexCoord;
+    if (kw.second == 2 && kw.first[0] == 'v' && kw.first[1] == 'n') return ObjLineType::Normal;
+    return ObjLineType::Other;
+}
+
+template<typename F> static inline void for_each_line(const TextChunk& chunk, F&& fn)
+{
+    const char* pos = chunk.begin;
+    while (pos < chunk.end)
+    {
+        const char* nl = static_cast<const char*>(std::memchr(pos, '\n', size_t(chunk.end - pos)));
+        const char* line_end = nl != nullptr ? nl : chunk.end;
+        fn(pos, line_end);
+        pos = line_end + 1;
+    }
+}
+
+struct ObjCorner
+{
+    int64_t position;
+    int64_t uv;
+    int64_t normal;
+    bool has_uv;
+    bool has_normal;
+};
+
+/**
+ * Reads one "v", "v/vt", "v//vn" or "v/vt/vn" face corner.
+ */
+static inline bool read_corner(ObjLine& line, ObjCorner& corner)
+{
+    if (line.done())
+        return false;
+
+    corner.has_uv = false;
+    corner.has_normal = false;
+    if (!line.try_read_int(corner.position))
+        throw std::runtime_error("malformed face in OBJ file");
+
+    if (line.peek() == '/')
+    {
+        line.advance();
+        if (line.peek() != '/')
+        {
+            if (!line.try_read_int(corner.uv))
+                throw std::runtime_error("malformed face in OBJ file");
+            corner.has_uv = true;
+        }
+
+        if (line.peek() == '/')
+        {
+            line.advance();
+            if (!line.try_read_int(corner.normal))
+                throw std::runtime_error("malformed face in OBJ file");
+            corner.has_normal = true;
+        }
+    }
+
+    line.skip_token();
+    return true;
+}
+
+/**
+ * Converts a 1-based (or negative, relative) OBJ index into a 0-based one. `seen` is the number of
+ * elements defined before the face.
+ */
+static inline uint32_t resolve_index(const int64_t index, const size_t seen)
+{
+    const int64_t resolved = index > 0 ? index - 1 : int64_t(seen) + index;
+    if (index == 0 || resolved < 0 || resolved >= int64_t(seen))
+        throw std::runtime_error("face references an undefined vertex in OBJ file");
+    return uint32_t(resolved);
+}
+
+TriangleMesh load_obj(const MappedFile& file, ThreadPool& pool)
+{
+    const auto chunks = split_lines(file.data(), file.size(), pool.size() * 8);
+
+    // Pass 1: count elements per chunk so each chunk knows where its output goes
+    std::vector<ObjCounts> counts(chunks.size());
+    pool.parallel_for(chunks.size(), [&](size_t c)
+    {
+        auto& count = counts[c];
+        for_each_line(chunks[c], [&](const char* begin, const char* end)
+        {
+            ObjLine line(begin, end);
+            switch (classify(line.keyword()))
+            {
+            case ObjLineType::Position: count.positions++; break;
+            case ObjLineType::TexCoord: count.uvs++; break;
+            case ObjLineType::Normal: count.normals++; break;
+            case ObjLineType::Face:
+            {
+                size_t corners = 0;
+                ObjCorner corner;
+                while (read_corner(line, corner))
+                {
+                    corners++;
+                    count.face_uvs |= corner.has_uv;
+                    count.face_normals |= corner.has_normal;
+                }
+                if (corners >= 3) count.triangles += corners - 2;
+                break;
+            }
+            default: break;
+            }
+        });
+    });
+
+    // Exclusive prefix sums give every chunk its output offsets
+    std::vector<ObjCounts> offsets(chunks.size());
+    ObjCounts total;
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        offsets[c] = total;
+        total.positions += counts[c].positions;
+        total.uvs += counts[c].uvs;
+        total.normals += counts[c].normals;
+        total.triangles += counts[c].triangles;
+        total.face_uvs |= counts[c].face_uvs;
+        total.face_normals |= counts[c].face_normals;
+    }
+
+    if (total.triangles > std::numeric_limits<uint32_t>::max() / 3)
+        throw std::runtime_error("OBJ file has too many triangles for 32-bit indices");
+
+    std::vector<point3> positions(total.positions);
+    std::vector<TexCoord> uvs(total.uvs);
+    std::vector<vec3> normals(total.normals);
+    std::vector<uint32_t> position_idx(3 * total.triangles);
+    std::vector<uint32_t> uv_idx(total.face_uvs ? 3 * total.triangles : 0);
+    std::vector<uint32_t> normal_idx(total.face_normals ? 3 * total.triangles : 0);
+
+    // Pass 2: parse every chunk straight into its slice of the buffers
+    pool.parallel_for(chunks.size(), [&](size_t c)
+    {
+        auto cursor = offsets[c];
+        for_each_line(chunks[c], [&](const char* begin, const char* end)
+        {
+            ObjLine line(begin, end);
+            switch (classify(line.keyword()))
+            {
+            case ObjLineType::Position:
+            {
+                const float x = line.read_float();
+                const float y = line.read_float();
+                const float z = line.read_float();
+                positions[cursor.positions++] = point3(x, y, z);
+                break;
+            }
+            case ObjLineType::TexCoord:
+            {
+                const float u = line.read_float();
+                const float v = line.done() ? 0.0f : line.read_float();
+                uvs[cursor.uvs++] = TexCoord { u, v };
+                break;
+            }
+            case ObjLineType::Normal:
+            {
+                const float x = line.read_float();
+                const float y = line.read_float();
+                const float z = line.read_float();
+                normals[cursor.normals++] = vec3(x, y, z);
+                break;
+            }
+            case ObjLineType::Face:
+            {
+                // Fan triangulation only needs the first and previous corner
+                ObjCorner corners[3];
+                size_t n = 0;
+                while (read_corner(line, corners[n < 2 ? n : 2]))
+                {
+                    if (n >= 2)
+                    {
+                        const size_t tri = cursor.triangles++;
+                        for (int k = 0; k < 3; k++)
+                        {
+                            const auto& corner = corners[k];
+                            position_idx[3 * tri + k] = resolve_index(corner.position, cursor.positions);
+                            if (!uv_idx.empty())
+                                uv_idx[3 * tri + k] = corner.has_uv ? resolve_index(corner.uv, cursor.uvs) : NO_INDEX;
+                            if (!normal_idx.empty())
+                                normal_idx[3 * tri + k] = corner.has_normal ? resolve_index(corner.normal, cursor.normals) : NO_INDEX;
+                        }
+                        corners[1] = corners[2];
+                    }
+                    n++;
+                }
+                break;
+            }
+            default: break;
+            }
+        });
+    });
+
+    // Attribute buffers can be shared when every corner indexes them like its position
+    const bool use_uvs = !uv_idx.empty();
+    const bool use_normals = !normal_idx.empty();
+    std::atomic<bool> shared(
+        (!use_uvs || total.uvs == total.positions)
+        && (!use_normals || total.normals == total.positions)
+    );
+
+    if (shared && (use_uvs || use_normals))
+    {
+        pool.parallel_for(chunks.size(), [&](size_t c)
+        {
+            const size_t begin = 3 * offsets[c].triangles;
+            const size_t end = begin + 3 * counts[c].triangles;
+            for (size_t i = begin; i < end && shared; i++)
+            {
+                if ((use_uvs && uv_idx[i] != position_idx[i]) || (use_normals && normal_idx[i] != position_idx[i]))
+                    shared = false;
+            }
+        });
+    }
+
+    if (shared)
+    {
+        return TriangleMesh(
+            std::move(positions),
+            std::move(position_idx),
+            use_normals ? std::move(normals) : std::vector<vec3>(),
+            use_uvs ? std::move(uvs) : std::vector<TexCoord>()
+        );
+    }
+
+    // Give every triangle corner its own vertex
+    const size_t corner_count = 3 * total.triangles;
+    std::vector<point3> corner_positions(corner_count);
+    std::vector<vec3> corner_normals(use_normals ? corner_count : 0);
+    std::vector<TexCoord> corner_uvs(use_uvs ? corner_count : 0);
+    std::vector<uint32_t> indices(corner_count);
+
+    pool.parallel_for(chunks.size(), [&](size_t c)
+    {
+        const size_t begin = 3 * offsets[c].triangles;
+        const size_t end = begin + 3 * counts[c].triangles;
+        for (size_t i = begin; i < end; i++)
+        {
+            corner_positions[i] = positions[position_idx[i]];
+            if (use_normals)
+                corner_normals[i] = normal_idx[i] != NO_INDEX ? normals[normal_idx[i]] : vec3();
+            if (use_uvs)
+                corner_uvs[i] = uv_idx[i] != NO_INDEX ? uvs[uv_idx[i]] : TexCoord { 0.0f, 0.0f };
+            indices[i] = uint32_t(i);
+        }
+    });
+
+    return TriangleMesh(
+        std::move(corner_positions),
+        std::move(indices),
+        std::move(corner_normals),
+        std::move(corner_uvs)
+    );
+}
+
+
+
+// ------------------------------------------------------------------------------------------------
+// PLY
+// ------------------------------------------------------------------------------------------------
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    bool is_list;
+    PlyType count_type;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+};
+
+static size_t ply_type_size(const PlyType type)
+{
+    switch (type)
+    {
+    case PlyType::Int8: case PlyType::UInt8: return 1;
+    case PlyType::Int16: case PlyType::UInt16: return 2;
+    case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+    case PlyType::Float64: return 8;
+    }
+    return 0;
+}
+
+static PlyType parse_ply_type(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    throw std::runtime_error("unknown PLY property type '" + name + "'");
+}
+
+template<typename T> static inline T load_swapped(const char* src, const bool swap)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, src, sizeof(T));
+    if (swap) std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static inline double read_ply_value(const char* src, const PlyType type, const bool swap)
+{
+    switch (type)
+    {
+    case PlyType::Int8: return double(int8_t(*src));
+    case PlyType::UInt8: return double(uint8_t(*src));
+    case PlyType::Int16: return double(load_swapped<int16_t>(src, swap));
+    case PlyType::UInt16: return double(load_swapped<uint16_t>(src, swap));
+    case PlyType::Int32: return double(load_swapped<int32_t>(src, swap));
+    case PlyType::UInt32: return double(load_swapped<uint32_t>(src, swap));
+    case PlyType::Float32: return double(load_swapped<float>(src, swap));
+    case PlyType::Float64: return load_swapped<double>(src, swap);
+    }
+    return 0.0;
+}
+
+static inline uint32_t read_ply_index(const char* src, const PlyType type, const bool swap)
+{
+    switch (type)
+    {
+    case PlyType::Int8: case PlyType::UInt8: return uint8_t(*src);
+    case PlyType::Int16: case PlyType::UInt16: return load_swapped<uint16_t>(src, swap);
+    case PlyType::Int32: case PlyType::UInt32: return load_swapped<uint32_t>(src, swap);
+    default: throw std::runtime_error("PLY list counts and indices must be integers");
+    }
+}
+
+/**
+ * Size of one record of `element`, or 0 if it contains lists and so varies per record.
+ */
+static size_t fixed_record_size(const PlyElement& element)
+{
+    size_t size = 0;
+    for (const auto& prop : element.properties)
+    {
+        if (prop.is_list) return 0;
+        size += ply_type_size(prop.type);
+    }
+    return size;
+}
+
+/**
+ * Size of the record starting at `src`, reading list lengths as needed.
+ */
+static inline size_t record_size(const PlyElement& element, const char* src, const char* end, const bool swap)
+{
+    size_t size = 0;
+    for (const auto& prop : element.properties)
+    {
+        if (src + size + ply_type_size(prop.count_type) > end)
+            throw std::runtime_error("PLY file is truncated");
+
+        if (prop.is_list)
+        {
+            const uint32_t n = read_ply_index(src + size, prop.count_type, swap);
+            size += ply_type_size(prop.count_type) + size_t(n) * ply_type_size(prop.type);
+        }
+        else
+        {
+            size += ply_type_size(prop.type);
+        }
+    }
+    return size;
+}
+
+static int find_property(const PlyElement& element, std::initializer_list<const char*> names)
+{
+    for (const char* name : names)
+    {
+        for (size_t i = 0; i < element.properties.size(); i++)
+        {
+            if (element.properties[i].name == name) return int(i);
+        }
+    }
+    return -1;
+}
+
+TriangleMesh load_ply(const MappedFile& file, ThreadPool& pool)
+{
+    const char* data = file.data();
+    const char* end = data + file.size();
+
+    // Header
+    const char* header_end_tag = "end_header";
+    const char* header_end = std::search(data, end, header_end_tag, header_end_tag + std::strlen(header_end_tag));
+    if (file.size() < 4 || std::memcmp(data, "ply", 3) != 0 || header_end == end)
+        throw std::runtime_error("not a PLY file");
+
+    const char* body = static_cast<const char*>(std::memchr(header_end, '\n', size_t(end - header_end)));
+    if (body == nullptr)
+        throw std::runtime_error("PLY header is truncated");
+    body++;
+
+    bool swap = false;
+    std::vector<PlyElement> elements = {};
+    const TextChunk header = { data, header_end };
+    for_each_line(header, [&](const char* line_begin, const char* line_end)
+    {
+        // Tokenize the line; headers are tiny so allocating here is fine
+        std::vector<std::string> tokens = {};
+        const char* pos = line_begin;
+        while (pos < line_end)
+        {
+            while (pos < line_end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) pos++;
+            const char* tok = pos;
+            while (pos < line_end && *pos != ' ' && *pos != '\t' && *pos != '\r') pos++;
+            if (pos > tok) tokens.emplace_back(tok, pos);
+        }
+
+        if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info" || tokens[0] == "ply")
+            return;
+
+        if (tokens[0] == "format" && tokens.size() >= 2)
+        {
+            if (tokens[1] == "ascii")
+                throw std::runtime_error("ASCII PLY files are not supported");
+
+            const bool big_endian = tokens[1] == "binary_big_endian";
+            if (!big_endian && tokens[1] != "binary_little_endian")
+                throw std::runtime_error("unknown PLY format '" + tokens[1] + "'");
+
+            const uint16_t probe = 1;
+            uint8_t first_byte;
+            std::memcpy(&first_byte, &probe, 1);
+            swap = big_endian == (first_byte == 1);
+        }
+        else if (tokens[0] == "element" && tokens.size() == 3)
+        {
+            elements.push_back(PlyElement { tokens[1], size_t(std::stoull(tokens[2])), {} });
+        }
+        else if (tokens[0] == "property" && !elements.empty())
+        {
+            if (tokens.size() == 5 && tokens[1] == "list")
+                elements.back().properties.push_back(PlyProperty { tokens[4], parse_ply_type(tokens[3]), true, parse_ply_type(tokens[2]) });
+            else if (tokens.size() == 3)
+                elements.back().properties.push_back(PlyProperty { tokens[2], parse_ply_type(tokens[1]), false, PlyType::UInt8 });
+            else
+                throw std::runtime_error("malformed PLY property");
+        }
+    });
+
+    // Locate each element's records. Variable sized elements are scanned once to find their end
+    const PlyElement* vertex_element = nullptr;
+    const PlyElement* face_element = nullptr;
+    const char* vertex_data = nullptr;
+    const char* face_data = nullptr;
+    std::vector<size_t> face_offsets = {};
+    size_t face_stride = 0;
+    bool faces_fixed = false;
+
+    const char* pos = body;
+    for (const auto& element : elements)
+    {
+        const size_t fixed = fixed_record_size(element);
+        const char* element_begin = pos;
+
+        if (element.name == "face")
+        {
+            face_element = &element;
+            face_data = pos;
+
+            // Guess that every face is a triangle, then verify the guess in parallel
+            const int list = find_property(element, { "vertex_indices", "vertex_index" });
+            if (list < 0)
+                throw std::runtime_error("PLY face element has no vertex_indices list");
+
+            size_t tri_stride = 0;
+            size_t count_offset = 0;
+            for (int i = 0; i < int(element.properties.size()); i++)
+            {
+                const auto& prop = element.properties[i];
+                if (i == list)
+                {
+                    count_offset = tri_stride;
+                    tri_stride += ply_type_size(prop.count_type) + 3 * ply_type_size(prop.type);
+                }
+                else if (prop.is_list)
+                {
+                    tri_stride = 0;
+                    break;
+                }
+                else
+                {
+                    tri_stride += ply_type_size(prop.type);
+                }
+            }
+
+            // Divided rather than multiplied, so a huge face count in the header can't overflow
+            if (tri_stride != 0 && element.count <= size_t(end - pos) / tri_stride)
+            {
+                const auto& list_prop = element.properties[list];
+                std::atomic<bool> all_triangles(true);
+                const size_t pieces = pool.size() * 8;
+                pool.parallel_for(pieces, [&](size_t piece)
+                {
+                    const size_t first = element.count * piece / pieces;
+                    const size_t last = element.count * (piece + 1) / pieces;
+                    for (size_t f = first; f < last && all_triangles; f++)
+                    {
+                        if (read_ply_index(pos + f * tri_stride + count_offset, list_prop.count_type, swap) != 3)
+                            all_triangles = false;
+                    }
+                });
+                faces_fixed = all_triangles;
+            }
+
+            if (faces_fixed)
+            {
+                face_stride = tri_stride;
+                pos += tri_stride * element.count;
+            }
+            else
+            {
+                // Every record holds at least the list's count, so this bounds the offset table
+                if (element.count > size_t(end - pos))
+                    throw std::runtime_error("PLY file is truncated");
+                face_offsets.resize(element.count + 1);
+                for (size_t f = 0; f < element.count; f++)
+                {
+                    face_offsets[f] = size_t(pos - face_data);
+                    pos += record_size(element, pos, end, swap);
+                }
+                face_offsets[element.count] = size_t(pos - face_data);
+            }
+        }
+        else if (fixed != 0)
+        {
+            if (element.name == "vertex")
+            {
+                vertex_element = &element;
+                vertex_data = pos;
+            }
+            if (element.count > size_t(end - pos) / fixed)
+                throw std::runtime_error("PLY file is truncated");
+            pos += fixed * element.count;
+        }
+        else
+        {
+            if (element.name == "vertex")
+                throw std::runtime_error("PLY vertex element must not contain lists");
+            for (size_t i = 0; i < element.count; i++)
+                pos += record_size(element, pos, end, swap);
+        }
+
+        if (pos > end || pos < element_begin)
+            throw std::runtime_error("PLY file is truncated");
+    }
+
+    if (vertex_element == nullptr || face_element == nullptr)
+        throw std::runtime_error("PLY file needs vertex and face elements");
+
+    // Vertices
+    const auto& vertex = *vertex_element;
+    const int px = find_property(vertex, { "x" });
+    const int py = find_property(vertex, { "y" });
+    const int pz = find_property(vertex, { "z" });
+    const int nx = find_property(vertex, { "nx" });
+    const int ny = find_property(vertex, { "ny" });
+    const int nz = find_property(vertex, { "nz" });
+    const int tu = find_property(vertex, { "u", "s", "texture_u", "texture_s" });
+    const int tv = find_property(vertex, { "v", "t", "texture_v", "texture_t" });
+
+    if (px < 0 || py < 0 || pz < 0)
+        throw std::runtime_error("PLY vertex element needs x, y and z");
+
+    const bool has_normals = nx >= 0 && ny >= 0 && nz >= 0;
+    const bool has_uvs = tu >= 0 && tv >= 0;
+
+    std::vector<size_t> prop_offsets(vertex.properties.size());
+    size_t vertex_stride = 0;
+    for (size_t i = 0; i < vertex.properties.size(); i++)
+    {
+        prop_offsets[i] = vertex_stride;
+        vertex_stride += ply_type_size(vertex.properties[i].type);
+    }
+
+    std::vector<point3> positions(vertex.count);
+    std::vector<vec3> normals(has_normals ? vertex.count : 0);
+    std::vector<TexCoord> uvs(has_uvs ? vertex.count : 0);
+
+    const auto read_prop = [&](const char* record, const int prop)
+    {
+        return float(read_ply_value(record + prop_offsets[prop], vertex.properties[prop].type, swap));
+    };
+
+    const size_t pieces = pool.size() * 8;
+    pool.parallel_for(pieces, [&](size_t piece)
+    {
+        const size_t first = vertex.count * piece / pieces;
+        const size_t last = vertex.count * (piece + 1) / pieces;
+        for (size_t i = first; i < last; i++)
+        {
+            const char* record = vertex_data + i * vertex_stride;
+            positions[i] = point3(read_prop(record, px), read_prop(record, py), read_prop(record, pz));
+            if (has_normals)
+                normals[i] = vec3(read_prop(record, nx), read_prop(record, ny), read_prop(record, nz));
+            if (has_uvs)
+                uvs[i] = TexCoord { read_prop(record, tu), read_prop(record, tv) };
+        }
+    });
+
+    // Faces
+    const auto& face = *face_element;
+    const int list = find_property(face, { "vertex_indices", "vertex_index" });
+    const auto& list_prop = face.properties[list];
+    const size_t count_size = ply_type_size(list_prop.count_type);
+    const size_t index_size = ply_type_size(list_prop.type);
+
+    // Byte offset of the index list within a record that starts at `record`
+    const auto list_offset = [&](const char* record)
+    {
+        size_t offset = 0;
+        for (int i = 0; i < list; i++)
+        {
+            const auto& prop = face.properties[i];
+            offset += prop.is_list
+                ? ply_type_size(prop.count_type) + size_t(read_ply_index(record + offset, prop.count_type, swap)) * ply_type_size(prop.type)
+                : ply_type_size(prop.type);
+        }
+        return offset;
+    };
+
+    const auto face_record = [&](const size_t f)
+    {
+        return faces_fixed ? face_data + f * face_stride : face_data + face_offsets[f];
+    };
+
+    // Triangles before each piece of faces, so pieces know where to write
+    std::vector<size_t> piece_triangles(pieces + 1, 0);
+    pool.parallel_for(pieces, [&](size_t piece)
+    {
+        const size_t first = face.count * piece / pieces;
+        const size_t last = face.count * (piece + 1) / pieces;
+        size_t tris = 0;
+        for (size_t f = first; f < last; f++)
+        {
+            const char* record = face_record(f);
+            const uint32_t n = read_ply_index(record + list_offset(record), list_prop.count_type, swap);
+            tris += n >= 3 ? n - 2 : 0;
+        }
+        piece_triangles[piece + 1] = tris;
+    });
+
+    for (size_t i = 1; i <= pieces; i++)
+        piece_triangles[i] += piece_triangles[i - 1];
+
+    if (piece_triangles[pieces] > std::numeric_limits<uint32_t>::max() / 3)
+        throw std::runtime_error("PLY file has too many triangles for 32-bit indices");
+
+    std::vector<uint32_t> indices(3 * piece_triangles[pieces]);
+    std::atomic<bool> out_of_range(false);
+    pool.parallel_for(pieces, [&](size_t piece)
+    {
+        const size_t first = face.count * piece / pieces;
+        const size_t last = face.count * (piece + 1) / pieces;
+        size_t out = 3 * piece_triangles[piece];
+        for (size_t f = first; f < last; f++)
+        {
+            const char* record = face_record(f);
+            const char* list_data = record + list_offset(record);
+            const uint32_t n = read_ply_index(list_data, list_prop.count_type, swap);
+            const char* idx = list_data + count_size;
+
+            // Points and lines make no triangles, and an empty list has no first index to read
+            if (n < 3)
+                continue;
+
+            const uint32_t i0 = read_ply_index(idx, list_prop.type, swap);
+            for (uint32_t k = 2; k < n; k++)
+            {
+                const uint32_t i1 = read_ply_index(idx + (k - 1) * index_size, list_prop.type, swap);
+                const uint32_t i2 = read_ply_index(idx + k * index_size, list_prop.type, swap);
+                if (i0 >= vertex.count || i1 >= vertex.count || i2 >= vertex.count)
+                    out_of_range = true;
+                indices[out++] = i0;
+                indices[out++] = i1;
+                indices[out++] = i2;
+            }
+        }
+    });
+
+    if (out_of_range)
+        throw std::runtime_error("face references an undefined vertex in PLY file");
+
+    return TriangleMesh(std::move(positions), std::move(indices), std::move(normals), std::move(uvs));
+}
+
+
+
+/**
+ * Splits `data` into roughly `pieces` chunks that each end just after a newline.
+ */
+std::vector<TextChunk> split_lines(const char* data, const size_t size, const size_t pieces)
+{
+    const size_t target = std::max(MIN_CHUNK_BYTES, size / std::max<size_t>(pieces, 1) + 1);
+    std::vector<TextChunk> chunks = {};
+
+    const char* end = data + size;
+    const char* pos = data;
+    while (pos < end)
+    {
+        const char* split = pos + std::min(target, size_t(end - pos));
+        if (split < end)
+        {
+            const char* nl = static_cast<const char*>(std::memchr(split, '\n', size_t(end - split)));
+            split = nl != nullptr ? nl + 1 : end;
+        }
+        chunks.push_back(TextChunk { pos, split });
+        pos = split;
+    }
+
+    return chunks;
+}
+
+bool ends_with(const char* str, const char* suffix)
+{
+    const size_t len = std::strlen(str);
+    const size_t suffix_len = std::strlen(suffix);
+    return len >= suffix_len && std::strcmp(str + len - suffix_len, suffix) == 0;
+}
\ No newline at end of file
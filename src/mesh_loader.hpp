@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include "triangle_mesh.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+struct MeshLoadStats
+{
+    size_t bytes = 0;
+    size_t triangles = 0;
+    double seconds = 0.0;
+
+    inline double megabytes_per_second() const noexcept
+    {
+        return seconds > 0.0 ? double(bytes) / seconds * 1e-6 : 0.0;
+    }
+};
+
+/**
+ * Loads a mesh from a Wavefront OBJ (`.obj`) or binary PLY (`.ply`) file, picked by extension.
+ * The file is memory mapped and parsed in chunks across `pool`, writing straight into the mesh
+ * buffers. Throws `std::runtime_error` on unreadable or malformed files.
+ */
+TriangleMesh load_mesh(const char* path, ThreadPool& pool, MeshLoadStats* stats = nullptr);
+
+/**
+ * Parses OBJ positions, texture coordinates, normals and faces. Polygons are fan triangulated.
+ * When every face uses the same index for a corner's position, normal and texture coordinate the
+ * vertex buffers are shared as-is; otherwise each triangle corner gets its own vertex.
+ */
+TriangleMesh load_obj(const MappedFile& file, ThreadPool& pool);
+
+/**
+ * Parses a binary (little or big endian) PLY file with a `vertex` element (`x`, `y`, `z` and
+ * optionally `nx`, `ny`, `nz` and `u`, `v` or `s`, `t`) and a `face` element holding a
+ * `vertex_indices` list. Polygons are fan triangulated.
+ */
+TriangleMesh load_ply(const MappedFile& file, ThreadPool& pool);
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <streambuf>
+#include "output_queue.hpp"
+#include "trace.hpp"
+
+#if defined(__linux__)
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(const Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+#if defined(__linux__) && defined(O_DIRECT)
+
+// O_DIRECT transfers must start and end on this boundary, in memory and in the file
+constexpr size_t DIRECT_ALIGNMENT = 4096;
+constexpr size_t STAGING_SIZE = 1 << 20;
+
+/**
+ * Stream buffer that writes a file through an aligned staging block, handing the block to the
+ * kernel each time it fills, so an encoder streams its rows out rather than building the whole
+ * file in memory. Files are opened with O_DIRECT where the file system takes it. O_DIRECT can't
+ * write a partial block, so the last one is padded out to the alignment and the file trimmed
+ * back afterwards, and since direct writes are synchronous the encoder waits on each block.
+ */
+class FileSink : public std::streambuf
+{
+public:
+
+    explicit FileSink(const std::string& path) :
+        m_path(path),
+        m_staging(static_cast<char*>(std::aligned_alloc(DIRECT_ALIGNMENT, STAGING_SIZE)), &std::free),
+        m_fd(-1),
+        m_offset(0),
+        m_direct(true),
+        m_failed(false),
+        m_write_seconds(0.0)
+    {
+        if (!m_staging)
+            throw std::bad_alloc();
+
+        // Some file systems, tmpfs among them, refuse O_DIRECT when opening and others on the
+        // first write. Either way the file is written through the page cache instead
+        m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (m_fd < 0 && errno == EINVAL)
+        {
+            m_direct = false;
+            m_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (m_fd < 0)
+            throw std::runtime_error("unable to open '" + path + "' for writing");
+
+        setp(m_staging.get(), m_staging.get() + STAGING_SIZE);
+    }
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    ~FileSink()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    /**
+     * Writes what's still staged and closes the file, throwing if any write failed.
+     */
+    void close()
+    {
+        const auto start = Clock::now();
+        const size_t size = size_t(pptr() - pbase());
+        const bool padded = m_direct && size % DIRECT_ALIGNMENT != 0;
+        if (!m_failed && size > 0)
+            write_block(size);
+        if (!m_failed && padded && ftruncate(m_fd, off_t(m_offset)) != 0)
+            m_failed = true;
+
+        const int fd = m_fd;
+        m_fd = -1;
+        if (::close(fd) != 0 || m_failed)
+            throw std::runtime_error("unable to write '" + m_path + "'");
+        m_write_seconds += seconds_since(start);
+    }
+
+    inline bool direct() const noexcept { return m_direct; }
+    inline uint64_t size() const noexcept { return m_offset; }
+
+    /**
+     * Time spent in writes so far, as opposed to waiting on the encoder.
+     */
+    inline double write_seconds() const noexcept { return m_write_seconds; }
+
+protected:
+
+    int_type overflow(const int_type c) override
+    {
+        const auto start = Clock::now();
+        if (!m_failed)
+            write_block(STAGING_SIZE);
+        m_write_seconds += seconds_since(start);
+        if (m_failed)
+            return traits_type::eof();
+
+        setp(m_staging.get(), m_staging.get() + STAGING_SIZE);
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            sputc(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+private:
+
+    /**
+     * Writes the first `size` staged bytes at the end of the file. Only the last block may be
+     * short, and with O_DIRECT it goes out padded with zeros.
+     */
+    void write_block(const size_t size)
+    {
+        TRACE_SCOPE("write block");
+
+        if (m_direct)
+        {
+            const size_t padded = (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+            std::memset(m_staging.get() + size, 0, padded - size);
+            const ssize_t written = pwrite(m_fd, m_staging.get(), padded, off_t(m_offset));
+            if (written == ssize_t(padded))
+            {
+                m_offset += size;
+                return;
+            }
+
+            const int flags = fcntl(m_fd, F_GETFL);
+            if (written >= 0 || errno != EINVAL || m_offset != 0 || flags < 0 ||
+                fcntl(m_fd, F_SETFL, flags & ~O_DIRECT) != 0)
+            {
+                m_failed = true;
+                return;
+            }
+            m_direct = false;
+        }
+
+        for (size_t done = 0; done < size;)
+        {
+            const ssize_t written = pwrite(m_fd, m_staging.get() + done, size - done, off_t(m_offset + done));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+            {
+                m_failed = true;
+                return;
+            }
+            done += size_t(written);
+        }
+        m_offset += size;
+    }
+
+    const std::string m_path;
+    const std::unique_ptr<char, decltype(&std::free)> m_staging;
+    int m_fd;
+    uint64_t m_offset;
+    bool m_direct;
+    bool m_failed;
+    double m_write_seconds;
+};
+
+#endif
+
+/**
+ * The size of the file written and how long went to writing rather than encoding.
+ */
+struct FrameWrite
+{
+    uint64_t size = 0;
+    bool direct = false;
+    double write_seconds = 0.0;
+};
+
+/**
+ * Encodes `image` straight into the file at `path`.
+ */
+static FrameWrite write_frame(const Image& image, const std::string& path, const ResolveSettings& settings)
+{
+    FrameWrite result;
+
+#if defined(__linux__) && defined(O_DIRECT)
+    FileSink sink(path);
+    std::ostream out(&sink);
+    image.encode(out, image_format(path.c_str()), settings);
+    sink.close();
+
+    result.size = sink.size();
+    result.direct = sink.direct();
+    result.write_seconds = sink.write_seconds();
+#else
+    // Without O_DIRECT the file stream's own buffer already streams the encoder's rows out
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("unable to open '" + path + "' for writing");
+    image.encode(out, image_format(path.c_str()), settings);
+    if (!out.flush())
+        throw std::runtime_error("unable to write '" + path + "'");
+    result.size = uint64_t(out.tellp());
+#endif
+
+    return result;
+}
+
+void OutputStats::report(std::ostream& out) const
+{
+    const double per_frame = 1.0 / double(frames > 0 ? frames : 1);
+
+    out << "Output: " << frames << " frames, " << double(bytes) * 1e-6 << " MB ("
+        << direct_frames << " written with O_DIRECT)\n"
+        << "Encode: " << encode_seconds * per_frame * 1e3 << " ms per frame, write latency: "
+        << write_seconds * per_frame * 1e3 << " ms average, " << max_write_seconds * 1e3 << " ms max\n"
+        << "Queue depth: " << double(depth_sum) * per_frame << " average, " << max_depth << " max, "
+        << stalls << " stalls (" << stall_seconds << "s waiting for room)\n";
+}
+
+OutputQueue::OutputQueue(const size_t capacity) :
+    m_capacity(capacity),
+    m_jobs(),
+    m_writing(false),
+    m_stop(false),
+    m_error(nullptr),
+    m_stats()
+{
+    assert(capacity > 0);
+    m_writer = std::thread(&OutputQueue::writer_loop, this);
+}
+
+OutputQueue::~OutputQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_job_ready.notify_all();
+    m_writer.join();
+}
+
+void OutputQueue::push(Image image, std::string path, const ResolveSettings& settings)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    rethrow_error();
+
+    const auto depth = [this] { return m_jobs.size() + (m_writing ? 1 : 0); };
+    if (depth() >= m_capacity)
+    {
+        TRACE_SCOPE("output stall");
+        const auto start = Clock::now();
+        m_job_done.wait(lock, [&] { return depth() < m_capacity || m_error; });
+        m_stats.stalls++;
+        m_stats.stall_seconds += seconds_since(start);
+        rethrow_error();
+    }
+
+    m_jobs.push_back(Job { std::move(image), std::move(path), settings });
+    m_stats.depth_sum += depth();
+    m_stats.max_depth = std::max<uint64_t>(m_stats.max_depth, depth());
+
+    lock.unlock();
+    m_job_ready.notify_one();
+}
+
+void OutputQueue::finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_done.wait(lock, [this] { return (m_jobs.empty() && !m_writing) || m_error; });
+    rethrow_error();
+}
+
+void OutputQueue::rethrow_error()
+{
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+void OutputQueue::writer_loop()
+{
+    trace_thread_name("output writer");
+
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job_ready.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+        if (m_jobs.empty() || m_error)
+            return;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_writing = true;
+        lock.unlock();
+
+        double total_seconds = 0.0;
+        FrameWrite frame;
+        std::exception_ptr error = nullptr;
+
+        try
+        {
+            TRACE_SCOPE("write frame");
+            const auto start = Clock::now();
+            frame = write_frame(job.image, job.path, job.settings);
+            total_seconds = seconds_since(start);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        m_writing = false;
+        if (error)
+        {
+            // Later frames are dropped, since the caller hears about the error on its next call
+            m_error = error;
+            m_jobs.clear();
+        }
+        else
+        {
+            m_stats.frames++;
+            m_stats.bytes += frame.size;
+            m_stats.direct_frames += frame.direct ? 1 : 0;
+            m_stats.encode_seconds += total_seconds - frame.write_seconds;
+            m_stats.write_seconds += total_seconds;
+            m_stats.max_write_seconds = std::max(m_stats.max_write_seconds, total_seconds);
+        }
+        lock.unlock();
+        m_job_done.notify_all();
+    }
+}
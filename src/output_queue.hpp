@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "image.hpp"
+
+/**
+ * Counters kept by an `OutputQueue` while it writes.
+ */
+struct OutputStats
+{
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+
+    // Frames written with O_DIRECT rather than through the page cache
+    uint64_t direct_frames = 0;
+
+    // Frames held by the queue, counting the one being written, when each frame was pushed
+    uint64_t depth_sum = 0;
+    uint64_t max_depth = 0;
+
+    // Pushes that had to wait for room, and how long they waited altogether
+    uint64_t stalls = 0;
+    double stall_seconds = 0.0;
+
+    // Encoding streams into the file, so this is the time not spent waiting on writes
+    double encode_seconds = 0.0;
+
+    // Time from opening a file to having written all of it
+    double write_seconds = 0.0;
+    double max_write_seconds = 0.0;
+
+    /**
+     * Writes a human readable summary with averages per frame.
+     */
+    void report(std::ostream& out) const;
+};
+
+/**
+ * Encodes and writes images on a background thread so rendering can move on to the next frame.
+ * The queue holds at most `capacity` frames, counting the one being written. `push` blocks until
+ * there's room, so a slow disk holds back rendering instead of letting frames pile up in memory.
+ * Frames are encoded straight into the file through a small staging block rather than in memory
+ * first. Where the system and file system allow it, files are written with O_DIRECT so long
+ * sequences don't churn through the page cache.
+ */
+class OutputQueue
+{
+public:
+
+    explicit OutputQueue(const size_t capacity);
+
+    OutputQueue(const OutputQueue&) = delete;
+    OutputQueue& operator=(const OutputQueue&) = delete;
+
+    /**
+     * Writes whatever is still queued. Errors are only reported through `finish`.
+     */
+    ~OutputQueue();
+
+    /**
+     * Queues `image` to be saved to `path`, whose extension picks the format. Rethrows the error
+     * of an earlier frame that failed to save, after which nothing more is written.
+     */
+    void push(Image image, std::string path, const ResolveSettings& settings);
+
+    /**
+     * Blocks until every queued frame is written, rethrowing the first error.
+     */
+    void finish();
+
+    /**
+     * Counters so far. Only stable once `finish` has returned.
+     */
+    inline const OutputStats& stats() const noexcept { return m_stats; }
+
+private:
+
+    struct Job
+    {
+        Image image;
+        std::string path;
+        ResolveSettings settings;
+    };
+
+    void writer_loop();
+
+    void rethrow_error();
+
+    const size_t m_capacity;
+    std::deque<Job> m_jobs;
+    bool m_writing;
+    bool m_stop;
+    std::exception_ptr m_error;
+    OutputStats m_stats;
+
+    std::mutex m_mutex;
+    std::condition_variable m_job_ready;
+    std::condition_variable m_job_done;
+    std::thread m_writer;
+};
@@ -1,26 +1,140 @@
 #pragma once
 
 #include "vec3.hpp"
+#include "stats.hpp"
 
+/**
+ * A ray with a unit length direction, cast at a time within the camera's shutter interval
+ * (0 when it opens, 1 when it closes). The reciprocal of the direction, the direction's sign bits
+ * and the origin scaled by the reciprocal are only needed for traversal, so they are computed the
+ * first time they are requested.
+ */
 class ray 
 {
 public:
     inline ray() {}
-    inline ray(const point3& origin, const vec3& direction)
-        : orig(origin), dir(direction), inv_dir(1.0f / direction)
-    {}
+    inline ray(const point3& origin, const vec3& direction, const float time = 0.0f)
+        : orig(origin), dir(vec3::unit_vector(direction)), tm(time)
+    {
+        RAY_STAT(rays, 1);
+        RAY_STAT(normalizations, 1);
+    }
+
+    /**
+     * Constructs a ray from a direction the caller knows is already unit length.
+     */
+    inline static ray from_unit(const point3& origin, const vec3& unit_direction, const float time = 0.0f) noexcept
+    {
+        ray r;
+        r.orig = origin;
+        r.dir = unit_direction;
+        r.tm = time;
+        RAY_STAT(rays, 1);
+        RAY_STAT(normalizations_saved, 1);
+        return r;
+    }
 
     inline point3 origin() const noexcept { return orig; }
     inline vec3 direction() const noexcept { return dir; }
-    inline vec3 inv_direction() const noexcept { return inv_dir; }
+    inline float time() const noexcept { return tm; }
+
+    /**
+     * Points the ray somewhere else, normalizing `direction`. The reciprocal, sign bits and
+     * scaled origin are dropped and recomputed for the new ray when next requested.
+     */
+    inline void set(const point3& origin, const vec3& direction, const float time) noexcept
+    {
+        orig = origin;
+        dir = vec3::unit_vector(direction);
+        tm = time;
+        has_inv = false;
+        RAY_STAT(normalizations, 1);
+    }
+
+    /**
+     * Reciprocal of the direction. Components of the direction that are zero (or close to it) are
+     * replaced by a tiny value of the same sign first, so the result is always finite.
+     */
+    inline vec3 inv_direction() const noexcept
+    {
+        if (!has_inv) compute_inverse();
+        return inv_dir;
+    }
+
+    /**
+     * `origin() * inv_direction()`, so a slab distance can be computed with a single
+     * `fma(plane, inv_direction(), -scaled_origin())`.
+     */
+    inline vec3 scaled_origin() const noexcept
+    {
+        if (!has_inv) compute_inverse();
+        return org_inv;
+    }
+
+    /**
+     * Bound on the rounding error of `scaled_origin()` (one ulp per component), widened on axes
+     * the ray doesn't move along so it covers the whole slab of a flat box it lies in.
+     */
+    inline vec3 scaled_origin_error() const noexcept
+    {
+        if (!has_inv) compute_inverse();
+        return org_inv_err;
+    }
+
+    /**
+     * Bit `i` is set when component `i` of the direction is negative.
+     */
+    inline int sign_bits() const noexcept
+    {
+        if (!has_inv) compute_inverse();
+        return signs;
+    }
 
     inline point3 at(float t) const noexcept
     {
         return orig + t*dir;
     }
 
-public:
+private:
+
+    inline void compute_inverse() const noexcept
+    {
+        // Clamping keeps the reciprocal finite so a zero direction component never produces
+        // 0 * inf = NaN in the slab test
+        constexpr float MIN_RCP_INPUT = 1e-18f;
+#if ENABLE_SIMD
+        const __m128 sign_mask = _mm_set1_ps(-0.0f);
+        const __m128 magnitude = _mm_max_ps(_mm_andnot_ps(sign_mask, dir.v), _mm_set1_ps(MIN_RCP_INPUT));
+        inv_dir.v = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(magnitude, _mm_and_ps(sign_mask, dir.v)));
+#else
+        const vec3 safe_dir = vec3(
+            std::copysign(std::fmax(std::fabs(dir.e[0]), MIN_RCP_INPUT), dir.e[0]),
+            std::copysign(std::fmax(std::fabs(dir.e[1]), MIN_RCP_INPUT), dir.e[1]),
+            std::copysign(std::fmax(std::fabs(dir.e[2]), MIN_RCP_INPUT), dir.e[2])
+        );
+        inv_dir = 1.0f / safe_dir;
+#endif
+
+        org_inv = orig * inv_dir;
+        // A ray lying exactly in a flat box's plane gets zero slab distances on that axis instead
+        // of the unbounded slab it should, so the error is floored by the reciprocal. The floor
+        // only reaches a meaningful distance on axes whose reciprocal was clamped
+        constexpr float MIN_ERROR_SCALE = 1e-12f;
+        org_inv_err = 0x1.0p-23f * vec3::abs(org_inv) + MIN_ERROR_SCALE * vec3::abs(inv_dir);
+        signs = (inv_dir.e[0] < 0 ? 1 : 0) | (inv_dir.e[1] < 0 ? 2 : 0) | (inv_dir.e[2] < 0 ? 4 : 0);
+        has_inv = true;
+        RAY_STAT(reciprocals, 1);
+    }
+
+    // Only changed through `set`, so the direction stays unit length and the cached values below
+    // belong to it
     point3 orig;
     vec3 dir;
-    vec3 inv_dir;
+    float tm = 0.0f;
+
+    mutable vec3 inv_dir;
+    mutable vec3 org_inv;
+    mutable vec3 org_inv_err;
+    mutable int signs = 0;
+    mutable bool has_inv = false;
 };
\ No newline at end of file
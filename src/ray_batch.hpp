@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "vec3x8.hpp"
+#include "ray.hpp"
+
+/**
+ * Rays stored eight to a block in SoA form, so batched kernels can load a block's origins,
+ * directions and times straight into lanes. Lanes past `size()` in the last block are padding and
+ * hold valid but meaningless rays.
+ */
+class RayBatch
+{
+public:
+
+    RayBatch() = default;
+
+    /**
+     * Makes room for `count` rays. The contents are left unspecified.
+     */
+    inline void resize(const size_t count)
+    {
+        const size_t blocks = (count + 7) / 8;
+        m_origins.resize(blocks);
+        m_directions.resize(blocks);
+        m_times.resize(blocks);
+        m_count = count;
+    }
+
+    inline size_t size() const noexcept { return m_count; }
+    inline size_t block_count() const noexcept { return m_origins.size(); }
+
+    inline vec3x8* origins() noexcept { return m_origins.data(); }
+    inline vec3x8* directions() noexcept { return m_directions.data(); }
+    inline float8* times() noexcept { return m_times.data(); }
+
+    inline const vec3x8* origins() const noexcept { return m_origins.data(); }
+    inline const vec3x8* directions() const noexcept { return m_directions.data(); }
+    inline const float8* times() const noexcept { return m_times.data(); }
+
+    /**
+     * Ray `i` on its own. Directions are stored unit length, so none is normalized again.
+     */
+    inline ray get(const size_t i) const noexcept
+    {
+        const size_t block = i / 8;
+        const int lane = int(i % 8);
+        return ray::from_unit(m_origins[block].get(lane), m_directions[block].get(lane), m_times[block][lane]);
+    }
+
+private:
+
+    std::vector<vec3x8> m_origins;
+    std::vector<vec3x8> m_directions;
+    std::vector<float8> m_times;
+    size_t m_count = 0;
+};
\ No newline at end of file
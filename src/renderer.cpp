@@ -1,129 +1,232 @@
+#include <algorithm>
 #include <cassert>
-#include <thread>
 #include "renderer.hpp"
-
-static void render_thread(unsigned int, Image*, const Camera*, const World*, const size_t);
-static void average_images_thread(Image*, Image*);
-
-Renderer::Renderer(RenderArgs args) :
-    m_args(args)
+#include "denoiser.hpp"
+#include "trace.hpp"
+
+// Rays generated per batch
+constexpr size_t RAY_BATCH_SIZE = 4096;
+
+static void render_tile(const size_t, Image*, const Camera*, const World*, const size_t, const bool, RayStats*);
+static float color_heatmap(Image&, const Heatmap, const float, ThreadPool&);
+
+/**
+ * Stores pixel `index` of `tile`'s AOVs: the first sample's depth and material, and the sums of
+ * the normals, albedos and squared luminances.
+ */
+static inline void store_aovs(
+    Image* image,
+    const size_t tile,
+    const size_t index,
+    const FirstHit& first,
+    const vec3& normal_sum,
+    const color& albedo_sum,
+    const float luminance_squared_sum
+)
 {
-    assert(m_args.width > 0 && m_args.height > 0);
-    assert(m_args.thread_count > 0 && (m_args.thread_count & (m_args.thread_count - 1)) == 0);
-}
+    if (image->has_aov(Aov::Depth))
+        image->aov_tile(Aov::Depth, tile)[index] = first.depth;
+    if (image->has_aov(Aov::MaterialId))
+        image->aov_tile(Aov::MaterialId, tile)[index] = first.material;
+    if (image->has_aov(Aov::Variance))
+        image->aov_tile(Aov::Variance, tile)[index] = luminance_squared_sum;
+
+    if (image->has_aov(Aov::Normal))
+    {
+        float* normal = image->aov_tile(Aov::Normal, tile) + index * 3;
+        normal[0] = normal_sum.x();
+        normal[1] = normal_sum.y();
+        normal[2] = normal_sum.z();
+    }
 
-Image Renderer::render(const Camera& camera, const World& world)
-{
-    auto images = render_images(camera, world);
-    return average_images(std::move(images));
+    if (image->has_aov(Aov::Albedo))
+    {
+        float* albedo = image->aov_tile(Aov::Albedo, tile) + index * 3;
+        albedo[0] = albedo_sum.x();
+        albedo[1] = albedo_sum.y();
+        albedo[2] = albedo_sum.z();
+    }
 }
 
-std::vector<Image> Renderer::render_images(const Camera& camera, const World& world)
+Renderer::Renderer(RenderArgs args) :
+    m_args(args),
+    m_pool(args.thread_count)
 {
-    // Threads dispatch based on image samples
-    std::vector<Image> images = {};
-    std::vector<std::thread> threads = {};
-    const size_t samples_per_thread = m_args.samples / m_args.thread_count;
-
-    // Create images
-    for (size_t i = 0; i < m_args.thread_count; i++)
-        images.push_back(Image(m_args.width, m_args.height));
+    assert(m_args.width > 0 && m_args.height > 0);
+    assert(m_args.thread_count > 0);
 
-    // Create render threads
-    for (size_t i = 0; i < m_args.thread_count; i++)
+    if (m_args.heatmap != Heatmap::None)
     {
-        std::thread thread(
-            render_thread, 
-            i,
-            &images[i],
-            &camera,
-            &world,
-            samples_per_thread + (
-                i == m_args.thread_count - 1
-                ? m_args.samples % m_args.thread_count
-                : 0
-            )
-        );
-        threads.push_back(std::move(thread));
+        m_args.aovs = 0;
+        m_args.denoise = false;
     }
 
-    // Wait for threads to complete
-    for (auto& thread : threads)
-        thread.join();
-
-    return std::move(images);
+    if (m_args.denoise)
+        m_args.aovs |= DENOISE_AOVS;
 }
 
-Image Renderer::average_images(std::vector<Image> src)
+Image Renderer::render(const Camera& camera, const World& world)
 {
-    std::vector<std::thread> threads = {};
+    TRACE_SCOPE("render");
+    Image image(m_args.width, m_args.height, m_args.aovs);
+    std::vector<RayStats> tile_stats(image.tile_count());
+    const bool heatmap = m_args.heatmap != Heatmap::None;
 
-    // We average together the images by powers of 2. The final image will be at images[0]
-    size_t offset = 2;
-    size_t count = m_args.thread_count / 2;
-    while (count != 0)
+    // Workers take tiles as they finish them, each writing only to its own tile's cache lines
+    m_pool.parallel_for(image.tile_count(), [&](const size_t tile)
     {
-        // Spawn threads to average the images
-        for (size_t i = 0; i < m_args.thread_count; i += offset)
-        {
-            std::thread thread(
-                average_images_thread,
-                &src[i],
-                &src[i + (offset / 2)]
-            );
-            threads.push_back(std::move(thread));
-        }
+        render_tile(tile, &image, &camera, &world, m_args.samples, heatmap, &tile_stats[tile]);
+    });
 
-        // Wait for the averaging to finish
-        for (auto& thread : threads)
-            thread.join();
-        threads.clear();
+    m_stats = RayStats();
+    for (const auto& stats : tile_stats)
+        m_stats.merge(stats);
 
-        offset *= 2;
-        count /= 2;
-    }
+    if (heatmap)
+        m_heatmap_scale = color_heatmap(image, m_args.heatmap, m_args.heatmap_scale, m_pool);
+    if (m_args.denoise)
+        denoise(image, m_pool);
 
-    return std::move(src[0]);
+    return image;
 }
 
-void render_thread(
-    unsigned int thread_id,
-    Image* image, 
-    const Camera* camera, 
+void render_tile(
+    const size_t tile,
+    Image* image,
+    const Camera* camera,
     const World* world,
-    const size_t samples_per_pixel
+    const size_t samples_per_pixel,
+    const bool heatmap,
+    RayStats* stats
 )
 {
-    seed_random_float(thread_id);
+    TRACE_SCOPE_ARG("tile", "tile", tile);
+
+    // Seeded by tile so the image doesn't depend on which worker rendered what
+    seed_random_stream(tile);
+    g_ray_stats = RayStats();
+
+    const PixelRect rect = image->tile_rect(tile);
+    Pixel* pixels = image->tile(tile).pixels;
 
-    const size_t width = image->width();
-    const size_t height = image->height();
+    // The sample count is already in every pixel, so it alone doesn't need first hits
+    const bool capture = (image->aovs() & ~aov_bit(Aov::SampleCount)) != 0;
 
-    for (size_t y = 0; y < height; y++)
+    // Rays are generated a few rows of the tile at a time, small enough for the batch to stay in
+    // cache. Each worker keeps its batch between tiles
+    const size_t rows = std::max<size_t>(1, RAY_BATCH_SIZE / (rect.width * samples_per_pixel));
+    thread_local RayBatch batch;
+
+    for (size_t y0 = 0; y0 < rect.height; y0 += rows)
     {
-        for (size_t x = 0; x < width; x++)
+        const PixelRect run = { rect.x, rect.y + y0, rect.width, std::min(rows, rect.height - y0) };
+        camera->generate_rays(run, image->width(), image->height(), samples_per_pixel, batch);
+
+        for (size_t i = 0; i < run.pixel_count(); i++)
         {
+            const size_t index = (y0 + i / run.width) * Image::TILE_SIZE + i % run.width;
             auto pixel_color = color(0, 0, 0);
 
-            for (size_t i = 0; i < samples_per_pixel; i++)
+            if (heatmap)
+            {
+                // Only the camera ray is traced. Its work is read off the counters around it
+                for (size_t s = 0; s < samples_per_pixel; s++)
+                {
+                    const RayStats before = g_ray_stats;
+                    HitRecord record;
+                    RAY_STAT(paths, 1);
+                    world->hit(batch.get(i * samples_per_pixel + s), World::T_MIN, World::T_MAX, record);
+                    pixel_color += color(
+                        float(g_ray_stats.nodes_visited - before.nodes_visited),
+                        float(g_ray_stats.primitive_tests - before.primitive_tests),
+                        0.0f
+                    );
+                }
+            }
+            else if (capture)
+            {
+                FirstHit first = {};
+                vec3 normal_sum(0, 0, 0);
+                color albedo_sum(0, 0, 0);
+                float luminance_squared_sum = 0.0f;
+                for (size_t s = 0; s < samples_per_pixel; s++)
+                {
+                    FirstHit hit;
+                    const color sample = world->ray_color(batch.get(i * samples_per_pixel + s), &hit);
+                    const float l = luminance(sample.x(), sample.y(), sample.z());
+                    pixel_color += sample;
+                    luminance_squared_sum += l * l;
+                    normal_sum += hit.normal;
+                    albedo_sum += hit.albedo;
+                    if (s == 0)
+                        first = hit;
+                }
+                store_aovs(image, tile, index, first, normal_sum, albedo_sum, luminance_squared_sum);
+            }
+            else
             {
-                const auto u = (float(x) + random_float()) / float(width - 1);
-                const auto v = (float(y) + random_float()) / float(height - 1);
-                const auto r = camera->screen_to_world(u, v);
-                pixel_color += world->ray_color(r);
+                for (size_t s = 0; s < samples_per_pixel; s++)
+                    pixel_color += world->ray_color(batch.get(i * samples_per_pixel + s));
             }
 
-            // Gamma correct
-            const auto scale = 1.0f / float(samples_per_pixel);
-            pixel_color.e[0] = std::sqrt(scale * pixel_color.e[0]);
-            pixel_color.e[1] = std::sqrt(scale * pixel_color.e[1]);
-            pixel_color.e[2] = std::sqrt(scale * pixel_color.e[2]);
-            image->set_pixel(x, y, pixel_color);
+            // Linear sums are kept until the image is resolved for display
+            pixels[index] = Pixel { pixel_color.x(), pixel_color.y(), pixel_color.z(), float(samples_per_pixel) };
         }
     }
+
+    *stats = g_ray_stats;
 }
 
-void average_images_thread(Image* dst, Image* src)
+/**
+ * Black through blue, cyan, green and yellow to red as `t` goes from 0 to 1.
+ */
+static inline color heat_ramp(const float t)
 {
-    dst->average(*src);
+    static const color STOPS[] = {
+        color(0.0f, 0.0f, 0.0f), color(0.0f, 0.0f, 1.0f), color(0.0f, 1.0f, 1.0f),
+        color(0.0f, 1.0f, 0.0f), color(1.0f, 1.0f, 0.0f), color(1.0f, 0.0f, 0.0f)
+    };
+    constexpr size_t SEGMENTS = sizeof(STOPS) / sizeof(STOPS[0]) - 1;
+
+    const float x = std::min(std::max(t, 0.0f), 1.0f) * float(SEGMENTS);
+    const size_t i = std::min(size_t(x), SEGMENTS - 1);
+    const float f = x - float(i);
+    return (1.0f - f) * STOPS[i] + f * STOPS[i + 1];
+}
+
+/**
+ * Replaces the node and primitive test counts `render_tile` summed into each pixel's red and
+ * green with `heatmap`'s value on the color ramp, keeping the sample counts. Returns the value at
+ * the top of the ramp: `scale`, or the image's highest value when `scale` is 0.
+ */
+float color_heatmap(Image& image, const Heatmap heatmap, const float scale, ThreadPool& pool)
+{
+    TRACE_SCOPE("color heatmap");
+    const auto value = [heatmap](const Pixel& p)
+    {
+        const float sum = heatmap == Heatmap::Nodes ? p.r : heatmap == Heatmap::Primitives ? p.g : p.r + p.g;
+        return p.a > 0.0f ? sum / p.a : 0.0f;
+    };
+
+    float top = scale;
+    if (top <= 0.0f)
+    {
+        for (size_t tile = 0; tile < image.tile_count(); tile++)
+        {
+            for (const Pixel& p : image.tile(tile).pixels)
+                top = std::max(top, value(p));
+        }
+    }
+
+    const float inv_top = top > 0.0f ? 1.0f / top : 0.0f;
+    pool.parallel_for(image.tile_count(), [&](const size_t tile)
+    {
+        for (Pixel& p : image.tile(tile).pixels)
+        {
+            const color c = heat_ramp(value(p) * inv_top) * p.a;
+            p = Pixel { c.x(), c.y(), c.z(), p.a };
+        }
+    });
+
+    return top;
 }
\ No newline at end of file
@@ -6,6 +6,26 @@
 #include "image.hpp"
 #include "world.hpp"
 #include "camera.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * What a heatmap render shows for each camera ray in place of radiance.
+ */
+enum class Heatmap
+{
+    // A normal render
+    None,
+
+    // BVH nodes whose boxes the ray entered
+    Nodes,
+
+    // Primitives the ray was tested against
+    Primitives,
+
+    // Nodes and primitive tests together, the work SAH estimates
+    Cost
+};
 
 struct RenderArgs
 {
@@ -13,33 +33,60 @@ struct RenderArgs
     size_t samples;
     size_t width;
     size_t height;
+
+    // Applied when the image is saved rather than while rendering
+    ResolveSettings resolve = {};
+
+    // Planes captured alongside the beauty pass
+    AovMask aovs = 0;
+
+    // Filter the noise out of the beauty pass once it's rendered
+    bool denoise = false;
+
+    // Traversal work of the camera rays alone, false colored with `heatmap_scale` at the top of
+    // the ramp, or the image's highest value when it's 0. Heatmaps capture no AOVs and aren't
+    // denoised
+    Heatmap heatmap = Heatmap::None;
+    float heatmap_scale = 0.0f;
 };
 
 class Renderer
 {
 public:
 
+    /**
+     * Starts `args.thread_count` worker threads, which are reused by every call to `render`.
+     * Denoising adds the AOVs it needs to those rendered.
+     */
     Renderer(RenderArgs args);
 
     /**
      * Renders the `world` from the perspective of the `camera` using the render settings sent
-     * to the constructor of the renderer. The final image is returned.
+     * to the constructor of the renderer. Workers take the image's tiles one at a time and trace
+     * every sample of a tile's pixels. The image returned holds linear radiance sums, denoised
+     * when the settings ask for it.
      */
     Image render(const Camera& camera, const World& world);
 
-private:
+    /**
+     * Ray statistics merged from every tile of the last call to `render`.
+     */
+    inline const RayStats& stats() const noexcept { return m_stats; }
 
     /**
-     * Renders a set of images with samples distributed across multiple threads. These images can
-     * be averaged together to produce a final image.
+     * The value at the top of the color ramp of the last heatmap rendered.
      */
-    std::vector<Image> render_images(const Camera& camera, const World& world);
+    inline float heatmap_scale() const noexcept { return m_heatmap_scale; }
 
     /**
-     * Takes every image from `src` and returns the average image. This process is destructive to
-     * the images in `src`.
+     * The render workers, idle between calls to `render`, for other work such as encoding output.
      */
-    Image average_images(std::vector<Image> src);
+    inline ThreadPool& pool() noexcept { return m_pool; }
+
+private:
 
     RenderArgs m_args;
+    RayStats m_stats;
+    float m_heatmap_scale = 0.0f;
+    ThreadPool m_pool;
 };
\ No newline at end of file
@@ -0,0 +1,442 @@
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "scene_description.hpp"
+#include "json.hpp"
+#include "mapped_file.hpp"
+#include "mesh_loader.hpp"
+#include "sphere.hpp"
+
+[[noreturn]] static void scene_error(const JsonValue& value, const std::string& what)
+{
+    throw std::runtime_error("scene error on line " + std::to_string(value.line()) + ": " + what);
+}
+
+static const JsonValue& expect_type(const JsonValue& value, const JsonValue::Type type, const char* name)
+{
+    if (value.type() != type)
+    {
+        scene_error(value, std::string("'") + name + "' must be " + JsonValue::type_name(type)
+            + ", not " + JsonValue::type_name(value.type()));
+    }
+    return value;
+}
+
+/**
+ * Rejects members of `object` that aren't in `allowed`, which catches typos in key names.
+ */
+static void check_keys(const JsonValue& object, std::initializer_list<const char*> allowed, const char* name)
+{
+    for (const auto& member : object.as_object())
+    {
+        bool known = false;
+        for (const char* key : allowed) known |= member.first == key;
+
+        if (!known)
+            scene_error(member.second, "unknown key '" + member.first + "' in " + name);
+    }
+}
+
+static const JsonValue& require(const JsonValue& object, const char* key, const char* name)
+{
+    const JsonValue* value = object.find(key);
+    if (value == nullptr)
+        scene_error(object, std::string(name) + " is missing '" + key + "'");
+    return *value;
+}
+
+static float read_float(const JsonValue& value, const char* name)
+{
+    const double number = expect_type(value, JsonValue::Type::Number, name).as_number();
+    if (!std::isfinite(number) || std::abs(number) > double(std::numeric_limits<float>::max()))
+        scene_error(value, std::string("'") + name + "' is out of range");
+    return float(number);
+}
+
+static size_t read_count(const JsonValue& value, const char* name, const size_t min, const size_t max)
+{
+    const double number = expect_type(value, JsonValue::Type::Number, name).as_number();
+    if (number != std::floor(number) || number < double(min) || number > double(max))
+    {
+        scene_error(value, std::string("'") + name + "' must be a whole number from "
+            + std::to_string(min) + " to " + std::to_string(max));
+    }
+    return size_t(number);
+}
+
+static vec3 read_vec3(const JsonValue& value, const char* name)
+{
+    const auto& arr = expect_type(value, JsonValue::Type::Array, name).as_array();
+    if (arr.size() != 3)
+        scene_error(value, std::string("'") + name + "' must have three components");
+    return vec3(read_float(arr[0], name), read_float(arr[1], name), read_float(arr[2], name));
+}
+
+static std::string resolve_path(const std::string& scene_path, const std::string& path)
+{
+    const bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\'))
+        || (path.size() > 1 && path[1] == ':');
+    if (absolute)
+        return path;
+
+    const auto slash = scene_path.find_last_of("/\\");
+    return slash == std::string::npos ? path : scene_path.substr(0, slash + 1) + path;
+}
+
+/**
+ * Overrides the members of `camera` that `value` sets.
+ */
+static void read_camera_fields(const JsonValue& value, CameraSettings& camera)
+{
+    if (const auto* v = value.find("look_from")) camera.eye = read_vec3(*v, "look_from");
+    if (const auto* v = value.find("look_at")) camera.target = read_vec3(*v, "look_at");
+    if (const auto* v = value.find("up")) camera.up = read_vec3(*v, "up");
+    if (const auto* v = value.find("vfov")) camera.vfov = read_float(*v, "vfov");
+    if (const auto* v = value.find("aperture")) camera.aperture = read_float(*v, "aperture");
+    if (const auto* v = value.find("focus_distance")) camera.focus_distance = read_float(*v, "focus_distance");
+
+    if (camera.vfov <= 0.0f || camera.vfov >= 180.0f)
+        scene_error(value, "'vfov' must be between 0 and 180 degrees");
+    if ((camera.eye - camera.target).near_zero() || vec3::cross(camera.up, camera.eye - camera.target).near_zero())
+        scene_error(value, "camera 'look_from', 'look_at' and 'up' don't define a view");
+    if (!(camera.aperture >= 0.0f) || !(camera.focus_distance >= 0.0f))
+        scene_error(value, "camera 'aperture' and 'focus_distance' can't be negative");
+}
+
+static void read_camera(const JsonValue& value, CameraSettings& camera)
+{
+    expect_type(value, JsonValue::Type::Object, "camera");
+    check_keys(value, { "look_from", "look_at", "up", "vfov", "aperture", "focus_distance", "shutter" }, "camera");
+    read_camera_fields(value, camera);
+
+    // Open and close times within the frame, which moving objects are blurred between
+    if (const auto* shutter = value.find("shutter"))
+    {
+        const auto& arr = expect_type(*shutter, JsonValue::Type::Array, "shutter").as_array();
+        if (arr.size() != 2)
+            scene_error(*shutter, "'shutter' must have an open and a close time");
+
+        camera.shutter_open = read_float(arr[0], "shutter");
+        camera.shutter_close = read_float(arr[1], "shutter");
+        if (!(camera.shutter_open >= 0.0f && camera.shutter_open <= camera.shutter_close && camera.shutter_close <= 1.0f))
+            scene_error(*shutter, "'shutter' times must be in order and between 0 and 1");
+    }
+}
+
+static void read_camera_path(const JsonValue& value, const CameraSettings& camera, CameraPath& path)
+{
+    CameraSettings settings = camera;
+    for (const auto& key : expect_type(value, JsonValue::Type::Array, "camera_path").as_array())
+    {
+        expect_type(key, JsonValue::Type::Object, "camera keyframe");
+        check_keys(key, { "time", "look_from", "look_at", "up", "vfov", "aperture", "focus_distance" }, "camera keyframe");
+        const float time = read_float(require(key, "time", "camera keyframe"), "time");
+        read_camera_fields(key, settings);
+
+        if (!path.empty() && !(time > path.end_time()))
+            scene_error(key, "camera keyframe 'time' must be after the one before it");
+        path.add_keyframe(time, settings);
+    }
+}
+
+static void read_render(const JsonValue& value, RenderArgs& render)
+{
+    constexpr size_t MAX_DIMENSION = 1 << 16;
+
+    expect_type(value, JsonValue::Type::Object, "render");
+    check_keys(value, { "width", "height", "samples", "threads", "exposure", "tonemap", "aovs", "denoise", "heatmap", "heatmap_scale" }, "render");
+
+    if (const auto* v = value.find("width")) render.width = read_count(*v, "width", 1, MAX_DIMENSION);
+    if (const auto* v = value.find("height")) render.height = read_count(*v, "height", 1, MAX_DIMENSION);
+    if (const auto* v = value.find("samples")) render.samples = read_count(*v, "samples", 1, 1 << 20);
+    if (const auto* v = value.find("threads")) render.thread_count = read_count(*v, "threads", 1, 1024);
+    if (const auto* v = value.find("exposure")) render.resolve.exposure = read_float(*v, "exposure");
+
+    if (const auto* v = value.find("tonemap"))
+    {
+        const auto& op = expect_type(*v, JsonValue::Type::String, "tonemap").as_string();
+        if (op == "none") render.resolve.tonemap = Tonemap::None;
+        else if (op == "reinhard") render.resolve.tonemap = Tonemap::Reinhard;
+        else if (op == "aces") render.resolve.tonemap = Tonemap::Aces;
+        else scene_error(*v, "'tonemap' must be \"none\", \"reinhard\" or \"aces\"");
+    }
+
+    if (const auto* v = value.find("aovs"))
+    {
+        render.aovs = 0;
+        for (const auto& name : expect_type(*v, JsonValue::Type::Array, "aovs").as_array())
+        {
+            const auto& aov = expect_type(name, JsonValue::Type::String, "aovs").as_string();
+            if (aov == "depth") render.aovs |= aov_bit(Aov::Depth);
+            else if (aov == "normal") render.aovs |= aov_bit(Aov::Normal);
+            else if (aov == "albedo") render.aovs |= aov_bit(Aov::Albedo);
+            else if (aov == "material_id") render.aovs |= aov_bit(Aov::MaterialId);
+            else if (aov == "variance") render.aovs |= aov_bit(Aov::Variance);
+            else if (aov == "sample_count") render.aovs |= aov_bit(Aov::SampleCount);
+            else scene_error(name, "'aovs' can hold \"depth\", \"normal\", \"albedo\", \"material_id\", \"variance\" and \"sample_count\"");
+        }
+    }
+
+    if (const auto* v = value.find("denoise"))
+        render.denoise = expect_type(*v, JsonValue::Type::Bool, "denoise").as_bool();
+
+    if (const auto* v = value.find("heatmap"))
+    {
+        const auto& metric = expect_type(*v, JsonValue::Type::String, "heatmap").as_string();
+        if (metric == "none") render.heatmap = Heatmap::None;
+        else if (metric == "nodes") render.heatmap = Heatmap::Nodes;
+        else if (metric == "primitives") render.heatmap = Heatmap::Primitives;
+        else if (metric == "cost") render.heatmap = Heatmap::Cost;
+        else scene_error(*v, "'heatmap' must be \"none\", \"nodes\", \"primitives\" or \"cost\"");
+    }
+
+    if (const auto* v = value.find("heatmap_scale"))
+    {
+        render.heatmap_scale = read_float(*v, "heatmap_scale");
+        if (!(render.heatmap_scale > 0.0f))
+            scene_error(*v, "'heatmap_scale' must be positive");
+    }
+}
+
+static MaterialId read_material(const JsonValue& value, const char* name, World& world)
+{
+    expect_type(value, JsonValue::Type::Object, name);
+    const auto& type = expect_type(require(value, "type", name), JsonValue::Type::String, "type").as_string();
+
+    if (type == "lambertian")
+    {
+        check_keys(value, { "type", "albedo" }, name);
+        return world.add_material(Lambertian(read_vec3(require(value, "albedo", name), "albedo")));
+    }
+
+    if (type == "metal")
+    {
+        check_keys(value, { "type", "albedo", "roughness" }, name);
+        const auto* roughness = value.find("roughness");
+        return world.add_material(Metal(
+            read_vec3(require(value, "albedo", name), "albedo"),
+            roughness != nullptr ? read_float(*roughness, "roughness") : 0.0f
+        ));
+    }
+
+    if (type == "dielectric")
+    {
+        check_keys(value, { "type", "ior" }, name);
+        const float ior = read_float(require(value, "ior", name), "ior");
+        if (ior <= 0.0f)
+            scene_error(value, "'ior' must be positive");
+        return world.add_material(Dielectric(ior));
+    }
+
+    scene_error(value, "unknown material type '" + type + "'");
+}
+
+static MeshLayout read_layout(const JsonValue& object)
+{
+    const auto* value = object.find("layout");
+    if (value == nullptr)
+        return MeshLayout::Triangles;
+
+    const auto& layout = expect_type(*value, JsonValue::Type::String, "layout").as_string();
+    if (layout == "packets") return MeshLayout::Packets;
+    if (layout == "triangles") return MeshLayout::Triangles;
+    scene_error(*value, "'layout' must be \"packets\" or \"triangles\"");
+}
+
+/**
+ * Where a scene's objects are read from and added to: the world itself, or one of the named
+ * shapes it instances.
+ */
+struct ObjectContext
+{
+    const char* scene_path;
+    ThreadPool& pool;
+    const std::unordered_map<std::string, MaterialId>& materials;
+    const std::unordered_map<std::string, std::shared_ptr<const Shape>>& shapes;
+};
+
+/**
+ * Scale, then rotation, then translation, or a full matrix given as twelve row-major values.
+ */
+static Transform read_transform(const JsonValue& object)
+{
+    if (const auto* matrix = object.find("matrix"))
+    {
+        if (object.find("translate") || object.find("rotate") || object.find("scale"))
+            scene_error(*matrix, "'matrix' can't be combined with 'translate', 'rotate' or 'scale'");
+
+        const auto& arr = expect_type(*matrix, JsonValue::Type::Array, "matrix").as_array();
+        if (arr.size() != 12)
+            scene_error(*matrix, "'matrix' must have twelve values, three rows of four");
+
+        float rows[12];
+        for (size_t i = 0; i < 12; i++) rows[i] = read_float(arr[i], "matrix");
+        return Transform::from_rows(rows);
+    }
+
+    Transform transform;
+    if (const auto* scale = object.find("scale"))
+    {
+        if (scale->type() == JsonValue::Type::Number)
+        {
+            const float s = read_float(*scale, "scale");
+            transform = Transform::scale(vec3(s, s, s));
+        }
+        else
+        {
+            transform = Transform::scale(read_vec3(*scale, "scale"));
+        }
+    }
+
+    if (const auto* rotate = object.find("rotate"))
+    {
+        expect_type(*rotate, JsonValue::Type::Object, "rotate");
+        check_keys(*rotate, { "axis", "degrees" }, "rotate");
+        const auto axis = read_vec3(require(*rotate, "axis", "rotate"), "axis");
+        if (axis.near_zero())
+            scene_error(*rotate, "rotation 'axis' must be non-zero");
+
+        transform = Transform::rotate(axis, read_float(require(*rotate, "degrees", "rotate"), "degrees")) * transform;
+    }
+
+    if (const auto* translate = object.find("translate"))
+        transform = Transform::translate(read_vec3(*translate, "translate")) * transform;
+
+    return transform;
+}
+
+template<typename Target> static void read_objects(const JsonValue& objects, const ObjectContext& ctx, Target& target)
+{
+    for (const auto& object : expect_type(objects, JsonValue::Type::Array, "objects").as_array())
+    {
+        expect_type(object, JsonValue::Type::Object, "object");
+        const auto& type = expect_type(require(object, "type", "object"), JsonValue::Type::String, "type").as_string();
+
+        if (type == "instance")
+        {
+            check_keys(object, { "type", "shape", "translate", "rotate", "scale", "matrix" }, "instance");
+            const auto& shape_name = expect_type(require(object, "shape", "instance"), JsonValue::Type::String, "shape");
+            const auto shape = ctx.shapes.find(shape_name.as_string());
+            if (shape == ctx.shapes.end())
+                scene_error(shape_name, "undefined shape '" + shape_name.as_string() + "'");
+
+            const auto to_world = read_transform(object);
+            try
+            {
+                target.add_instance(shape->second, to_world);
+            }
+            catch (const std::runtime_error& e)
+            {
+                scene_error(object, e.what());
+            }
+            continue;
+        }
+
+        const auto& mat_name = expect_type(require(object, "material", type.c_str()), JsonValue::Type::String, "material");
+        const auto mat = ctx.materials.find(mat_name.as_string());
+        if (mat == ctx.materials.end())
+            scene_error(mat_name, "undefined material '" + mat_name.as_string() + "'");
+
+        if (type == "sphere")
+        {
+            check_keys(object, { "type", "material", "center", "center_end", "radius" }, "sphere");
+            const float radius = read_float(require(object, "radius", "sphere"), "radius");
+            if (radius == 0.0f)
+                scene_error(object, "sphere 'radius' must be non-zero");
+
+            // A sphere with an end center moves there while the shutter is open
+            const auto center = read_vec3(require(object, "center", "sphere"), "center");
+            const auto* center_end = object.find("center_end");
+            target.add_object(Sphere(center, center_end ? read_vec3(*center_end, "center_end") : center, radius, mat->second));
+        }
+        else if (type == "mesh")
+        {
+            check_keys(object, { "type", "material", "path", "layout" }, "mesh");
+            const auto& mesh_path = expect_type(require(object, "path", "mesh"), JsonValue::Type::String, "path");
+            const auto layout = read_layout(object);
+
+            try
+            {
+                target.add_mesh(load_mesh(resolve_path(ctx.scene_path, mesh_path.as_string()).c_str(), ctx.pool), mat->second, layout);
+            }
+            catch (const std::runtime_error& e)
+            {
+                scene_error(mesh_path, e.what());
+            }
+        }
+        else if (type == "uv_sphere")
+        {
+            check_keys(object, { "type", "material", "center", "radius", "rings", "segments", "layout" }, "uv_sphere");
+            const auto* rings = object.find("rings");
+            const auto* segments = object.find("segments");
+
+            target.add_mesh(
+                TriangleMesh::uv_sphere(
+                    read_vec3(require(object, "center", "uv_sphere"), "center"),
+                    read_float(require(object, "radius", "uv_sphere"), "radius"),
+                    uint32_t(rings != nullptr ? read_count(*rings, "rings", 2, 1 << 14) : 32),
+                    uint32_t(segments != nullptr ? read_count(*segments, "segments", 3, 1 << 14) : 64)
+                ),
+                mat->second,
+                read_layout(object)
+            );
+        }
+        else
+        {
+            scene_error(object, "unknown object type '" + type + "'");
+        }
+    }
+}
+
+SceneDescription load_scene_description(const char* path, ThreadPool& pool, const BvhBuilder builder)
+{
+    const MappedFile file(path);
+    const auto doc = JsonValue::parse(file.data(), file.data() + file.size());
+
+    expect_type(doc, JsonValue::Type::Object, "scene");
+    check_keys(doc, { "camera", "camera_path", "render", "materials", "shapes", "objects" }, "scene");
+
+    SceneDescription scene;
+    auto& world = scene.world;
+
+    if (const auto* camera = doc.find("camera")) read_camera(*camera, scene.camera);
+    if (const auto* path = doc.find("camera_path")) read_camera_path(*path, scene.camera, scene.camera_path);
+    if (const auto* render = doc.find("render")) read_render(*render, scene.render);
+
+    std::unordered_map<std::string, MaterialId> materials = {};
+    if (const auto* mats = doc.find("materials"))
+    {
+        for (const auto& member : expect_type(*mats, JsonValue::Type::Object, "materials").as_object())
+            materials[member.first] = read_material(member.second, member.first.c_str(), world);
+    }
+
+    std::unordered_map<std::string, std::shared_ptr<const Shape>> shapes = {};
+    const ObjectContext ctx = { path, pool, materials, shapes };
+
+    // Shapes are built in the order they're written, so a shape can only instance earlier ones
+    if (const auto* defs = doc.find("shapes"))
+    {
+        for (const auto& member : expect_type(*defs, JsonValue::Type::Object, "shapes").as_object())
+        {
+            expect_type(member.second, JsonValue::Type::Object, member.first.c_str());
+            check_keys(member.second, { "objects" }, member.first.c_str());
+
+            auto shape = std::make_shared<Shape>();
+            read_objects(require(member.second, "objects", member.first.c_str()), ctx, *shape);
+            if (shape->object_count() == 0)
+                scene_error(member.second, "shape '" + member.first + "' has no objects");
+
+            shape->compute_bvh(builder);
+            shapes[member.first] = std::move(shape);
+        }
+    }
+
+    if (const auto* objects = doc.find("objects"))
+        read_objects(*objects, ctx, world);
+
+    return scene;
+}
\ No newline at end of file
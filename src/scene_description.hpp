@@ -0,0 +1,59 @@
+#pragma once
+
+#include "world.hpp"
+#include "camera_path.hpp"
+#include "renderer.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Everything a scene file describes. Render settings the file leaves out keep the defaults below.
+ */
+struct SceneDescription
+{
+    World world;
+    CameraSettings camera;
+
+    // Empty unless the file keys the camera for rendering sequences
+    CameraPath camera_path;
+    RenderArgs render = { 4, 64, 560, 315 };
+};
+
+/**
+ * Reads a JSON scene description:
+ *
+ *     {
+ *         "camera": { "look_from": [13, 2, 3], "look_at": [0, 0, 0], "up": [0, 1, 0], "vfov": 20 },
+ *         "camera_path": [
+ *             { "time": 0, "look_from": [13, 2, 3] },
+ *             { "time": 2, "look_from": [0, 4, 12], "vfov": 30 }
+ *         ],
+ *         "render": { "width": 560, "height": 315, "samples": 64, "threads": 4, "exposure": 0, "tonemap": "aces",
+ *                     "aovs": ["depth", "normal"], "denoise": true },
+ *         "materials": {
+ *             "ground": { "type": "lambertian", "albedo": [0.8, 0.8, 0.8] },
+ *             "gold": { "type": "metal", "albedo": [0.8, 0.6, 0.2], "roughness": 0.1 },
+ *             "glass": { "type": "dielectric", "ior": 1.5 }
+ *         },
+ *         "shapes": {
+ *             "tree": { "objects": [ { "type": "mesh", "path": "tree.obj", "material": "ground" } ] }
+ *         },
+ *         "objects": [
+ *             { "type": "sphere", "center": [0, 1, 0], "radius": 1, "material": "glass" },
+ *             { "type": "mesh", "path": "bunny.ply", "material": "gold", "layout": "packets" },
+ *             { "type": "uv_sphere", "center": [4, 1, 0], "radius": 1, "rings": 64, "segments": 128,
+ *               "material": "ground" },
+ *             { "type": "instance", "shape": "tree", "scale": 2, "rotate": { "axis": [0, 1, 0], "degrees": 30 },
+ *               "translate": [-4, 0, 0] }
+ *         ]
+ *     }
+ *
+ * Every section is optional. Camera path keyframes leave out whatever doesn't change since the
+ * keyframe before, the first one starting from "camera", and are in increasing time. Shapes are object lists with their own BVH that instances place with
+ * a scale, rotation and translation, applied in that order, or a 3x4 row-major "matrix". A shape
+ * may instance the shapes defined before it, and their BVHs are built with `builder`. Mesh paths are relative to the scene file and are loaded on `pool`.
+ * Meshes use the watertight "triangles" layout unless "layout" asks for "packets".
+ * The world is built while the document is walked, so it is ready once this returns apart from
+ * its BVH. Throws `std::runtime_error` naming the offending line on unknown keys, wrong types,
+ * bad values or references to undefined materials or shapes.
+ */
+SceneDescription load_scene_description(const char* path, ThreadPool& pool, const BvhBuilder builder = BvhBuilder::Sah);
\ No newline at end of file
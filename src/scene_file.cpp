@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "scene_file.hpp"
+#include "mapped_file.hpp"
+#include "sphere.hpp"
+#include "triangle_mesh.hpp"
+
+struct SectionData
+{
+    SceneSectionType type;
+    uint32_t record_size;
+    uint64_t count;
+    const void* data;
+};
+
+template<typename T> static SectionData section(const SceneSectionType type, const T* data, const size_t count)
+{
+    return SectionData { type, uint32_t(sizeof(T)), uint64_t(count), data };
+}
+
+static inline uint64_t align_up(const uint64_t offset)
+{
+    return (offset + SCENE_SECTION_ALIGNMENT - 1) / SCENE_SECTION_ALIGNMENT * SCENE_SECTION_ALIGNMENT;
+}
+
+static uint32_t to_u32(const size_t value, const char* what)
+{
+    if (value > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error(std::string("too many ") + what + " for the scene format");
+    return uint32_t(value);
+}
+
+static SceneMaterialRecord material_record(const Material& mat)
+{
+    SceneMaterialRecord rec = {};
+    color albedo;
+
+    if (const auto* lambertian = dynamic_cast<const Lambertian*>(&mat))
+    {
+        rec.type = SceneMaterialType::Lambertian;
+        albedo = lambertian->get_albedo();
+    }
+    else if (const auto* metal = dynamic_cast<const Metal*>(&mat))
+    {
+        rec.type = SceneMaterialType::Metal;
+        albedo = metal->get_albedo();
+        rec.parameter = metal->get_roughness();
+    }
+    else if (const auto* dielectric = dynamic_cast<const Dielectric*>(&mat))
+    {
+        rec.type = SceneMaterialType::Dielectric;
+        rec.parameter = dielectric->get_index_of_refraction();
+    }
+    else
+    {
+        throw std::runtime_error("material type can't be saved in a scene file");
+    }
+
+    for (int i = 0; i < 3; i++) rec.albedo[i] = albedo[i];
+    return rec;
+}
+
+/**
+ * Appends every shape `shape` instances, then `shape` itself, skipping ones already listed.
+ * Reversed, the list has each shape before all of the shapes it instances.
+ */
+static void collect_shapes(const Shape* shape, std::vector<const Shape*>& order, std::unordered_set<const Shape*>& seen)
+{
+    if (!seen.insert(shape).second)
+        return;
+
+    for (const auto& object : shape->objects())
+    {
+        if (const auto* instance = dynamic_cast<const Instance*>(object.get()))
+            collect_shapes(instance->get_shape().get(), order, seen);
+    }
+    order.push_back(shape);
+}
+
+void save_scene(const World& world, const char* path)
+{
+    if (world.bvh().empty() && world.object_count() != 0)
+        throw std::runtime_error("the world's BVH must be built before saving it");
+
+    // Materials
+    std::vector<SceneMaterialRecord> materials = {};
+    for (const auto& mat : world.materials())
+        materials.push_back(material_record(*mat));
+
+    // Shapes, the world's first
+    std::vector<const Shape*> order = {};
+    std::unordered_set<const Shape*> seen = {};
+    collect_shapes(&world.root(), order, seen);
+    std::reverse(order.begin(), order.end());
+
+    std::unordered_map<const Shape*, uint32_t> shape_ids = {};
+    for (size_t i = 0; i < order.size(); i++)
+        shape_ids[order[i]] = to_u32(i, "shapes");
+
+    std::vector<SceneShapeRecord> shapes = {};
+    std::vector<SceneMeshRecord> meshes = {};
+    std::vector<point3> positions = {};
+    std::vector<vec3> normals = {};
+    std::vector<TexCoord> uvs = {};
+    std::vector<uint32_t> indices = {};
+    std::vector<SceneObjectRecord> objects = {};
+    std::vector<SceneInstanceRecord> instances = {};
+    std::vector<FlatBvhNode> nodes = {};
+    std::vector<uint32_t> primitives = {};
+
+    for (const Shape* shape : order)
+    {
+        const uint32_t shape_id = shape_ids[shape];
+        const auto& bvh = shape->bvh();
+
+        SceneShapeRecord shape_rec = {};
+        shape_rec.first_object = objects.size();
+        shape_rec.object_count = shape->object_count();
+        shape_rec.first_node = nodes.size();
+        shape_rec.node_count = bvh.nodes().size();
+        shape_rec.first_primitive = primitives.size();
+        shape_rec.primitive_count = bvh.primitives().size();
+        shapes.push_back(shape_rec);
+
+        nodes.insert(nodes.end(), bvh.nodes().begin(), bvh.nodes().end());
+        primitives.insert(primitives.end(), bvh.primitives().begin(), bvh.primitives().end());
+
+        // Meshes, with their buffers concatenated
+        std::unordered_map<const TriangleMesh*, uint32_t> mesh_ids = {};
+        for (const auto& mesh : shape->meshes())
+        {
+            SceneMeshRecord rec = {};
+            rec.first_position = positions.size();
+            rec.vertex_count = mesh->vertex_count();
+            rec.first_normal = normals.size();
+            rec.first_uv = uvs.size();
+            rec.first_index = indices.size();
+            rec.index_count = mesh->indices().size();
+            rec.has_normals = mesh->has_normals() ? 1 : 0;
+            rec.has_uvs = mesh->has_uvs() ? 1 : 0;
+            rec.shape = shape_id;
+
+            positions.insert(positions.end(), mesh->positions().begin(), mesh->positions().end());
+            normals.insert(normals.end(), mesh->normals().begin(), mesh->normals().end());
+            uvs.insert(uvs.end(), mesh->uvs().begin(), mesh->uvs().end());
+            indices.insert(indices.end(), mesh->indices().begin(), mesh->indices().end());
+
+            mesh_ids[mesh.get()] = to_u32(meshes.size(), "meshes");
+            meshes.push_back(rec);
+        }
+
+        const auto mesh_id = [&](const TriangleMesh* mesh)
+        {
+            const auto it = mesh_ids.find(mesh);
+            if (it == mesh_ids.end())
+                throw std::runtime_error("object refers to a mesh its shape doesn't own");
+            return it->second;
+        };
+
+        // Objects
+        for (const auto& ptr : shape->objects())
+        {
+            const Hittable* object = ptr.get();
+            SceneObjectRecord rec;
+            std::memset(&rec, 0, sizeof(rec));
+
+            if (const auto* sphere = dynamic_cast<const Sphere*>(object))
+            {
+                if (sphere->is_moving())
+                    throw std::runtime_error("scene files can't hold moving spheres");
+
+                rec.type = SceneObjectType::Sphere;
+                rec.material = to_u32(sphere->get_material(), "materials");
+                for (int k = 0; k < 3; k++) rec.sphere[k] = sphere->get_center()[k];
+                rec.sphere[3] = sphere->get_radius();
+            }
+            else if (const auto* triangle = dynamic_cast<const Triangle*>(object))
+            {
+                rec.type = SceneObjectType::Triangle;
+                rec.material = to_u32(triangle->get_material(), "materials");
+                rec.reference = mesh_id(triangle->get_mesh());
+                rec.count = 1;
+                rec.triangles[0] = triangle->get_index();
+            }
+            else if (const auto* packet = dynamic_cast<const TrianglePacket*>(object))
+            {
+                rec.type = SceneObjectType::TrianglePacket;
+                rec.material = to_u32(packet->get_material(), "materials");
+                rec.reference = mesh_id(packet->get_mesh());
+                rec.count = uint32_t(packet->get_count());
+                std::memcpy(rec.triangles, packet->get_indices(), sizeof(rec.triangles));
+            }
+            else if (const auto* instance = dynamic_cast<const Instance*>(object))
+            {
+                SceneInstanceRecord inst = {};
+                inst.shape = shape_ids[instance->get_shape().get()];
+                instance->get_transform().to_rows(inst.to_world);
+
+                rec.type = SceneObjectType::Instance;
+                rec.reference = to_u32(instances.size(), "instances");
+                instances.push_back(inst);
+            }
+            else
+            {
+                throw std::runtime_error("object type can't be saved in a scene file");
+            }
+
+            objects.push_back(rec);
+        }
+    }
+
+    const SectionData sections[] = {
+        section(SceneSectionType::Materials, materials.data(), materials.size()),
+        section(SceneSectionType::Meshes, meshes.data(), meshes.size()),
+        section(SceneSectionType::Positions, positions.data(), positions.size()),
+        section(SceneSectionType::Normals, normals.data(), normals.size()),
+        section(SceneSectionType::TexCoords, uvs.data(), uvs.size()),
+        section(SceneSectionType::Indices, indices.data(), indices.size()),
+        section(SceneSectionType::Objects, objects.data(), objects.size()),
+        section(SceneSectionType::BvhNodes, nodes.data(), nodes.size()),
+        section(SceneSectionType::BvhPrimitives, primitives.data(), primitives.size()),
+        section(SceneSectionType::Shapes, shapes.data(), shapes.size()),
+        section(SceneSectionType::Instances, instances.data(), instances.size())
+    };
+    constexpr size_t SECTION_COUNT = sizeof(sections) / sizeof(sections[0]);
+
+    // Lay out the sections after the header and table
+    SceneSection table[SECTION_COUNT] = {};
+    uint64_t offset = align_up(sizeof(SceneFileHeader) + sizeof(table));
+    for (size_t i = 0; i < SECTION_COUNT; i++)
+    {
+        table[i].type = sections[i].type;
+        table[i].record_size = sections[i].record_size;
+        table[i].offset = offset;
+        table[i].count = sections[i].count;
+        offset = align_up(offset + sections[i].count * sections[i].record_size);
+    }
+
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_FILE_VERSION;
+    header.byte_order = SCENE_FILE_BYTE_ORDER;
+    header.file_size = offset;
+    header.section_count = uint32_t(SECTION_COUNT);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error(std::string("unable to open '") + path + "' for writing");
+
+    const char padding[SCENE_SECTION_ALIGNMENT] = {};
+    uint64_t written = 0;
+    const auto write = [&](const void* data, const uint64_t size)
+    {
+        out.write(static_cast<const char*>(data), std::streamsize(size));
+        written += size;
+    };
+    const auto pad_to = [&](const uint64_t target) { write(padding, target - written); };
+
+    write(&header, sizeof(header));
+    write(table, sizeof(table));
+    for (size_t i = 0; i < SECTION_COUNT; i++)
+    {
+        pad_to(table[i].offset);
+        write(sections[i].data, table[i].count * table[i].record_size);
+    }
+    pad_to(header.file_size);
+
+    if (!out.flush())
+        throw std::runtime_error(std::string("unable to write '") + path + "'");
+}
+
+/**
+ * Typed view of a section, checked against the file's bounds.
+ */
+template<typename T> static ArrayView<T> find_section(
+    const MappedFile& file,
+    const SceneSection* table,
+    const uint32_t section_count,
+    const SceneSectionType type
+)
+{
+    for (uint32_t i = 0; i < section_count; i++)
+    {
+        const auto& sec = table[i];
+        if (sec.type != type)
+            continue;
+
+        if (sec.record_size != sizeof(T) || sec.offset % SCENE_SECTION_ALIGNMENT != 0)
+            throw std::runtime_error("scene file section has an unexpected layout");
+
+        if (sec.offset > file.size() || sec.count > (file.size() - sec.offset) / sizeof(T))
+            throw std::runtime_error("scene file section runs past the end of the file");
+
+        return ArrayView<T>(reinterpret_cast<const T*>(file.data() + sec.offset), size_t(sec.count));
+    }
+
+    return ArrayView<T>();
+}
+
+template<typename T> static ArrayView<T> slice(const ArrayView<T> all, const uint64_t first, const uint64_t count)
+{
+    if (first > all.size() || count > all.size() - first)
+        throw std::runtime_error("scene file record refers past the end of a section");
+    return ArrayView<T>(all.data() + first, size_t(count));
+}
+
+World load_scene(const char* path)
+{
+    const auto file = std::make_shared<const MappedFile>(path);
+
+    SceneFileHeader header;
+    if (file->size() < sizeof(header))
+        throw std::runtime_error(std::string("'") + path + "' is not a scene file");
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error(std::string("'") + path + "' is not a scene file");
+    if (header.version != SCENE_FILE_VERSION)
+        throw std::runtime_error("unsupported scene file version " + std::to_string(header.version));
+    if (header.byte_order != SCENE_FILE_BYTE_ORDER)
+        throw std::runtime_error("scene file was written with a different byte order");
+    if (header.file_size != file->size()
+        || header.section_count > (file->size() - sizeof(header)) / sizeof(SceneSection))
+        throw std::runtime_error("scene file is truncated");
+
+    const auto* table = reinterpret_cast<const SceneSection*>(file->data() + sizeof(header));
+    const auto count = header.section_count;
+    const auto materials = find_section<SceneMaterialRecord>(*file, table, count, SceneSectionType::Materials);
+    const auto meshes = find_section<SceneMeshRecord>(*file, table, count, SceneSectionType::Meshes);
+    const auto positions = find_section<point3>(*file, table, count, SceneSectionType::Positions);
+    const auto normals = find_section<vec3>(*file, table, count, SceneSectionType::Normals);
+    const auto uvs = find_section<TexCoord>(*file, table, count, SceneSectionType::TexCoords);
+    const auto indices = find_section<uint32_t>(*file, table, count, SceneSectionType::Indices);
+    const auto objects = find_section<SceneObjectRecord>(*file, table, count, SceneSectionType::Objects);
+    const auto nodes = find_section<FlatBvhNode>(*file, table, count, SceneSectionType::BvhNodes);
+    const auto primitives = find_section<uint32_t>(*file, table, count, SceneSectionType::BvhPrimitives);
+    const auto shapes = find_section<SceneShapeRecord>(*file, table, count, SceneSectionType::Shapes);
+    const auto instances = find_section<SceneInstanceRecord>(*file, table, count, SceneSectionType::Instances);
+
+    if (shapes.empty())
+        throw std::runtime_error("scene file has no shapes");
+
+    World world;
+
+    for (const auto& rec : materials)
+    {
+        const color albedo(rec.albedo[0], rec.albedo[1], rec.albedo[2]);
+        switch (rec.type)
+        {
+        case SceneMaterialType::Lambertian: world.add_material(Lambertian(albedo)); break;
+        case SceneMaterialType::Metal: world.add_material(Metal(albedo, rec.parameter)); break;
+        case SceneMaterialType::Dielectric: world.add_material(Dielectric(rec.parameter)); break;
+        default: throw std::runtime_error("unknown material type in scene file");
+        }
+    }
+
+    std::vector<std::shared_ptr<const TriangleMesh>> mesh_data = {};
+    for (const auto& rec : meshes)
+    {
+        if (rec.index_count % 3 != 0)
+            throw std::runtime_error("scene file mesh has a partial triangle");
+        if (rec.shape >= shapes.size())
+            throw std::runtime_error("scene file mesh belongs to a missing shape");
+
+        // Triangles read their vertices through these, so one bad index would read out of bounds
+        const auto mesh_indices = slice(indices, rec.first_index, rec.index_count);
+        for (const uint32_t index : mesh_indices)
+        {
+            if (index >= rec.vertex_count)
+                throw std::runtime_error("scene file mesh index refers to a missing vertex");
+        }
+
+        mesh_data.push_back(std::make_shared<const TriangleMesh>(TriangleMesh::view(
+            slice(positions, rec.first_position, rec.vertex_count),
+            mesh_indices,
+            rec.has_normals ? slice(normals, rec.first_normal, rec.vertex_count) : ArrayView<vec3>(),
+            rec.has_uvs ? slice(uvs, rec.first_uv, rec.vertex_count) : ArrayView<TexCoord>(),
+            file
+        )));
+    }
+
+    std::vector<std::shared_ptr<const Shape>> built(shapes.size());
+
+    // Fills the world or a shape with the objects, meshes and BVH of shape `id`
+    const auto load_shape = [&](const uint32_t id, auto& target)
+    {
+        const auto& shape = shapes[id];
+
+        std::unordered_map<uint32_t, const TriangleMesh*> mesh_ptrs = {};
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].shape == id)
+                mesh_ptrs[uint32_t(i)] = target.add_shared_mesh(mesh_data[i]);
+        }
+
+        for (const auto& rec : slice(objects, shape.first_object, shape.object_count))
+        {
+            if (rec.type == SceneObjectType::Instance)
+            {
+                if (rec.reference >= instances.size())
+                    throw std::runtime_error("scene file object refers to a missing instance");
+
+                const auto& inst = instances[rec.reference];
+                if (inst.shape <= id || inst.shape >= shapes.size())
+                    throw std::runtime_error("scene file instance refers to a bad shape");
+
+                target.add_instance(built[inst.shape], Transform::from_rows(inst.to_world));
+                continue;
+            }
+
+            if (rec.material >= world.materials().size())
+                throw std::runtime_error("scene file object refers to a missing material");
+
+            if (rec.type == SceneObjectType::Sphere)
+            {
+                target.add_object(Sphere(point3(rec.sphere[0], rec.sphere[1], rec.sphere[2]), rec.sphere[3], rec.material));
+                continue;
+            }
+
+            const auto mesh_it = mesh_ptrs.find(rec.reference);
+            if (mesh_it == mesh_ptrs.end())
+                throw std::runtime_error("scene file object refers to a missing mesh");
+
+            const TriangleMesh* mesh = mesh_it->second;
+            const uint32_t max_count = rec.type == SceneObjectType::Triangle ? 1 : uint32_t(TrianglePacket::WIDTH);
+            if (rec.count == 0 || rec.count > max_count)
+                throw std::runtime_error("scene file object has a bad triangle count");
+            for (uint32_t i = 0; i < rec.count; i++)
+            {
+                if (rec.triangles[i] >= mesh->triangle_count())
+                    throw std::runtime_error("scene file object refers to a missing triangle");
+            }
+
+            if (rec.type == SceneObjectType::Triangle)
+                target.add_object(Triangle(mesh, rec.triangles[0], rec.material));
+            else if (rec.type == SceneObjectType::TrianglePacket)
+                target.add_object(TrianglePacket(mesh, rec.triangles, rec.count, rec.material));
+            else
+                throw std::runtime_error("unknown object type in scene file");
+        }
+
+        if (shape.object_count != 0 && shape.node_count == 0)
+            throw std::runtime_error("scene file shape has objects but no BVH");
+
+        target.set_bvh(FlatBvh::view(
+            slice(nodes, shape.first_node, shape.node_count),
+            slice(primitives, shape.first_primitive, shape.primitive_count),
+            file
+        ));
+    };
+
+    // Instanced shapes come after the ones placing them, so build from the back
+    for (uint32_t id = uint32_t(shapes.size()) - 1; id > 0; id--)
+    {
+        auto shape = std::make_shared<Shape>();
+        load_shape(id, *shape);
+        built[id] = std::move(shape);
+    }
+    load_shape(0, world);
+
+    return world;
+}
\ No newline at end of file
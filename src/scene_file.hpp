@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include "world.hpp"
+
+/**
+ * Binary scene container. A fixed header and a table of sections is followed by the sections
+ * themselves, each aligned to `SCENE_SECTION_ALIGNMENT` bytes from the start of the file. Every
+ * section is a packed array of fixed-size records in native byte order, laid out exactly as they
+ * are used in memory, so a mapped file is used in place.
+ */
+constexpr char SCENE_FILE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+constexpr uint32_t SCENE_FILE_VERSION = 2;
+constexpr uint32_t SCENE_FILE_BYTE_ORDER = 0x01020304;
+constexpr uint64_t SCENE_SECTION_ALIGNMENT = 64;
+
+enum class SceneSectionType : uint32_t
+{
+    Materials = 1,
+    Meshes,
+    Positions,
+    Normals,
+    TexCoords,
+    Indices,
+    Objects,
+    BvhNodes,
+    BvhPrimitives,
+    Shapes,
+    Instances
+};
+
+struct SceneFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint32_t section_count;
+    uint32_t reserved[9];
+};
+
+struct SceneSection
+{
+    SceneSectionType type;
+    uint32_t record_size;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t reserved;
+};
+
+enum class SceneMaterialType : uint32_t { Lambertian = 1, Metal, Dielectric };
+
+struct SceneMaterialRecord
+{
+    SceneMaterialType type;
+    float albedo[3];
+
+    // Roughness for metals, index of refraction for dielectrics
+    float parameter;
+    uint32_t reserved[3];
+};
+
+/**
+ * Offsets are in elements of the matching buffer section. Meshes without normals or texture
+ * coordinates have no entries in those sections. Only objects of the owning shape use a mesh.
+ */
+struct SceneMeshRecord
+{
+    uint64_t first_position;
+    uint64_t vertex_count;
+    uint64_t first_normal;
+    uint64_t first_uv;
+    uint64_t first_index;
+    uint64_t index_count;
+    uint32_t has_normals;
+    uint32_t has_uvs;
+    uint32_t shape;
+    uint32_t reserved;
+};
+
+/**
+ * A shape's objects, BVH nodes and BVH primitives as ranges of their sections. Shape 0 is the
+ * world's own; instances only refer to shapes after the one they're in, so there are no cycles.
+ */
+struct SceneShapeRecord
+{
+    uint64_t first_object;
+    uint64_t object_count;
+    uint64_t first_node;
+    uint64_t node_count;
+    uint64_t first_primitive;
+    uint64_t primitive_count;
+    uint64_t reserved[2];
+};
+
+struct SceneInstanceRecord
+{
+    uint32_t shape;
+    uint32_t reserved[3];
+
+    // Object to world, row-major
+    float to_world[12];
+};
+
+enum class SceneObjectType : uint32_t { Sphere = 1, Triangle, TrianglePacket, Instance };
+
+struct SceneObjectRecord
+{
+    SceneObjectType type;
+    uint32_t material;
+
+    // Mesh and number of triangles for triangles and packets, instance record for instances
+    uint32_t reference;
+    uint32_t count;
+
+    union
+    {
+        // Center and radius
+        float sphere[4];
+        uint32_t triangles[8];
+    };
+};
+
+static_assert(sizeof(SceneFileHeader) == 64, "scene header layout changed");
+static_assert(sizeof(SceneSection) == 32, "scene section layout changed");
+static_assert(sizeof(SceneMaterialRecord) == 32, "scene material layout changed");
+static_assert(sizeof(SceneMeshRecord) == 64, "scene mesh layout changed");
+static_assert(sizeof(SceneObjectRecord) == 48, "scene object layout changed");
+static_assert(sizeof(SceneShapeRecord) == 64, "scene shape layout changed");
+static_assert(sizeof(SceneInstanceRecord) == 64, "scene instance layout changed");
+
+/**
+ * Writes the materials, meshes, objects and BVH of `world` and of every shape it instances, each
+ * shape once however many times it is placed. The BVH must have been built. Throws
+ * `std::runtime_error` if the world holds an object or material the format can't describe or the
+ * file can't be written.
+ */
+void save_scene(const World& world, const char* path);
+
+/**
+ * Maps a file written by `save_scene` and builds a world that uses its mesh buffers and BVHs in
+ * place. Structure, record indices and mesh vertex indices are validated; vertex attributes are
+ * trusted. Throws `std::runtime_error` if the file is unreadable, from another version or
+ * malformed.
+ */
+World load_scene(const char* path);
\ No newline at end of file
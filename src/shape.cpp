@@ -0,0 +1,259 @@
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include "shape.hpp"
+#include "trace.hpp"
+
+static void group_triangles(const TriangleMesh&, uint32_t*, const size_t, std::vector<size_t>&);
+
+void Shape::add_mesh(TriangleMesh mesh, const MaterialId mat, const MeshLayout layout)
+{
+    const TriangleMesh* mesh_ptr = add_shared_mesh(std::make_shared<const TriangleMesh>(std::move(mesh)));
+    const size_t tri_count = mesh_ptr->triangle_count();
+
+    if (layout == MeshLayout::Triangles)
+    {
+        m_objects.reserve(m_objects.size() + tri_count);
+        for (uint32_t i = 0; i < tri_count; i++)
+            m_objects.push_back(std::make_shared<Triangle>(mesh_ptr, i, mat));
+        return;
+    }
+
+    // Grouping always starts a first packet, which would be empty
+    if (tri_count == 0)
+        return;
+
+    // Order the triangles so neighbours in space are neighbours in the list, then cut the list
+    // into packets
+    std::vector<uint32_t> order(tri_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<size_t> packet_starts = {};
+    group_triangles(*mesh_ptr, order.data(), tri_count, packet_starts);
+    packet_starts.push_back(tri_count);
+
+    for (size_t i = 0; i + 1 < packet_starts.size(); i++)
+    {
+        m_objects.push_back(std::make_shared<TrianglePacket>(
+            mesh_ptr,
+            order.data() + packet_starts[i],
+            packet_starts[i + 1] - packet_starts[i],
+            mat
+        ));
+    }
+}
+
+const TriangleMesh* Shape::add_shared_mesh(std::shared_ptr<const TriangleMesh> mesh)
+{
+    m_meshes.push_back(std::move(mesh));
+    return m_meshes.back().get();
+}
+
+void Shape::add_instance(std::shared_ptr<const Shape> shape, const Transform& to_world)
+{
+    m_objects.push_back(std::make_shared<Instance>(std::move(shape), to_world));
+}
+
+static void object_bounds(
+    const std::vector<std::shared_ptr<Hittable>>& objects,
+    aabb* bounds,
+    const size_t begin,
+    const size_t end
+)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        if (!objects[i]->bounding_box(bounds[i]))
+            throw std::runtime_error("no bounding box for an object in a Shape");
+    }
+}
+
+static inline bool same_bounds(const aabb& a, const aabb& b)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (a.min()[i] != b.min()[i] || a.max()[i] != b.max()[i])
+            return false;
+    }
+    return true;
+}
+
+void Shape::compute_bvh(const BvhBuilder builder)
+{
+    TRACE_SCOPE_ARG("compute_bvh", "objects", m_objects.size());
+    std::vector<aabb> start(m_objects.size());
+    std::vector<aabb> end(m_objects.size());
+    bool moving = false;
+    for (size_t i = 0; i < m_objects.size(); i++)
+    {
+        if (!m_objects[i]->motion_bounds(start[i], end[i]))
+            throw std::runtime_error("no bounding box for an object in a Shape");
+        moving = moving || !same_bounds(start[i], end[i]);
+    }
+
+    m_bvh = moving ? FlatBvh::build(start, end, builder) : FlatBvh::build(start, builder);
+}
+
+BvhRefitStats Shape::refit(ThreadPool& pool, const float rebuild_threshold)
+{
+    TRACE_SCOPE("refit");
+    constexpr size_t CHUNK_SIZE = 4096;
+
+    if (m_bvh.empty() && !m_objects.empty())
+        throw std::runtime_error("Shape::refit needs a BVH built with compute_bvh");
+
+    // Both keys of a moving tree would have to be refit and checked, so it is rebuilt instead
+    if (m_bvh.has_motion())
+    {
+        BvhRefitStats stats;
+        const auto start = std::chrono::steady_clock::now();
+        compute_bvh(m_bvh.builder());
+        stats.full_rebuild = true;
+        stats.rebuild_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    std::vector<aabb> bounds(m_objects.size());
+    pool.parallel_for((m_objects.size() + CHUNK_SIZE - 1) / CHUNK_SIZE, [&](const size_t chunk)
+    {
+        const size_t begin = chunk * CHUNK_SIZE;
+        object_bounds(m_objects, bounds.data(), begin, std::min(begin + CHUNK_SIZE, m_objects.size()));
+    });
+
+    return m_bvh.refit(bounds, pool, rebuild_threshold);
+}
+
+void Shape::set_bvh(FlatBvh bvh)
+{
+    for (const auto object : bvh.primitives())
+    {
+        if (object >= m_objects.size())
+            throw std::runtime_error("BVH refers to an object that doesn't exist");
+    }
+
+    m_bvh = std::move(bvh);
+}
+
+bool Shape::bounding_box(aabb& output_box) const
+{
+    if (m_bvh.empty())
+        return false;
+
+    aabb start, end;
+    motion_bounds(start, end);
+    output_box = aabb::surrounding_box(start, end);
+    return true;
+}
+
+bool Shape::motion_bounds(aabb& start, aabb& end) const
+{
+    if (m_bvh.empty())
+        return false;
+
+    start = m_bvh.nodes()[0].bounds();
+    end = m_bvh.has_motion() ? m_bvh.end_nodes()[0].bounds() : start;
+    return true;
+}
+
+
+
+Instance::Instance(std::shared_ptr<const Shape> shape, const Transform& to_world) :
+    m_shape(std::move(shape))
+{
+    set_transform(to_world);
+}
+
+void Instance::set_transform(const Transform& to_world)
+{
+    aabb start, end;
+    if (!m_shape->motion_bounds(start, end))
+        throw std::runtime_error("an instanced shape's BVH must be built first");
+
+    // Transforming a box is linear in its center and extent, so blending the transformed keys
+    // gives the transformed blend
+    m_to_object = to_world.inverse();
+    m_to_world = to_world;
+    m_bounds = m_to_world.apply_box(start);
+    m_end_bounds = m_to_world.apply_box(end);
+}
+
+bool Instance::hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const
+{
+    // Scaling changes the direction's length, and rays must have unit directions, so distances
+    // are rescaled between the two spaces
+    const vec3 dir = m_to_object.apply_vector(r.direction());
+    const float scale = dir.length();
+    const ray object_ray = ray::from_unit(m_to_object.apply_point(r.origin()), dir / scale, r.time());
+
+    if (!m_shape->hit(object_ray, t_min * scale, t_max * scale, rec))
+        return false;
+
+    // The shape faced its normal against the object space ray, and that orientation survives
+    // the normal transform, so `front_face` stays valid
+    rec.t /= scale;
+    rec.p = r.at(rec.t);
+    rec.normal = vec3::unit_vector(m_to_object.apply_transposed(rec.normal));
+    return true;
+}
+
+
+/**
+ * Recursively splits `triangles` at the median centroid along the widest axis until each group
+ * fits in a packet. The start of every group is appended to `starts`.
+ */
+void group_triangles(
+    const TriangleMesh& mesh,
+    uint32_t* triangles,
+    const size_t count,
+    std::vector<size_t>& starts
+)
+{
+    struct Range { size_t begin; size_t end; };
+    std::vector<Range> stack = { Range { 0, count } };
+
+    while (!stack.empty())
+    {
+        const auto range = stack.back();
+        stack.pop_back();
+
+        if (range.end - range.begin <= TrianglePacket::WIDTH)
+        {
+            starts.push_back(range.begin);
+            continue;
+        }
+
+        point3 lo = mesh.triangle_centroid(triangles[range.begin]);
+        point3 hi = lo;
+        for (size_t i = range.begin; i < range.end; i++)
+        {
+            const auto c = mesh.triangle_centroid(triangles[i]);
+            lo = vec3::min(lo, c);
+            hi = vec3::max(hi, c);
+        }
+
+        const auto extent = hi - lo;
+        const int axis = extent.x() > extent.y()
+            ? (extent.x() > extent.z() ? 0 : 2)
+            : (extent.y() > extent.z() ? 1 : 2);
+
+        // Split on a multiple of the packet width so only the last packet is partially filled
+        const size_t half = (range.end - range.begin) / 2;
+        const size_t mid = range.begin + std::max(
+            TrianglePacket::WIDTH,
+            (half / TrianglePacket::WIDTH) * TrianglePacket::WIDTH
+        );
+        std::nth_element(
+            triangles + range.begin,
+            triangles + mid,
+            triangles + range.end,
+            [&](const uint32_t a, const uint32_t b)
+            {
+                return mesh.triangle_centroid(a)[axis] < mesh.triangle_centroid(b)[axis];
+            }
+        );
+
+        // Pushed in reverse so groups come out in order
+        stack.push_back(Range { mid, range.end });
+        stack.push_back(Range { range.begin, mid });
+    }
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "hittable.hpp"
+#include "flat_bvh.hpp"
+#include "triangle_mesh.hpp"
+#include "transform.hpp"
+
+/**
+ * How a mesh's triangles are split into objects for the BVH.
+ */
+enum class MeshLayout
+{
+    // One object per triangle, intersected with the watertight kernel
+    Triangles,
+
+    // Spatially coherent groups of eight triangles, intersected together with SIMD
+    Packets
+};
+
+/**
+ * A set of objects in their own space with a BVH over them. The world's objects are one shape,
+ * and any shape can be placed many times through `Instance`s that share it.
+ */
+class Shape : public Hittable
+{
+public:
+
+    Shape() = default;
+
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+    Shape(Shape&&) = default;
+    Shape& operator=(Shape&&) = default;
+
+    template<typename T> inline void add_object(const T& obj)
+    {
+        m_objects.push_back(std::make_shared<T>(obj));
+    }
+
+    /**
+     * Takes ownership of `mesh` and adds its triangles to the shape using `layout`.
+     */
+    void add_mesh(TriangleMesh mesh, const MaterialId mat, const MeshLayout layout = MeshLayout::Triangles);
+
+    /**
+     * Keeps `mesh` alive for the lifetime of the shape without adding any objects for it, so
+     * objects added separately can refer to it.
+     */
+    const TriangleMesh* add_shared_mesh(std::shared_ptr<const TriangleMesh> mesh);
+
+    /**
+     * Places `shape`, whose BVH must be built, inside this one. The shape is shared, not copied.
+     */
+    void add_instance(std::shared_ptr<const Shape> shape, const Transform& to_world);
+
+    inline size_t object_count() const noexcept { return m_objects.size(); }
+
+    inline const std::vector<std::shared_ptr<Hittable>>& objects() const noexcept { return m_objects; }
+    inline const std::vector<std::shared_ptr<const TriangleMesh>>& meshes() const noexcept { return m_meshes; }
+    inline const FlatBvh& bvh() const noexcept { return m_bvh; }
+
+    /**
+     * Builds the BVH over every object added so far with `builder`. When any of them move while
+     * the shutter is open the BVH keeps bounds at both ends of the interval. Must be called again
+     * after adding objects.
+     */
+    void compute_bvh(const BvhBuilder builder = BvhBuilder::Sah);
+
+    /**
+     * Updates the BVH after objects moved, rebuilding the parts that degraded too far. See
+     * `FlatBvh::refit`. A BVH with motion keys is rebuilt in full instead. Throws
+     * `std::runtime_error` if the BVH hasn't been built.
+     */
+    BvhRefitStats refit(ThreadPool& pool, const float rebuild_threshold = FlatBvh::DEFAULT_REBUILD_THRESHOLD);
+
+    /**
+     * Uses a BVH built earlier over the current objects, in the same order, instead of building
+     * one. Throws `std::runtime_error` if it refers to objects that don't exist.
+     */
+    void set_bvh(FlatBvh bvh);
+
+    inline bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const override
+    {
+        return m_bvh.traverse(r, t_min, t_max, [&](const uint32_t object, float& closest)
+        {
+            if (!m_objects[object]->hit(r, t_min, closest, rec))
+                return false;
+            closest = rec.t;
+            return true;
+        });
+    }
+
+    /**
+     * Bounds of the BVH's root over the whole shutter interval. False until the BVH is built.
+     */
+    bool bounding_box(aabb& output_box) const override;
+
+    bool motion_bounds(aabb& start, aabb& end) const override;
+
+private:
+
+    FlatBvh m_bvh;
+    std::vector<std::shared_ptr<Hittable>> m_objects;
+    std::vector<std::shared_ptr<const TriangleMesh>> m_meshes;
+};
+
+/**
+ * A shared `Shape` placed in the world with an affine transform. Rays are moved into the
+ * shape's space instead of moving the shape, so any number of instances cost one shape's memory.
+ */
+class Instance : public Hittable
+{
+public:
+
+    /**
+     * The shape's BVH must already be built. Throws `std::runtime_error` if it isn't or if
+     * `to_world` is singular.
+     */
+    Instance(std::shared_ptr<const Shape> shape, const Transform& to_world);
+
+    inline const std::shared_ptr<const Shape>& get_shape() const noexcept { return m_shape; }
+    inline const Transform& get_transform() const noexcept { return m_to_world; }
+
+    /**
+     * Moves the instance. Also picks up changes to the shape's bounds after it was refit. The BVH
+     * holding the instance must be refit or rebuilt afterwards.
+     */
+    void set_transform(const Transform& to_world);
+
+    bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const override;
+
+    inline bool bounding_box(aabb& output_box) const override
+    {
+        output_box = aabb::surrounding_box(m_bounds, m_end_bounds);
+        return true;
+    }
+
+    inline bool motion_bounds(aabb& start, aabb& end) const override
+    {
+        start = m_bounds;
+        end = m_end_bounds;
+        return true;
+    }
+
+private:
+
+    std::shared_ptr<const Shape> m_shape;
+    Transform m_to_world;
+    Transform m_to_object;
+
+    // The shape's bounds in world space when the shutter opens and closes
+    aabb m_bounds;
+    aabb m_end_bounds;
+};
\ No newline at end of file
@@ -1,8 +1,13 @@
 #include "sphere.hpp"
 
 Sphere::Sphere(const point3& center, const float radius, const MaterialId mat) :
+    Sphere(center, center, radius, mat)
+{}
+
+Sphere::Sphere(const point3& center, const point3& center_end, const float radius, const MaterialId mat) :
     m_mat(mat),
     m_center(center),
+    m_motion(center_end - center),
     m_radius(radius),
     m_sqr_radius(radius * radius)
 {}
\ No newline at end of file
@@ -10,29 +10,50 @@ public:
 
     Sphere(const point3& center, const float radius, const MaterialId mat);
 
+    /**
+     * A sphere moving from `center` when the shutter opens to `center_end` when it closes.
+     */
+    Sphere(const point3& center, const point3& center_end, const float radius, const MaterialId mat);
+
     inline float get_radius() const noexcept { return m_radius; }
 
     inline point3 get_center() const noexcept { return m_center; }
 
+    inline point3 get_center_end() const noexcept { return m_center + m_motion; }
+
+    inline bool is_moving() const noexcept { return m_motion.x() != 0.0f || m_motion.y() != 0.0f || m_motion.z() != 0.0f; }
+
+    /**
+     * Moves the sphere, keeping how far it travels while the shutter is open. The BVH holding
+     * it must be refit or rebuilt afterwards.
+     */
+    inline void set_center(const point3& center) noexcept { m_center = center; }
+
+    inline point3 center_at(const float time) const noexcept { return m_center + time * m_motion; }
+
+    inline MaterialId get_material() const noexcept { return m_mat; }
+
     bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const override
     {
-        const auto oc = r.origin() - m_center;
-        const auto a = r.direction().length_squared();
+        // Ray directions are unit length so the quadratic's `a` term is always 1
+        RAY_STAT(primitive_tests, 1);
+        const auto center = center_at(r.time());
+        const auto oc = r.origin() - center;
         const auto half_b = vec3::dot(
             oc, 
             r.direction()
         );
         const auto c = oc.length_squared() - m_sqr_radius;
-        const auto discriminant = half_b*half_b - a*c;
+        const auto discriminant = half_b*half_b - c;
 
         if (discriminant < 0) return false;
 
         const auto sqrtd = std::sqrt(discriminant);
 
-        auto root = (-half_b - sqrtd) / a;
+        auto root = -half_b - sqrtd;
         if (root < t_min || t_max < root)
         {
-            root = (-half_b + sqrtd) / a;
+            root = -half_b + sqrtd;
             if (root < t_min || t_max < root)
                 return false;
         }
@@ -40,7 +61,7 @@ public:
         rec.t = root;
         rec.p = r.at(rec.t);
         rec.mat = m_mat;
-        const vec3 outward_normal = (rec.p - m_center) / m_radius;
+        const vec3 outward_normal = (rec.p - center) / m_radius;
         rec.set_face_normal(r, outward_normal);
 
         return true;
@@ -48,17 +69,25 @@ public:
 
     bool bounding_box(aabb& output_box) const override 
     {
-        output_box = aabb(
-            m_center - vec3(m_radius, m_radius, m_radius),
-            m_center + vec3(m_radius, m_radius, m_radius)
-        );
+        aabb start, end;
+        motion_bounds(start, end);
+        output_box = aabb::surrounding_box(start, end);
+        return true;
+    }
+
+    bool motion_bounds(aabb& start, aabb& end) const override
+    {
+        const vec3 extent(m_radius, m_radius, m_radius);
+        start = aabb(m_center - extent, m_center + extent);
+        end = aabb(start.min() + m_motion, start.max() + m_motion);
         return true;
     }
 
 private:
 
     const MaterialId m_mat;
-    const point3 m_center;
+    point3 m_center;
+    vec3 m_motion;
     const float m_radius;
     const float m_sqr_radius;
 };
\ No newline at end of file
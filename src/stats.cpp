@@ -0,0 +1,73 @@
+#include "stats.hpp"
+
+thread_local RayStats g_ray_stats;
+
+void RayStats::merge(const RayStats& other)
+{
+    paths += other.paths;
+    rays += other.rays;
+    bounces += other.bounces;
+    normalizations += other.normalizations;
+    normalizations_saved += other.normalizations_saved;
+    reciprocals += other.reciprocals;
+    box_tests += other.box_tests;
+    nodes_visited += other.nodes_visited;
+    primitive_tests += other.primitive_tests;
+    depth_terminated += other.depth_terminated;
+}
+
+static inline double ratio(const uint64_t n, const uint64_t d)
+{
+    return double(n) / double(d > 0 ? d : 1);
+}
+
+static inline double mrays_per_second(const uint64_t rays, const double seconds)
+{
+    return seconds > 0.0 ? double(rays) / seconds * 1e-6 : 0.0;
+}
+
+void RayStats::report(std::ostream& out, const double seconds) const
+{
+    const uint64_t traced = traced_rays();
+
+    out << "Traced rays: " << traced << " (" << paths << " camera, " << bounces << " bounce), "
+        << mrays_per_second(traced, seconds) << " Mrays/s\n"
+        << "Average path length: " << ratio(traced, paths)
+        << " rays, terminated by depth: " << depth_terminated << "\n"
+        << "Per ray: " << ratio(box_tests, traced) << " box tests, "
+        << ratio(nodes_visited, traced) << " nodes visited, "
+        << ratio(primitive_tests, traced) << " primitive tests\n"
+        << "Paths: " << paths << ", rays: " << rays
+        << " (" << ratio(rays, paths) << " per path)\n"
+        << "Normalizations: " << normalizations
+        << ", saved: " << normalizations_saved
+        << " (" << ratio(normalizations_saved, bounces) << " per bounce)\n"
+        << "Reciprocals: " << reciprocals
+        << ", skipped: " << (rays - reciprocals)
+        << " (" << ratio(rays - reciprocals, bounces) << " per bounce)\n";
+}
+
+void RayStats::write_json(std::ostream& out, const double seconds) const
+{
+    const uint64_t traced = traced_rays();
+
+    out << "{\n"
+        << "    \"seconds\": " << seconds << ",\n"
+        << "    \"mrays_per_second\": " << mrays_per_second(traced, seconds) << ",\n"
+        << "    \"camera_rays\": " << paths << ",\n"
+        << "    \"bounce_rays\": " << bounces << ",\n"
+        << "    \"traced_rays\": " << traced << ",\n"
+        << "    \"box_tests\": " << box_tests << ",\n"
+        << "    \"nodes_visited\": " << nodes_visited << ",\n"
+        << "    \"primitive_tests\": " << primitive_tests << ",\n"
+        << "    \"depth_terminated\": " << depth_terminated << ",\n"
+        << "    \"average_path_length\": " << ratio(traced, paths) << ",\n"
+        << "    \"box_tests_per_ray\": " << ratio(box_tests, traced) << ",\n"
+        << "    \"nodes_visited_per_ray\": " << ratio(nodes_visited, traced) << ",\n"
+        << "    \"primitive_tests_per_ray\": " << ratio(primitive_tests, traced) << ",\n"
+        << "    \"rays\": " << rays << ",\n"
+        << "    \"normalizations\": " << normalizations << ",\n"
+        << "    \"normalizations_saved\": " << normalizations_saved << ",\n"
+        << "    \"reciprocals\": " << reciprocals << "\n"
+        << "}\n";
+}
\ No newline at end of file
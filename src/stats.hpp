@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+#ifndef ENABLE_STATS
+    #define ENABLE_STATS 1
+#endif
+
+/**
+ * Counters describing the work done while tracing paths. Each thread accumulates into its own
+ * `g_ray_stats` without synchronization, and the renderer merges them once the threads finish.
+ */
+struct RayStats
+{
+    // Camera rays, one per path
+    uint64_t paths = 0;
+
+    // Rays constructed, including scattered rays that are never traced
+    uint64_t rays = 0;
+
+    // Scattered rays that were followed to another intersection test
+    uint64_t bounces = 0;
+
+    // Directions normalized when constructing a ray
+    uint64_t normalizations = 0;
+
+    // Normalizations avoided because the direction was already known to be unit length
+    uint64_t normalizations_saved = 0;
+
+    // Inverse directions computed for traversal. Rays that are never traversed skip this
+    uint64_t reciprocals = 0;
+
+    // Ray-box tests against BVH nodes, and the nodes whose boxes were hit
+    uint64_t box_tests = 0;
+    uint64_t nodes_visited = 0;
+
+    // Ray-primitive tests. A packet of triangles tested at once counts once
+    uint64_t primitive_tests = 0;
+
+    // Paths cut off by the bounce limit rather than absorbed or escaping to the sky
+    uint64_t depth_terminated = 0;
+
+    void merge(const RayStats& other);
+
+    /**
+     * Rays followed to an intersection test: a camera ray for every path and its bounces.
+     */
+    inline uint64_t traced_rays() const noexcept { return paths + bounces; }
+
+    /**
+     * Writes a human readable summary of work done in `seconds`: throughput in millions of traced
+     * rays a second, traversal work per ray and the work saved per bounce.
+     */
+    void report(std::ostream& out, const double seconds) const;
+
+    /**
+     * Writes the counters, throughput and per-ray averages as a JSON object.
+     */
+    void write_json(std::ostream& out, const double seconds) const;
+};
+
+extern thread_local RayStats g_ray_stats;
+
+#if ENABLE_STATS
+    #define RAY_STAT(field, n) (g_ray_stats.field += (n))
+#else
+    #define RAY_STAT(field, n) ((void)0)
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+ThreadPool::ThreadPool(const size_t thread_count) :
+    m_workers(),
+    m_tasks(),
+    m_pending(0),
+    m_stop(false)
+{
+    assert(thread_count > 0);
+    TRACE_SCOPE_ARG("spawn threads", "threads", thread_count);
+
+    for (size_t i = 0; i < thread_count; i++)
+        m_workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_task_ready.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        m_pending++;
+    }
+    m_task_ready.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void ThreadPool::parallel_for(const size_t count, const std::function<void(size_t)>& fn)
+{
+    if (count == 0)
+        return;
+
+    TRACE_SCOPE_ARG("parallel_for", "count", count);
+    std::atomic<size_t> next(0);
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+
+    const size_t task_count = std::min(count, m_workers.size());
+    for (size_t t = 0; t < task_count; t++)
+    {
+        submit([&]
+        {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            {
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                    next = count;
+                }
+            }
+        });
+    }
+
+    wait();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ThreadPool::worker_loop()
+{
+    trace_thread_name("pool worker");
+
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            // Gaps between a worker's tasks show up as idle spans on its track
+            TRACE_SCOPE("idle");
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_ready.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_stop && m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+            if (m_pending == 0)
+                m_tasks_done.notify_all();
+        }
+    }
+}
\ No newline at end of file
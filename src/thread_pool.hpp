@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that stay alive for the lifetime of the pool, so work that is
+ * dispatched repeatedly doesn't pay for thread creation every time.
+ */
+class ThreadPool
+{
+public:
+
+    explicit ThreadPool(const size_t thread_count);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    inline size_t size() const noexcept { return m_workers.size(); }
+
+    /**
+     * Queues `task` to run on one of the workers.
+     */
+    void submit(std::function<void()> task);
+
+    /**
+     * Blocks until every task submitted so far has finished.
+     */
+    void wait();
+
+    /**
+     * Calls `fn(i)` for every `i` in `[0, count)`. Indices are handed out dynamically so uneven
+     * work balances itself. Returns once every call has finished. The first exception thrown by
+     * `fn` is rethrown here.
+     */
+    void parallel_for(const size_t count, const std::function<void(size_t)>& fn);
+
+private:
+
+    void worker_loop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_ready;
+    std::condition_variable m_tasks_done;
+    size_t m_pending;
+    bool m_stop;
+};
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+// Events each thread keeps before overwriting its oldest, about 2.5 MB
+constexpr size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+std::atomic<bool> g_trace_enabled(false);
+
+/**
+ * One thread's events. Only the owning thread writes; `count` is published after each event so
+ * a reader sees whole events.
+ */
+struct TraceBuffer
+{
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> count;
+    uint32_t tid;
+    std::string name;
+};
+
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    uint64_t epoch_ns = 0;
+};
+
+// Buffers outlive their threads, so workers of a pool that's gone still show up
+static TraceRegistry& registry()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+static thread_local std::shared_ptr<TraceBuffer> t_buffer;
+
+static TraceBuffer& thread_buffer()
+{
+    if (!t_buffer)
+    {
+        auto buffer = std::make_shared<TraceBuffer>();
+        buffer->events.resize(TRACE_BUFFER_EVENTS);
+        buffer->count = 0;
+
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffer->tid = uint32_t(reg.buffers.size() + 1);
+        reg.buffers.push_back(buffer);
+        t_buffer = std::move(buffer);
+    }
+    return *t_buffer;
+}
+
+void trace_start()
+{
+    {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.epoch_ns = trace_now_ns();
+    }
+    g_trace_enabled.store(true);
+}
+
+void trace_record(const TraceEvent& event)
+{
+    auto& buffer = thread_buffer();
+    const uint64_t index = buffer.count.load(std::memory_order_relaxed);
+    buffer.events[index % TRACE_BUFFER_EVENTS] = event;
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void trace_thread_name(const char* name)
+{
+    if (!g_trace_enabled.load(std::memory_order_relaxed))
+        return;
+
+    auto& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+void trace_write(std::ostream& out)
+{
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    char line[512];
+    bool first = true;
+    uint64_t dropped = 0;
+    const auto separator = [&]() -> const char*
+    {
+        const char* s = first ? "\n" : ",\n";
+        first = false;
+        return s;
+    };
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (const auto& buffer : reg.buffers)
+    {
+        if (!buffer->name.empty())
+        {
+            std::snprintf(line, sizeof(line), "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                buffer->tid, buffer->name.c_str());
+            out << separator() << line;
+        }
+
+        const uint64_t count = buffer->count.load(std::memory_order_acquire);
+        const uint64_t begin = count > TRACE_BUFFER_EVENTS ? count - TRACE_BUFFER_EVENTS : 0;
+        dropped += begin;
+
+        for (uint64_t i = begin; i < count; i++)
+        {
+            const auto& e = buffer->events[i % TRACE_BUFFER_EVENTS];
+            const double ts = double(int64_t(e.start_ns - reg.epoch_ns)) * 1e-3;
+            const double dur = double(e.duration_ns) * 1e-3;
+            int n = std::snprintf(line, sizeof(line), "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+                e.name, buffer->tid, ts, dur);
+            if (e.arg_name != nullptr)
+                n += std::snprintf(line + n, sizeof(line) - size_t(n), ", \"args\": {\"%s\": %lld}", e.arg_name, (long long)e.arg);
+            out << separator() << line << "}";
+        }
+    }
+
+    out << "\n], \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+}
+
+void trace_save(const char* path)
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        throw std::runtime_error(std::string("unable to open '") + path + "' for writing");
+
+    trace_write(out);
+    if (!out.flush())
+        throw std::runtime_error(std::string("unable to write '") + path + "'");
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#ifndef ENABLE_TRACE
+    #define ENABLE_TRACE 1
+#endif
+
+/**
+ * A span of time one thread spent in a traced scope. `name` and `arg_name` must be string
+ * literals, or otherwise outlive the trace.
+ */
+struct TraceEvent
+{
+    const char* name;
+    const char* arg_name;
+    int64_t arg;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+/**
+ * Whether scopes are being recorded. Read on every traced scope, so a disabled trace costs one
+ * relaxed load and a branch.
+ */
+extern std::atomic<bool> g_trace_enabled;
+
+inline uint64_t trace_now_ns() noexcept
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Starts recording. Timestamps in the output count from here.
+ */
+void trace_start();
+
+/**
+ * Appends `event` to the calling thread's ring buffer, which is made on the thread's first
+ * event. Once a buffer is full each event replaces the thread's oldest. Lock free apart from
+ * making the buffer.
+ */
+void trace_record(const TraceEvent& event);
+
+/**
+ * Names the calling thread in the trace.
+ */
+void trace_thread_name(const char* name);
+
+/**
+ * Writes every thread's events in the Chrome trace event format, which chrome://tracing and
+ * Perfetto open. Threads should be idle, since buffers are read without locking them out.
+ */
+void trace_write(std::ostream& out);
+
+/**
+ * `trace_write`s to `path`. Throws `std::runtime_error` if the file can't be written.
+ */
+void trace_save(const char* path);
+
+/**
+ * Records the time from construction to destruction as an event on the current thread, when
+ * tracing is enabled.
+ */
+class TraceScope
+{
+public:
+
+    inline explicit TraceScope(const char* name, const char* arg_name = nullptr, const int64_t arg = 0) noexcept :
+        m_name(name),
+        m_arg_name(arg_name),
+        m_arg(arg),
+        m_start(g_trace_enabled.load(std::memory_order_relaxed) ? trace_now_ns() : 0)
+    {}
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    inline ~TraceScope()
+    {
+        if (m_start != 0)
+            trace_record(TraceEvent { m_name, m_arg_name, m_arg, m_start, trace_now_ns() - m_start });
+    }
+
+private:
+
+    const char* m_name;
+    const char* m_arg_name;
+    int64_t m_arg;
+    uint64_t m_start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if ENABLE_TRACE
+    #define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+    #define TRACE_SCOPE_ARG(name, arg_name, arg) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, arg_name, int64_t(arg))
+#else
+    #define TRACE_SCOPE(name) ((void)0)
+    #define TRACE_SCOPE_ARG(name, arg_name, arg) ((void)0)
+#endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include "vec3.hpp"
+#include "aabb.hpp"
+
+/**
+ * Affine transform stored as a 3x4 matrix: a linear part and a translation. Kept as four column
+ * vectors so applying it is three multiply-adds.
+ */
+class Transform
+{
+public:
+
+    inline Transform() :
+        m_cols{ vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(0, 0, 0) }
+    {}
+
+    /**
+     * From twelve values in row-major order: each row is three linear terms then a translation.
+     */
+    inline static Transform from_rows(const float* m)
+    {
+        Transform t;
+        t.m_cols[0] = vec3(m[0], m[4], m[8]);
+        t.m_cols[1] = vec3(m[1], m[5], m[9]);
+        t.m_cols[2] = vec3(m[2], m[6], m[10]);
+        t.m_cols[3] = vec3(m[3], m[7], m[11]);
+        return t;
+    }
+
+    /**
+     * Writes the twelve values `from_rows` takes.
+     */
+    inline void to_rows(float* m) const noexcept
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 4; col++)
+                m[row * 4 + col] = m_cols[col][row];
+        }
+    }
+
+    inline static Transform translate(const vec3& offset)
+    {
+        Transform t;
+        t.m_cols[3] = offset;
+        return t;
+    }
+
+    inline static Transform scale(const vec3& factors)
+    {
+        Transform t;
+        t.m_cols[0] = vec3(factors.x(), 0, 0);
+        t.m_cols[1] = vec3(0, factors.y(), 0);
+        t.m_cols[2] = vec3(0, 0, factors.z());
+        return t;
+    }
+
+    /**
+     * Right-handed rotation of `degrees` around `axis`.
+     */
+    inline static Transform rotate(const vec3& axis, const float degrees)
+    {
+        const auto a = vec3::unit_vector(axis);
+        const float theta = degrees_to_radians(degrees);
+        const float c = std::cos(theta);
+        const float s = std::sin(theta);
+        const float k = 1.0f - c;
+
+        Transform t;
+        t.m_cols[0] = vec3(a.x() * a.x() * k + c, a.y() * a.x() * k + a.z() * s, a.z() * a.x() * k - a.y() * s);
+        t.m_cols[1] = vec3(a.x() * a.y() * k - a.z() * s, a.y() * a.y() * k + c, a.z() * a.y() * k + a.x() * s);
+        t.m_cols[2] = vec3(a.x() * a.z() * k + a.y() * s, a.y() * a.z() * k - a.x() * s, a.z() * a.z() * k + c);
+        return t;
+    }
+
+    inline point3 apply_point(const point3& p) const noexcept
+    {
+        return vec3::fma(m_cols[0], vec3(p.x(), p.x(), p.x()),
+            vec3::fma(m_cols[1], vec3(p.y(), p.y(), p.y()),
+            vec3::fma(m_cols[2], vec3(p.z(), p.z(), p.z()), m_cols[3])));
+    }
+
+    inline vec3 apply_vector(const vec3& v) const noexcept
+    {
+        return vec3::fma(m_cols[0], vec3(v.x(), v.x(), v.x()),
+            vec3::fma(m_cols[1], vec3(v.y(), v.y(), v.y()),
+            m_cols[2] * vec3(v.z(), v.z(), v.z())));
+    }
+
+    /**
+     * Multiplies by the transpose of the linear part. Applied on an inverse transform this maps
+     * normals the way the forward transform maps points.
+     */
+    inline vec3 apply_transposed(const vec3& v) const noexcept
+    {
+        return vec3(vec3::dot(m_cols[0], v), vec3::dot(m_cols[1], v), vec3::dot(m_cols[2], v));
+    }
+
+    /**
+     * Box around the transformed corners of `box`.
+     */
+    inline aabb apply_box(const aabb& box) const noexcept
+    {
+        point3 lo = apply_point(box.min());
+        point3 hi = lo;
+        for (int corner = 1; corner < 8; corner++)
+        {
+            const point3 p = apply_point(point3(
+                (corner & 1) ? box.max().x() : box.min().x(),
+                (corner & 2) ? box.max().y() : box.min().y(),
+                (corner & 4) ? box.max().z() : box.min().z()
+            ));
+            lo = vec3::min(lo, p);
+            hi = vec3::max(hi, p);
+        }
+        return aabb(lo, hi);
+    }
+
+    /**
+     * `*this` applied after `other`.
+     */
+    inline Transform operator*(const Transform& other) const noexcept
+    {
+        Transform t;
+        for (int i = 0; i < 3; i++)
+            t.m_cols[i] = apply_vector(other.m_cols[i]);
+        t.m_cols[3] = apply_point(other.m_cols[3]);
+        return t;
+    }
+
+    inline float determinant() const noexcept
+    {
+        return vec3::dot(m_cols[0], vec3::cross(m_cols[1], m_cols[2]));
+    }
+
+    /**
+     * Throws `std::runtime_error` if the transform is singular.
+     */
+    inline Transform inverse() const
+    {
+        const float det = determinant();
+        if (!(std::abs(det) > 1e-20f) || !std::isfinite(det))
+            throw std::runtime_error("transform is not invertible");
+
+        // Rows of the inverse linear part are the cross products of the columns
+        const float inv_det = 1.0f / det;
+        const vec3 r0 = inv_det * vec3::cross(m_cols[1], m_cols[2]);
+        const vec3 r1 = inv_det * vec3::cross(m_cols[2], m_cols[0]);
+        const vec3 r2 = inv_det * vec3::cross(m_cols[0], m_cols[1]);
+
+        Transform t;
+        t.m_cols[0] = vec3(r0.x(), r1.x(), r2.x());
+        t.m_cols[1] = vec3(r0.y(), r1.y(), r2.y());
+        t.m_cols[2] = vec3(r0.z(), r1.z(), r2.z());
+        t.m_cols[3] = -t.apply_vector(m_cols[3]);
+        return t;
+    }
+
+private:
+
+    vec3 m_cols[4];
+};
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include <stdexcept>
+#include <utility>
+#include "triangle_mesh.hpp"
+
+TriangleMesh::TriangleMesh(
+    std::vector<point3> positions,
+    std::vector<uint32_t> indices,
+    std::vector<vec3> normals,
+    std::vector<TexCoord> uvs
+) :
+    m_position_data(std::move(positions)),
+    m_normal_data(std::move(normals)),
+    m_uv_data(std::move(uvs)),
+    m_index_data(std::move(indices))
+{
+    bind_storage();
+}
+
+TriangleMesh::TriangleMesh(const TriangleMesh& other) :
+    m_positions(other.m_positions),
+    m_normals(other.m_normals),
+    m_uvs(other.m_uvs),
+    m_indices(other.m_indices),
+    m_position_data(other.m_position_data),
+    m_normal_data(other.m_normal_data),
+    m_uv_data(other.m_uv_data),
+    m_index_data(other.m_index_data),
+    m_backing(other.m_backing)
+{
+    bind_storage();
+}
+
+TriangleMesh::TriangleMesh(TriangleMesh&& other) noexcept :
+    m_positions(other.m_positions),
+    m_normals(other.m_normals),
+    m_uvs(other.m_uvs),
+    m_indices(other.m_indices),
+    m_position_data(std::move(other.m_position_data)),
+    m_normal_data(std::move(other.m_normal_data)),
+    m_uv_data(std::move(other.m_uv_data)),
+    m_index_data(std::move(other.m_index_data)),
+    m_backing(std::move(other.m_backing))
+{
+    bind_storage();
+
+    other.m_positions = {};
+    other.m_normals = {};
+    other.m_uvs = {};
+    other.m_indices = {};
+}
+
+TriangleMesh& TriangleMesh::operator=(const TriangleMesh& other)
+{
+    if (this != &other)
+        *this = TriangleMesh(other);
+    return *this;
+}
+
+TriangleMesh& TriangleMesh::operator=(TriangleMesh&& other) noexcept
+{
+    if (this != &other)
+    {
+        m_positions = other.m_positions;
+        m_normals = other.m_normals;
+        m_uvs = other.m_uvs;
+        m_indices = other.m_indices;
+        m_position_data = std::move(other.m_position_data);
+        m_normal_data = std::move(other.m_normal_data);
+        m_uv_data = std::move(other.m_uv_data);
+        m_index_data = std::move(other.m_index_data);
+        m_backing = std::move(other.m_backing);
+        bind_storage();
+
+        other.m_positions = {};
+        other.m_normals = {};
+        other.m_uvs = {};
+        other.m_indices = {};
+    }
+    return *this;
+}
+
+TriangleMesh TriangleMesh::view(
+    ArrayView<point3> positions,
+    ArrayView<uint32_t> indices,
+    ArrayView<vec3> normals,
+    ArrayView<TexCoord> uvs,
+    std::shared_ptr<const void> backing
+)
+{
+    TriangleMesh mesh;
+    mesh.m_positions = positions;
+    mesh.m_indices = indices;
+    mesh.m_normals = normals;
+    mesh.m_uvs = uvs;
+    mesh.m_backing = std::move(backing);
+    return mesh;
+}
+
+void TriangleMesh::bind_storage() noexcept
+{
+    if (m_backing != nullptr)
+        return;
+
+    m_positions = m_position_data;
+    m_normals = m_normal_data;
+    m_uvs = m_uv_data;
+    m_indices = m_index_data;
+}
+
+TriangleMesh TriangleMesh::uv_sphere(
+    const point3& center,
+    const float radius,
+    const uint32_t rings,
+    const uint32_t segments
+)
+{
+    const uint32_t columns = segments + 1;
+    std::vector<point3> positions = {};
+    std::vector<vec3> normals = {};
+    std::vector<TexCoord> uvs = {};
+    std::vector<uint32_t> indices = {};
+    positions.reserve(size_t(rings + 1) * columns);
+    normals.reserve(size_t(rings + 1) * columns);
+    uvs.reserve(size_t(rings + 1) * columns);
+    indices.reserve(size_t(rings) * segments * 6);
+
+    for (uint32_t ring = 0; ring <= rings; ring++)
+    {
+        const float v = float(ring) / float(rings);
+        const float theta = v * PI;
+        for (uint32_t seg = 0; seg <= segments; seg++)
+        {
+            const float u = float(seg) / float(segments);
+            const float phi = u * 2.0f * PI;
+            const vec3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            positions.push_back(center + radius * n);
+            normals.push_back(n);
+            uvs.push_back(TexCoord { u, v });
+        }
+    }
+
+    for (uint32_t ring = 0; ring < rings; ring++)
+    {
+        for (uint32_t seg = 0; seg < segments; seg++)
+        {
+            const uint32_t i0 = ring * columns + seg;
+            const uint32_t i1 = i0 + columns;
+
+            // Wound so the geometric normal faces outwards
+            indices.insert(indices.end(), { i0, i0 + 1, i1 });
+            indices.insert(indices.end(), { i0 + 1, i1 + 1, i1 });
+        }
+    }
+
+    return TriangleMesh(std::move(positions), std::move(indices), std::move(normals), std::move(uvs));
+}
+
+size_t TriangleMesh::memory_usage() const noexcept
+{
+    return m_positions.size() * sizeof(point3)
+        + m_normals.size() * sizeof(vec3)
+        + m_uvs.size() * sizeof(TexCoord)
+        + m_indices.size() * sizeof(uint32_t);
+}
+
+static inline int max_dimension(const vec3& v)
+{
+    return (v.x() > v.y())
+        ? (v.x() > v.z() ? 0 : 2)
+        : (v.y() > v.z() ? 1 : 2);
+}
+
+bool intersect_triangle(
+    const ray& r,
+    const point3& p0,
+    const point3& p1,
+    const point3& p2,
+    const float t_min,
+    const float t_max,
+    float& t,
+    float& b0,
+    float& b1,
+    float& b2
+)
+{
+    // Permute the axes so the ray travels along +z, then shear so it becomes (0, 0, 1)
+    const vec3 dir = r.direction();
+    const int kz = max_dimension(vec3::abs(dir));
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    if (dir[kz] < 0.0f) std::swap(kx, ky);
+
+    const float sz = 1.0f / dir[kz];
+    const float sx = dir[kx] * sz;
+    const float sy = dir[ky] * sz;
+
+    const vec3 a = p0 - r.origin();
+    const vec3 b = p1 - r.origin();
+    const vec3 c = p2 - r.origin();
+
+    const float ax = a[kx] - sx * a[kz];
+    const float ay = a[ky] - sy * a[kz];
+    const float bx = b[kx] - sx * b[kz];
+    const float by = b[ky] - sy * b[kz];
+    const float cx = c[kx] - sx * c[kz];
+    const float cy = c[ky] - sy * c[kz];
+
+    // Scaled barycentrics as 2D edge functions
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    // Fall back to double precision on an edge so neighbouring triangles agree
+    if (u == 0.0f || v == 0.0f || w == 0.0f)
+    {
+        u = float(double(cx) * double(by) - double(cy) * double(bx));
+        v = float(double(ax) * double(cy) - double(ay) * double(cx));
+        w = float(double(bx) * double(ay) - double(by) * double(ax));
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+
+    // On slivers, such as the ones left where an edge collapses, the edge functions are mostly
+    // rounding error and the hit distance would be meaningless
+    const float det = u + v + w;
+    const float det_error = 0x1.0p-22f * (
+        std::abs(cx * by) + std::abs(cy * bx)
+        + std::abs(ax * cy) + std::abs(ay * cx)
+        + std::abs(bx * ay) + std::abs(by * ax)
+    );
+    if (std::abs(det) <= det_error)
+        return false;
+
+    const float az = sz * a[kz];
+    const float bz = sz * b[kz];
+    const float cz = sz * c[kz];
+    const float inv_det = 1.0f / det;
+    const float hit_t = (u * az + v * bz + w * cz) * inv_det;
+
+    if (hit_t <= t_min || hit_t >= t_max)
+        return false;
+
+    t = hit_t;
+    b0 = u * inv_det;
+    b1 = v * inv_det;
+    b2 = w * inv_det;
+    return true;
+}
+
+void triangle_hit_record(
+    const ray& r,
+    const TriangleMesh& mesh,
+    const uint32_t triangle,
+    const MaterialId mat,
+    const float t,
+    const float b0,
+    const float b1,
+    const float b2,
+    HitRecord& rec
+)
+{
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.mat = mat;
+
+    vec3 outward_normal;
+    if (mesh.has_normals())
+    {
+        outward_normal = b0 * mesh.normal(triangle, 0)
+            + b1 * mesh.normal(triangle, 1)
+            + b2 * mesh.normal(triangle, 2);
+    }
+    else
+    {
+        const auto& p0 = mesh.vertex(triangle, 0);
+        outward_normal = vec3::cross(mesh.vertex(triangle, 1) - p0, mesh.vertex(triangle, 2) - p0);
+    }
+
+    rec.set_face_normal(r, vec3::unit_vector(outward_normal));
+}
+
+
+
+Triangle::Triangle(const TriangleMesh* mesh, const uint32_t index, const MaterialId mat) :
+    m_mesh(mesh),
+    m_index(index),
+    m_mat(mat)
+{}
+
+bool Triangle::hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const
+{
+    RAY_STAT(primitive_tests, 1);
+    float t, b0, b1, b2;
+    if (!intersect_triangle(
+        r,
+        m_mesh->vertex(m_index, 0),
+        m_mesh->vertex(m_index, 1),
+        m_mesh->vertex(m_index, 2),
+        t_min,
+        t_max,
+        t, b0, b1, b2
+    ))
+        return false;
+
+    triangle_hit_record(r, *m_mesh, m_index, m_mat, t, b0, b1, b2, rec);
+    return true;
+}
+
+
+
+TrianglePacket::TrianglePacket(
+    const TriangleMesh* mesh,
+    const uint32_t* indices,
+    const size_t count,
+    const MaterialId mat
+) :
+    m_mesh(mesh),
+    m_mat(mat)
+{
+    // |det| is at most |e1| |e2| for a unit direction, and is mostly rounding error within this
+    // fraction of it, the same bound the watertight test uses
+    constexpr float DET_EPSILON = 0x1.0p-22f;
+
+    if (count == 0 || count > WIDTH)
+        throw std::runtime_error("a TrianglePacket holds between 1 and 8 triangles");
+
+    m_valid = mask8::from_bits((1 << count) - 1);
+    m_bounds = mesh->triangle_bounds(indices[0]);
+
+    alignas(32) float min_det[WIDTH];
+    for (size_t i = 0; i < WIDTH; i++)
+    {
+        // Unused lanes repeat the last triangle and are masked off
+        const uint32_t tri = indices[i < count ? i : count - 1];
+        const auto& p0 = mesh->vertex(tri, 0);
+        const auto e1 = mesh->vertex(tri, 1) - p0;
+        const auto e2 = mesh->vertex(tri, 2) - p0;
+        m_indices[i] = tri;
+        m_v0.set(int(i), p0);
+        m_e1.set(int(i), e1);
+        m_e2.set(int(i), e2);
+        min_det[i] = DET_EPSILON * e1.length() * e2.length();
+        m_bounds = aabb::surrounding_box(m_bounds, mesh->triangle_bounds(tri));
+    }
+    m_min_det = float8::load(min_det);
+}
+
+bool TrianglePacket::hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const
+{
+    RAY_STAT(primitive_tests, 1);
+    const vec3x8 dir(r.direction());
+    const vec3x8 pvec = vec3x8::cross(dir, m_e2);
+    const float8 det = vec3x8::dot(m_e1, pvec);
+    const float8 inv_det = float8(1.0f) / det;
+
+    const vec3x8 tvec = vec3x8(r.origin()) - m_v0;
+    const float8 u = vec3x8::dot(tvec, pvec) * inv_det;
+    const vec3x8 qvec = vec3x8::cross(tvec, m_e1);
+    const float8 v = vec3x8::dot(dir, qvec) * inv_det;
+    const float8 t = vec3x8::dot(m_e2, qvec) * inv_det;
+
+    const float8 zero(0.0f);
+    const mask8 hits = m_valid
+        & (float8::abs(det) > m_min_det)
+        & (u >= zero)
+        & (v >= zero)
+        & (u + v <= float8(1.0f))
+        & (t > float8(t_min))
+        & (t < float8(t_max));
+
+    const int bits = hits.bits();
+    if (bits == 0)
+        return false;
+
+    // Closest of the hit lanes
+    int best = -1;
+    float best_t = t_max;
+    for (int lane = 0; lane < int(WIDTH); lane++)
+    {
+        if (((bits >> lane) & 1) && t[lane] < best_t)
+        {
+            best_t = t[lane];
+            best = lane;
+        }
+    }
+
+    const float b1 = u[best];
+    const float b2 = v[best];
+    triangle_hit_record(r, *m_mesh, m_indices[best], m_mat, best_t, 1.0f - b1 - b2, b1, b2, rec);
+    return true;
+}
\ No newline at end of file
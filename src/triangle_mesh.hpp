@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "array_view.hpp"
+#include "vec3.hpp"
+#include "vec3x8.hpp"
+#include "ray.hpp"
+#include "aabb.hpp"
+#include "hittable.hpp"
+
+struct TexCoord
+{
+    float u;
+    float v;
+};
+
+/**
+ * Indexed triangle mesh. Vertex attributes live in shared buffers and every triangle is three
+ * 32-bit indices into them. Normals and texture coordinates are optional; when present they are
+ * indexed by the same indices as the positions.
+ *
+ * The buffers are either owned by the mesh or borrowed from memory that `backing` keeps alive,
+ * such as a mapped scene file.
+ */
+class TriangleMesh
+{
+public:
+
+    TriangleMesh() = default;
+
+    TriangleMesh(
+        std::vector<point3> positions,
+        std::vector<uint32_t> indices,
+        std::vector<vec3> normals = {},
+        std::vector<TexCoord> uvs = {}
+    );
+
+    TriangleMesh(const TriangleMesh& other);
+    TriangleMesh(TriangleMesh&& other) noexcept;
+    TriangleMesh& operator=(const TriangleMesh& other);
+    TriangleMesh& operator=(TriangleMesh&& other) noexcept;
+
+    /**
+     * Makes a mesh that reads its buffers in place instead of copying them.
+     */
+    static TriangleMesh view(
+        ArrayView<point3> positions,
+        ArrayView<uint32_t> indices,
+        ArrayView<vec3> normals,
+        ArrayView<TexCoord> uvs,
+        std::shared_ptr<const void> backing
+    );
+
+    /**
+     * Builds a sphere out of `rings` bands of `segments` quads each, with smooth normals.
+     */
+    static TriangleMesh uv_sphere(
+        const point3& center,
+        const float radius,
+        const uint32_t rings,
+        const uint32_t segments
+    );
+
+    inline size_t triangle_count() const noexcept { return m_indices.size() / 3; }
+    inline size_t vertex_count() const noexcept { return m_positions.size(); }
+
+    inline bool has_normals() const noexcept { return !m_normals.empty(); }
+    inline bool has_uvs() const noexcept { return !m_uvs.empty(); }
+
+    inline const point3& vertex(const uint32_t triangle, const int corner) const noexcept
+    {
+        return m_positions[m_indices[3 * triangle + corner]];
+    }
+
+    inline const vec3& normal(const uint32_t triangle, const int corner) const noexcept
+    {
+        return m_normals[m_indices[3 * triangle + corner]];
+    }
+
+    inline aabb triangle_bounds(const uint32_t triangle) const noexcept
+    {
+        const auto& p0 = vertex(triangle, 0);
+        const auto& p1 = vertex(triangle, 1);
+        const auto& p2 = vertex(triangle, 2);
+        return aabb(vec3::min(p0, vec3::min(p1, p2)), vec3::max(p0, vec3::max(p1, p2)));
+    }
+
+    inline point3 triangle_centroid(const uint32_t triangle) const noexcept
+    {
+        return (vertex(triangle, 0) + vertex(triangle, 1) + vertex(triangle, 2)) / 3.0f;
+    }
+
+    /**
+     * Bytes used by the vertex, attribute and index buffers.
+     */
+    size_t memory_usage() const noexcept;
+
+    inline ArrayView<point3> positions() const noexcept { return m_positions; }
+    inline ArrayView<vec3> normals() const noexcept { return m_normals; }
+    inline ArrayView<TexCoord> uvs() const noexcept { return m_uvs; }
+    inline ArrayView<uint32_t> indices() const noexcept { return m_indices; }
+
+private:
+
+    /**
+     * Points the views at the owned buffers, unless the mesh borrows its buffers.
+     */
+    void bind_storage() noexcept;
+
+    ArrayView<point3> m_positions;
+    ArrayView<vec3> m_normals;
+    ArrayView<TexCoord> m_uvs;
+    ArrayView<uint32_t> m_indices;
+
+    std::vector<point3> m_position_data;
+    std::vector<vec3> m_normal_data;
+    std::vector<TexCoord> m_uv_data;
+    std::vector<uint32_t> m_index_data;
+    std::shared_ptr<const void> m_backing;
+};
+
+/**
+ * Watertight ray/triangle intersection (Woop, Benthin and Wald 2013). Rays passing exactly
+ * through a shared edge or vertex hit exactly one of the triangles sharing it. On a hit `t` and
+ * the barycentric coordinates of the hit point are written out.
+ */
+bool intersect_triangle(
+    const ray& r,
+    const point3& p0,
+    const point3& p1,
+    const point3& p2,
+    const float t_min,
+    const float t_max,
+    float& t,
+    float& b0,
+    float& b1,
+    float& b2
+);
+
+/**
+ * A single triangle of a `TriangleMesh`. The mesh must outlive the triangle.
+ */
+class Triangle : public Hittable
+{
+public:
+
+    Triangle(const TriangleMesh* mesh, const uint32_t index, const MaterialId mat);
+
+    inline const TriangleMesh* get_mesh() const noexcept { return m_mesh; }
+    inline uint32_t get_index() const noexcept { return m_index; }
+    inline MaterialId get_material() const noexcept { return m_mat; }
+
+    bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const override;
+
+    inline bool bounding_box(aabb& output_box) const override
+    {
+        output_box = m_mesh->triangle_bounds(m_index);
+        return true;
+    }
+
+private:
+
+    const TriangleMesh* m_mesh;
+    uint32_t m_index;
+    MaterialId m_mat;
+};
+
+/**
+ * Up to eight triangles of a `TriangleMesh` intersected together with an eight-wide
+ * Möller-Trumbore kernel. Used as a BVH leaf so one traversal step tests a whole packet.
+ */
+class TrianglePacket : public Hittable
+{
+public:
+
+    static constexpr size_t WIDTH = 8;
+
+    /**
+     * Packs the `count` triangles listed in `indices`. Throws unless there are between 1 and
+     * `WIDTH` of them.
+     */
+    TrianglePacket(
+        const TriangleMesh* mesh,
+        const uint32_t* indices,
+        const size_t count,
+        const MaterialId mat
+    );
+
+    inline const TriangleMesh* get_mesh() const noexcept { return m_mesh; }
+    inline const uint32_t* get_indices() const noexcept { return m_indices; }
+    inline MaterialId get_material() const noexcept { return m_mat; }
+
+    /**
+     * Number of triangles in the packet. Unused lanes come last.
+     */
+    inline size_t get_count() const noexcept
+    {
+        size_t count = 0;
+        for (int bits = m_valid.bits(); bits != 0; bits >>= 1) count += bits & 1;
+        return count;
+    }
+
+    bool hit(const ray& r, const float t_min, const float t_max, HitRecord& rec) const override;
+
+    inline bool bounding_box(aabb& output_box) const override
+    {
+        output_box = m_bounds;
+        return true;
+    }
+
+private:
+
+    vec3x8 m_v0;
+    vec3x8 m_e1;
+    vec3x8 m_e2;
+
+    // Smallest determinant accepted in each lane, relative to the lengths of its edges, since the
+    // determinant scales with them
+    float8 m_min_det;
+
+    mask8 m_valid;
+    uint32_t m_indices[WIDTH];
+    const TriangleMesh* m_mesh;
+    MaterialId m_mat;
+    aabb m_bounds;
+};
+
+/**
+ * Fills in the hit record for a hit on `triangle` at distance `t` with barycentrics `b0..b2`.
+ * Interpolates vertex normals when the mesh has them.
+ */
+void triangle_hit_record(
+    const ray& r,
+    const TriangleMesh& mesh,
+    const uint32_t triangle,
+    const MaterialId mat,
+    const float t,
+    const float b0,
+    const float b1,
+    const float b2,
+    HitRecord& rec
+);
\ No newline at end of file
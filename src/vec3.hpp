@@ -5,6 +5,7 @@
 #include <cmath>
 #include <iostream>
 #include "common.hpp"
+#include "fast_math.hpp"
 
 #ifdef ENABLE_SIMD 
     #include <xmmintrin.h>
@@ -25,7 +26,25 @@ public:
 #else
     inline vec3() : e{0,0,0,0} {}
 #endif
-    
+
+    /**
+     * Loads `p[0..2]` from unaligned memory. Four floats are read, so `p[3]` must be readable; its
+     * value is discarded.
+     */
+    inline static vec3 load(const float* p)
+    {
+        vec3 res;
+#if ENABLE_SIMD
+        const __m128 keep_xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        res.v = _mm_and_ps(_mm_loadu_ps(p), keep_xyz);
+#else
+        res.e[0] = p[0];
+        res.e[1] = p[1];
+        res.e[2] = p[2];
+#endif
+        return res;
+    }
+
     inline static vec3 max(const vec3& a, const vec3& b)
     {
         vec3 res;
@@ -107,6 +126,35 @@ public:
         return *this;
     }
 
+    /**
+     * Computes `a * b + c` per component. Uses a fused multiply-add when SIMD is enabled.
+     */
+    inline static vec3 fma(const vec3& a, const vec3& b, const vec3& c)
+    {
+        vec3 res;
+#if ENABLE_SIMD
+        res.v = _mm_fmadd_ps(a.v, b.v, c.v);
+#else
+        res.e[0] = std::fma(a.e[0], b.e[0], c.e[0]);
+        res.e[1] = std::fma(a.e[1], b.e[1], c.e[1]);
+        res.e[2] = std::fma(a.e[2], b.e[2], c.e[2]);
+#endif
+        return res;
+    }
+
+    inline static vec3 abs(const vec3& v)
+    {
+        vec3 res;
+#if ENABLE_SIMD
+        res.v = _mm_andnot_ps(_mm_set1_ps(-0.0f), v.v);
+#else
+        res.e[0] = std::fabs(v.e[0]);
+        res.e[1] = std::fabs(v.e[1]);
+        res.e[2] = std::fabs(v.e[2]);
+#endif
+        return res;
+    }
+
     inline static float dot(const vec3 &u, const vec3 &v)
     {
 #if ENABLE_SIMD
@@ -148,8 +196,22 @@ public:
 
     inline static vec3 unit_vector(vec3 v) 
     {
-        const auto l = v.length();
-        return v *= (1/l);
+        return v *= math_rsqrt(v.length_squared());
+    }
+
+    inline static vec3 sqrt(const vec3& v)
+    {
+        vec3 res;
+#if ENABLE_SIMD && ENABLE_FAST_MATH
+        res.v = fast_sqrt(v.v);
+#elif ENABLE_SIMD
+        res.v = _mm_sqrt_ps(v.v);
+#else
+        res.e[0] = math_sqrt(v.e[0]);
+        res.e[1] = math_sqrt(v.e[1]);
+        res.e[2] = math_sqrt(v.e[2]);
+#endif
+        return res;
     }
 
     inline float operator[](int i) const { return e[i]; }
@@ -0,0 +1,219 @@
+#pragma once
+
+// Structure-of-arrays counterpart to `vec3` that processes eight lanes at a time. This is meant
+// for batched kernels (ray packets, wavefront shading, SoA primitives).
+
+#include <cstdint>
+#include "float8.hpp"
+#include "vec3.hpp"
+
+/**
+ * Eight `vec3`s stored as three `float8`s, one per component.
+ */
+class vec3x8
+{
+public:
+
+    inline vec3x8() {}
+    inline vec3x8(const float8& x, const float8& y, const float8& z) : x(x), y(y), z(z) {}
+
+    // Broadcasts `v` to every lane
+    inline explicit vec3x8(const vec3& v) : x(v.x()), y(v.y()), z(v.z()) {}
+
+    inline vec3 get(int lane) const
+    {
+        return vec3(x.e[lane], y.e[lane], z.e[lane]);
+    }
+
+    inline void set(int lane, const vec3& v)
+    {
+        x.e[lane] = v.x();
+        y.e[lane] = v.y();
+        z.e[lane] = v.z();
+    }
+
+    /**
+     * Converts eight consecutive AoS `vec3`s into SoA form.
+     */
+    inline static vec3x8 gather(const vec3* src)
+    {
+        vec3x8 res;
+#if ENABLE_SIMD
+        // Each vec3 is four floats wide so the components sit at a stride of 4
+        const __m256i idx = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+        const float* base = src->e;
+        res.x.v = _mm256_i32gather_ps(base + 0, idx, 4);
+        res.y.v = _mm256_i32gather_ps(base + 1, idx, 4);
+        res.z.v = _mm256_i32gather_ps(base + 2, idx, 4);
+#else
+        for (int i = 0; i < 8; i++) res.set(i, src[i]);
+#endif
+        return res;
+    }
+
+    /**
+     * Gathers `src[indices[i]]` into lane `i`.
+     */
+    inline static vec3x8 gather(const vec3* src, const int32_t* indices)
+    {
+        vec3x8 res;
+#if ENABLE_SIMD
+        const __m256i idx = _mm256_slli_epi32(
+            _mm256_loadu_si256((const __m256i*)indices),
+            2
+        );
+        const float* base = src->e;
+        res.x.v = _mm256_i32gather_ps(base + 0, idx, 4);
+        res.y.v = _mm256_i32gather_ps(base + 1, idx, 4);
+        res.z.v = _mm256_i32gather_ps(base + 2, idx, 4);
+#else
+        for (int i = 0; i < 8; i++) res.set(i, src[indices[i]]);
+#endif
+        return res;
+    }
+
+    /**
+     * Writes the lanes back out as eight consecutive AoS `vec3`s.
+     */
+    inline void scatter(vec3* dst) const
+    {
+        for (int i = 0; i < 8; i++) dst[i] = get(i);
+    }
+
+    /**
+     * Writes lane `i` to `dst[indices[i]]` for every lane set in `m`.
+     */
+    inline void scatter(vec3* dst, const int32_t* indices, const mask8& m = mask8(true)) const
+    {
+        const int bits = m.bits();
+        for (int i = 0; i < 8; i++)
+        {
+            if ((bits >> i) & 1)
+                dst[indices[i]] = get(i);
+        }
+    }
+
+    inline vec3x8 operator-() const { return vec3x8(-x, -y, -z); }
+
+    inline vec3x8& operator+=(const vec3x8& o) { return *this = *this + o; }
+    inline vec3x8& operator-=(const vec3x8& o) { return *this = *this - o; }
+    inline vec3x8& operator*=(const vec3x8& o) { return *this = *this * o; }
+    inline vec3x8& operator*=(const float8& t) { return *this = *this * t; }
+
+    inline friend vec3x8 operator+(const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(a.x + b.x, a.y + b.y, a.z + b.z);
+    }
+
+    inline friend vec3x8 operator-(const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(a.x - b.x, a.y - b.y, a.z - b.z);
+    }
+
+    inline friend vec3x8 operator*(const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(a.x * b.x, a.y * b.y, a.z * b.z);
+    }
+
+    inline friend vec3x8 operator*(const vec3x8& a, const float8& t)
+    {
+        return vec3x8(a.x * t, a.y * t, a.z * t);
+    }
+
+    inline friend vec3x8 operator*(const float8& t, const vec3x8& a)
+    {
+        return a * t;
+    }
+
+    inline friend vec3x8 operator/(const vec3x8& a, const float8& t)
+    {
+        return a * (float8(1.0f) / t);
+    }
+
+    /**
+     * Computes `a * b + c` per component.
+     */
+    inline static vec3x8 fma(const vec3x8& a, const float8& b, const vec3x8& c)
+    {
+        return vec3x8(
+            float8::fma(a.x, b, c.x),
+            float8::fma(a.y, b, c.y),
+            float8::fma(a.z, b, c.z)
+        );
+    }
+
+    inline static float8 dot(const vec3x8& u, const vec3x8& v)
+    {
+        return float8::fma(u.x, v.x, float8::fma(u.y, v.y, u.z * v.z));
+    }
+
+    inline static vec3x8 cross(const vec3x8& u, const vec3x8& v)
+    {
+        return vec3x8(
+            float8::fma(u.y, v.z, -(u.z * v.y)),
+            float8::fma(u.z, v.x, -(u.x * v.z)),
+            float8::fma(u.x, v.y, -(u.y * v.x))
+        );
+    }
+
+    inline float8 length_squared() const
+    {
+        return vec3x8::dot(*this, *this);
+    }
+
+    inline float8 length() const
+    {
+        return float8::sqrt(length_squared());
+    }
+
+    inline static vec3x8 unit_vector(const vec3x8& v)
+    {
+        return v * (float8(1.0f) / v.length());
+    }
+
+    inline static vec3x8 min(const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(float8::min(a.x, b.x), float8::min(a.y, b.y), float8::min(a.z, b.z));
+    }
+
+    inline static vec3x8 max(const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(float8::max(a.x, b.x), float8::max(a.y, b.y), float8::max(a.z, b.z));
+    }
+
+    /**
+     * Per lane, returns `a` where `m` is true and `b` otherwise.
+     */
+    inline static vec3x8 select(const mask8& m, const vec3x8& a, const vec3x8& b)
+    {
+        return vec3x8(
+            float8::select(m, a.x, b.x),
+            float8::select(m, a.y, b.y),
+            float8::select(m, a.z, b.z)
+        );
+    }
+
+    inline static vec3x8 reflect(const vec3x8& v, const vec3x8& n)
+    {
+        return v - (float8(2.0f) * vec3x8::dot(v, n)) * n;
+    }
+
+    /**
+     * Lanes that are close to zero in every dimension.
+     */
+    inline mask8 near_zero() const
+    {
+        const float8 s(1e-6f);
+        return (float8::abs(x) < s) & (float8::abs(y) < s) & (float8::abs(z) < s);
+    }
+
+public:
+
+    float8 x;
+    float8 y;
+    float8 z;
+};
+
+// Type aliases for vec3x8
+using point3x8 = vec3x8;
+using colorx8 = vec3x8;
\ No newline at end of file
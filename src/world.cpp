@@ -2,13 +2,13 @@
 #include "world.hpp"
 
 World::World() :
-    m_objects(),
-    m_bvh_root(nullptr)
+    m_root(),
+    m_materials()
 {}
 
 bool World::hit(const ray& r, const float t_min, const float t_max, HitRecord& record) const
 {
-    return m_bvh_root == nullptr ? false : m_bvh_root->hit(r, t_min, t_max, record);
+    return m_root.hit(r, t_min, t_max, record);
 
     /*
     HitRecord hit_record;
@@ -29,28 +29,30 @@ bool World::hit(const ray& r, const float t_min, const float t_max, HitRecord& r
     */
 }
 
-void World::compute_bvh()
+color World::ray_color(const ray& r, FirstHit* first) const
 {
-    m_bvh_root = std::make_unique<BvhNode>(m_objects, 0, m_objects.size());
-}
-
-color World::ray_color(const ray& r) const
-{
-    constexpr float T_MIN = 0.001f;
-    constexpr float T_MAX = std::numeric_limits<float>::max();
     constexpr size_t MAX_BOUNCES = 16;
 
     HitRecord hit_record;
     color output_color = color(1, 1, 1);
     ray ray_dir = r;
+    RAY_STAT(paths, 1);
     
     for (size_t depth = 0; depth < MAX_BOUNCES; depth++)
     {
+        if (depth > 0) RAY_STAT(bounces, 1);
+
         if (hit(ray_dir, T_MIN, T_MAX, hit_record))
         {
             ray scattered;
             color attenuation;
 
+            if (depth == 0 && first != nullptr)
+            {
+                const auto& material = *m_materials[hit_record.mat];
+                *first = FirstHit { hit_record.t, hit_record.normal, material.albedo(), float(hit_record.mat) };
+            }
+
             if (m_materials[hit_record.mat]->scatter(ray_dir, hit_record, attenuation, scattered))
             {
                 output_color *= attenuation;
@@ -58,17 +60,25 @@ color World::ray_color(const ray& r) const
             }
             else
             {
-                break;
+                // Absorbed
+                return color(0, 0, 0);
             }
         }
         else
         {
-            const vec3 unit_dir = vec3::unit_vector(ray_dir.direction());
+            const vec3 unit_dir = ray_dir.direction();
+            RAY_STAT(normalizations_saved, 1);
             const auto t = 0.5f * (unit_dir.y() + 1.0f);
-            output_color *= (1.0f - t) * color(1.0f, 1.0f, 1.0f) + t*color(0.5f, 0.7f, 1.0f);
+            const color sky = (1.0f - t) * color(1.0f, 1.0f, 1.0f) + t*color(0.5f, 0.7f, 1.0f);
+
+            if (depth == 0 && first != nullptr)
+                *first = FirstHit { std::numeric_limits<float>::infinity(), vec3(0, 0, 0), sky, -1.0f };
+
+            output_color *= sky;
             return output_color;
         }
     }
 
+    RAY_STAT(depth_terminated, 1);
     return color(0, 0, 0);
-}
+}
\ No newline at end of file
@@ -1,22 +1,70 @@
 #pragma once
 
+#include <limits>
 #include <vector>
 #include <memory>
 #include "hittable.hpp"
 #include "material.hpp"
 #include "vec3.hpp"
 #include "ray.hpp"
-#include "bvh.hpp"
+#include "shape.hpp"
+
+/**
+ * What a camera ray hit first, for the AOVs. A ray that hits nothing has infinite depth, a zero
+ * normal, the sky as its albedo and material -1.
+ */
+struct FirstHit
+{
+    float depth;
+    vec3 normal;
+    color albedo;
+    float material;
+};
 
 class World
 {
 public:
 
+    // Range along a ray that counts as a hit, clear of the surface the ray left
+    static constexpr float T_MIN = 0.001f;
+    static constexpr float T_MAX = std::numeric_limits<float>::max();
+
     World();
 
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    World(World&&) = default;
+    World& operator=(World&&) = default;
+
     template<typename T> inline void add_object(const T& obj)
     {
-        m_objects.push_back(std::make_shared<T>(obj));
+        m_root.add_object(obj);
+    }
+
+    /**
+     * Takes ownership of `mesh` and adds its triangles to the world using `layout`.
+     */
+    inline void add_mesh(TriangleMesh mesh, const MaterialId mat, const MeshLayout layout = MeshLayout::Triangles)
+    {
+        m_root.add_mesh(std::move(mesh), mat, layout);
+    }
+
+    /**
+     * Keeps `mesh` alive for the lifetime of the world without adding any objects for it, so
+     * objects added separately can refer to it.
+     */
+    inline const TriangleMesh* add_shared_mesh(std::shared_ptr<const TriangleMesh> mesh)
+    {
+        return m_root.add_shared_mesh(std::move(mesh));
+    }
+
+    /**
+     * Places `shape`, whose BVH must be built, in the world. The shape is shared, not copied.
+     */
+    inline void add_instance(std::shared_ptr<const Shape> shape, const Transform& to_world)
+    {
+        m_root.add_instance(std::move(shape), to_world);
     }
 
     template<typename T> inline MaterialId add_material(const T& mat)
@@ -25,15 +73,48 @@ public:
         return m_materials.size() - 1;
     }
 
+    inline size_t object_count() const noexcept { return m_root.object_count(); }
+
+    /**
+     * The shape holding the world's own objects, including its instances.
+     */
+    inline const Shape& root() const noexcept { return m_root; }
+
+    inline const std::vector<std::shared_ptr<Hittable>>& objects() const noexcept { return m_root.objects(); }
+    inline const std::vector<std::shared_ptr<const TriangleMesh>>& meshes() const noexcept { return m_root.meshes(); }
+    inline const std::vector<std::shared_ptr<Material>>& materials() const noexcept { return m_materials; }
+    inline const FlatBvh& bvh() const noexcept { return m_root.bvh(); }
+
     bool hit(const ray& r, const float t_min, const float t_max, HitRecord& record) const;
 
-    void compute_bvh();
+    /**
+     * Builds the BVH over every object added so far with `builder`. Must be called again after
+     * adding objects.
+     */
+    inline void compute_bvh(const BvhBuilder builder = BvhBuilder::Sah) { m_root.compute_bvh(builder); }
+
+    /**
+     * Updates the BVH after objects moved. See `Shape::refit`.
+     */
+    inline BvhRefitStats refit(ThreadPool& pool, const float rebuild_threshold = FlatBvh::DEFAULT_REBUILD_THRESHOLD)
+    {
+        return m_root.refit(pool, rebuild_threshold);
+    }
+
+    /**
+     * Uses a BVH built earlier over the current objects, in the same order, instead of building
+     * one. Throws `std::runtime_error` if it refers to objects that don't exist.
+     */
+    inline void set_bvh(FlatBvh bvh) { m_root.set_bvh(std::move(bvh)); }
 
-    color ray_color(const ray& r) const;
+    /**
+     * Traces a path from `r` and returns the radiance it carries back. When `first` isn't null
+     * it is filled in from the first intersection.
+     */
+    color ray_color(const ray& r, FirstHit* first = nullptr) const;
 
 private:
 
-    std::unique_ptr<BvhNode> m_bvh_root;
-    std::vector<std::shared_ptr<Hittable>> m_objects;
+    Shape m_root;
     std::vector<std::shared_ptr<Material>> m_materials;
 };
\ No newline at end of file
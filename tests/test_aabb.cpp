@@ -0,0 +1,112 @@
+#include <iostream>
+#include <limits>
+
+#include "aabb.hpp"
+#include "ray.hpp"
+
+// Checks the slab test against the rays it has to get right exactly: rays along an axis, whose
+// zero direction components rely on the clamped reciprocal, rays grazing a face or an edge, and
+// boxes flattened to a plane, as a BVH gets around axis-aligned triangles. Built with and without
+// ENABLE_SIMD, so both branches of `aabb::hit` are covered.
+//
+// Usage: ray-tracer-tests, which exits with 1 if any check fails.
+
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+static int failures = 0;
+
+static void check(const char* name, const aabb& box, const ray& r, const bool expected, const float t_min = 0.0f, const float t_max = INF)
+{
+    if (box.hit(r, t_min, t_max) == expected)
+        return;
+
+    failures++;
+    std::cout << "FAILED: " << name << " should " << (expected ? "hit" : "miss") << std::endl;
+}
+
+static void test_axis_aligned()
+{
+    const aabb box(point3(0, 0, 0), point3(1, 1, 1));
+
+    check("along +z through the middle", box, ray(point3(0.5f, 0.5f, -1), vec3(0, 0, 1)), true);
+    check("along -z away from the box", box, ray(point3(0.5f, 0.5f, -1), vec3(0, 0, -1)), false);
+    check("along +z beside the box", box, ray(point3(2, 0.5f, -1), vec3(0, 0, 1)), false);
+    check("along +x through the middle", box, ray(point3(-1, 0.5f, 0.5f), vec3(1, 0, 0)), true);
+    check("along -y through the middle", box, ray(point3(0.5f, 2, 0.5f), vec3(0, -1, 0)), true);
+    check("along +z with negative zeros", box, ray(point3(0.5f, 0.5f, -1), vec3(-0.0f, -0.0f, 1)), true);
+    check("along +z from inside", box, ray(point3(0.5f, 0.5f, 0.5f), vec3(0, 0, 1)), true);
+    check("along +z, box past t_max", box, ray(point3(0.5f, 0.5f, -1), vec3(0, 0, 1)), false, 0.0f, 0.5f);
+    check("along +z, box before t_min", box, ray(point3(0.5f, 0.5f, -1), vec3(0, 0, 1)), false, 2.5f, INF);
+}
+
+static void test_grazing()
+{
+    const aabb box(point3(0, 0, 0), point3(1, 1, 1));
+
+    check("along the min x face", box, ray(point3(0, 0.5f, -1), vec3(0, 0, 1)), true);
+    check("along the max x face", box, ray(point3(1, 0.5f, -1), vec3(0, 0, 1)), true);
+    check("along the max x, max y edge", box, ray(point3(1, 1, -1), vec3(0, 0, 1)), true);
+    check("along the min x, min y edge", box, ray(point3(0, 0, 2), vec3(0, 0, -1)), true);
+    check("diagonally through the max x, max y edge", box, ray(point3(2, 0, 0.5f), vec3(-1, 1, 0)), true);
+    check("diagonally through a corner", box, ray(point3(2, 2, 2), vec3(1, 1, 1)), false);
+    check("diagonally onto a corner", box, ray(point3(2, 2, 2), vec3(-1, -1, -1)), true);
+    check("just outside the max x face", box, ray(point3(1.001f, 0.5f, -1), vec3(0, 0, 1)), false);
+    check("just outside the max x, max y edge", box, ray(point3(2.001f, 0, 0.5f), vec3(-1, 1, 0)), false);
+
+    // Far from the origin the slab distances carry more rounding error than the box is wide
+    const aabb far_box(point3(1e4f, 1e4f, 1e4f), point3(1e4f + 1, 1e4f + 1, 1e4f + 1));
+    check("far away, along the max x face", far_box, ray(point3(1e4f + 1, 1e4f + 0.5f, 0), vec3(0, 0, 1)), true);
+    check("far away, along the max x, max y edge", far_box, ray(point3(1e4f + 1, 1e4f + 1, 0), vec3(0, 0, 1)), true);
+}
+
+static void test_zero_thickness()
+{
+    const aabb flat(point3(0, 0, 0), point3(1, 1, 0));
+
+    check("flat, through along +z", flat, ray(point3(0.5f, 0.5f, -1), vec3(0, 0, 1)), true);
+    check("flat, through along -z", flat, ray(point3(0.5f, 0.5f, 1), vec3(0, 0, -1)), true);
+    check("flat, through obliquely", flat, ray(point3(0, 0, -1), vec3(0.5f, 0.5f, 1)), true);
+    check("flat, beside it along +z", flat, ray(point3(1.5f, 0.5f, -1), vec3(0, 0, 1)), false);
+    check("flat, within its plane", flat, ray(point3(-1, 0.5f, 0), vec3(1, 0, 0)), true);
+    check("flat, parallel above it", flat, ray(point3(-1, 0.5f, 0.1f), vec3(1, 0, 0)), false);
+    check("flat, through its edge", flat, ray(point3(1, 0.5f, -1), vec3(0, 0, 1)), true);
+
+    const aabb line(point3(0, 0, 0), point3(1, 0, 0));
+    check("line, through along +y", line, ray(point3(0.5f, -1, 0), vec3(0, 1, 0)), true);
+    check("line, along it", line, ray(point3(-1, 0, 0), vec3(1, 0, 0)), true);
+    check("line, beside it along +y", line, ray(point3(0.5f, -1, 0.1f), vec3(0, 1, 0)), false);
+
+    const aabb point(point3(1, 1, 1), point3(1, 1, 1));
+    check("point, onto it along -z", point, ray(point3(1, 1, 2), vec3(0, 0, -1)), true);
+    check("point, onto it diagonally", point, ray(point3(0, 0, 0), vec3(1, 1, 1)), true);
+}
+
+static void test_set()
+{
+    const aabb box(point3(0, 0, 0), point3(1, 1, 1));
+
+    // The reciprocal cached for the first direction must not survive `set`
+    ray r(point3(0.5f, 0.5f, -1), vec3(0, 0, 1));
+    check("before set", box, r, true);
+    r.set(point3(0.5f, 0.5f, -1), vec3(0, 0, -1), 0.0f);
+    check("after set reverses it", box, r, false);
+    r.set(point3(-1, 0.5f, 0.5f), vec3(2, 0, 0), 0.0f);
+    check("after set moves it", box, r, true);
+}
+
+int main()
+{
+    test_axis_aligned();
+    test_grazing();
+    test_zero_thickness();
+    test_set();
+
+    if (failures > 0)
+    {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
\ No newline at end of file